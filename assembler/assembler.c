@@ -0,0 +1,385 @@
+/*═════════════════════════════════════════════════════════════════════════════
+ *   assembler.c
+ *
+ *      ./assembler sum.s
+        ./assembler -t 0x400 -f binary -o sum.elf sum.s
+ *
+ *   Sintaxia (lerro bakoitzeko agindu edo direktiba bat, ';' iruzkina):
+ *
+ *      .text
+ *      loop:   ldr  r5, r2, 0        ; r5 = mem[r2 + 0]
+ *              addi r3, r3, -1
+ *              bne  r3, r0, loop
+ *              halt
+ *      .data
+ *      array:  .word 1, 2, 3
+ *              .space 64             ; bytetan, zeroz beteta
+ *
+ *════════════════════════════════════════════════════════════════════════════*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "../prometheus/defines.h"
+
+#define LINE_LENGTH    512
+#define LABEL_LENGTH   64
+#define MAX_OPERANDS   3
+
+// Iturburuko lerro bat, bi pasaldietan erabiltzeko
+typedef struct line_t {
+    unsigned int  number;
+    int           data;           // 0: .text, 1: .data
+    unsigned int  offset;         // atalaren hasieratik, hitzetan
+    char          *mnemonic;      // NULL: etiketa bakarrik
+    char          *operands;
+} line_t;
+
+typedef struct label_t {
+    char          name[LABEL_LENGTH];
+    int           data;
+    unsigned int  offset;
+} label_t;
+
+char          *source_name;
+line_t        *lines;
+unsigned int  line_count;
+label_t       *labels;
+unsigned int  label_count;
+unsigned int  text_words, data_words;
+unsigned int  text_address, data_address;
+int           binary;
+
+void __error(unsigned int line, const char *s, const char *detail);
+
+/*-----------------------------------------------------------------------------
+ *   Lehen pasaldia: lerroak, etiketak eta atalen tamaina
+ *----------------------------------------------------------------------------*/
+
+static char *trim(char *s) {
+    char *end;
+
+    while (isspace((unsigned char)*s)) s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+static label_t *find_label(const char *name) {
+    unsigned int i;
+
+    for (i = 0; i < label_count; i++)
+        if (strcmp(labels[i].name, name) == 0) return &labels[i];
+    return NULL;
+}
+
+// .word-en balio kopurua: komaz bereizitako zerrenda
+static unsigned int count_values(char *operands) {
+    unsigned int n = 1;
+
+    if (*operands == '\0') return 0;
+    for (; *operands; operands++)
+        if (*operands == ',') n++;
+    return n;
+}
+
+static void read_source(FILE *fd) {
+    char          buffer[LINE_LENGTH], *s, *colon, *space;
+    unsigned int  number = 0, capacity = 0, words[2] = {0, 0};
+    int           data = 0;
+    long          bytes;
+    line_t        *line;
+
+    while (fgets(buffer, sizeof(buffer), fd) != NULL) {
+        number++;
+        if ((s = strchr(buffer, ';')) != NULL) *s = '\0';
+        s = trim(buffer);
+
+        // Etiketa, nahi bada agindu baten aurrean
+        if ((colon = strchr(s, ':')) != NULL) {
+            *colon = '\0';
+            if (*trim(s) == '\0' || strlen(trim(s)) >= LABEL_LENGTH || strpbrk(trim(s), " \t,") != NULL)
+                __error(number, "Invalid label", s);
+            if (find_label(trim(s)) != NULL)
+                __error(number, "Duplicate label", trim(s));
+            labels = realloc(labels, (label_count + 1) * sizeof(label_t));
+            strcpy(labels[label_count].name, trim(s));
+            labels[label_count].data = data;
+            labels[label_count].offset = words[data];
+            label_count++;
+            s = trim(colon + 1);
+        }
+        if (*s == '\0') continue;
+
+        if (strcmp(s, ".text") == 0 || strcmp(s, ".data") == 0) {
+            data = s[1] == 'd';
+            continue;
+        }
+
+        if (line_count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            lines = realloc(lines, capacity * sizeof(line_t));
+        }
+        line = &lines[line_count++];
+        space = s + strcspn(s, " \t");
+        line->operands = strdup(trim(*space ? space + 1 : space));
+        *space = '\0';
+        line->mnemonic = strdup(s);
+        line->number = number;
+        line->data = data;
+        line->offset = words[data];
+
+        if (strcmp(line->mnemonic, ".word") == 0)
+            words[data] += count_values(line->operands);
+        else if (strcmp(line->mnemonic, ".space") == 0) {
+            bytes = strtol(line->operands, NULL, 0);
+            if (bytes <= 0) __error(number, "Invalid .space size", line->operands);
+            words[data] += (bytes + 3) / 4;
+        } else if (data)
+            __error(number, "Instruction in the .data section", line->mnemonic);
+        else
+            words[data]++;
+    }
+    text_words = words[0];
+    data_words = words[1];
+}
+
+/*-----------------------------------------------------------------------------
+ *   Bigarren pasaldia: aginduak kodetu
+ *----------------------------------------------------------------------------*/
+
+// Zenbaki bat edo etiketa baten helbidea, bytetan
+static long value(line_t *line, const char *operand) {
+    char     *end;
+    long     n;
+    label_t  *label;
+
+    n = strtol(operand, &end, 0);
+    if (*operand != '\0' && *end == '\0') return n;
+    if ((label = find_label(operand)) == NULL)
+        __error(line->number, "Unknown label", operand);
+    return (label->data ? data_address : text_address) + (label->offset << 2);
+}
+
+static unsigned int reg(line_t *line, const char *operand) {
+    char  *end;
+    long  n;
+
+    if (tolower((unsigned char)operand[0]) != 'r')
+        __error(line->number, "Expected a register", operand);
+    n = strtol(operand + 1, &end, 10);
+    if (operand[1] == '\0' || *end != '\0' || n < 0 || n > 15)
+        __error(line->number, "Invalid register", operand);
+    return n;
+}
+
+static long bounded(line_t *line, long n, long low, long high) {
+    if (n < low || n >= high)
+        __error(line->number, "Operand out of range", line->operands);
+    return n;
+}
+
+// Eragigaiak komaz bereizi; kopurua zuzena izan behar da
+static void split(line_t *line, char *operands, char *op[], int expected) {
+    int   n = 0;
+    char  *s = operands, *comma;
+
+    while (*s != '\0' && n < MAX_OPERANDS) {
+        comma = strchr(s, ',');
+        if (comma != NULL) *comma = '\0';
+        op[n++] = trim(s);
+        if (comma == NULL) break;
+        s = comma + 1;
+    }
+    if (n != expected || (n > 0 && *op[n - 1] == '\0'))
+        __error(line->number, "Wrong number of operands", line->mnemonic);
+}
+
+static unsigned int encode(line_t *line) {
+    char          operands[LINE_LENGTH], *op[MAX_OPERANDS];
+    const char    *m = line->mnemonic;
+    long          address;
+
+    strcpy(operands, line->operands);
+    if (strcmp(m, "halt") == 0) {
+        split(line, operands, op, 0);
+        return HALT;
+    }
+    if (strcmp(m, "jmp") == 0) {
+        split(line, operands, op, 1);
+        return JMP(bounded(line, value(line, op[0]), 0, 1 << 24));
+    }
+    if (strcmp(m, "ld") == 0 || strcmp(m, "st") == 0 || strcmp(m, "li") == 0 ||
+        strcmp(m, "la") == 0 || strcmp(m, "io") == 0) {
+        split(line, operands, op, 2);
+        address = value(line, op[1]);
+        switch (m[1]) {
+            case 'd': return LOAD(reg(line, op[0]), bounded(line, address, 0, 1 << 24));
+            case 't': return STORE(reg(line, op[0]), bounded(line, address, 0, 1 << 24));
+            case 'o': return IO(reg(line, op[0]), bounded(line, address, 1, 1 << 24));
+            default:  return LI(reg(line, op[0]), bounded(line, address, -IMMEDIATE_LIMIT, IMMEDIATE_LIMIT));
+        }
+    }
+
+    split(line, operands, op, 3);
+    if (strcmp(m, "add") == 0)
+        return ADD(reg(line, op[0]), reg(line, op[1]), reg(line, op[2]));
+    if (strcmp(m, "sub") == 0)
+        return SUB(reg(line, op[0]), reg(line, op[1]), reg(line, op[2]));
+    if (strcmp(m, "addi") == 0)
+        return ADDI(reg(line, op[0]), reg(line, op[1]), bounded(line, value(line, op[2]), -OFFSET_LIMIT, OFFSET_LIMIT));
+    if (strcmp(m, "ldr") == 0)
+        return LDR(reg(line, op[0]), reg(line, op[1]), bounded(line, value(line, op[2]), -OFFSET_LIMIT, OFFSET_LIMIT));
+    if (strcmp(m, "str") == 0)
+        return STR(reg(line, op[0]), reg(line, op[1]), bounded(line, value(line, op[2]), -OFFSET_LIMIT, OFFSET_LIMIT));
+
+    address = bounded(line, value(line, op[2]), 0, BRANCH_LIMIT);
+    if (strcmp(m, "beq") == 0)
+        return BEQ(reg(line, op[0]), reg(line, op[1]), address);
+    if (strcmp(m, "bne") == 0)
+        return BNE(reg(line, op[0]), reg(line, op[1]), address);
+    if (strcmp(m, "blt") == 0)
+        return BLT(reg(line, op[0]), reg(line, op[1]), address);
+    __error(line->number, "Unknown instruction", m);
+    return 0;
+}
+
+// Atal bakoitzeko hitzak memorian osatu: .text eta ondoren .data
+static unsigned int *assemble(void) {
+    unsigned int  i, n, *words, *cursor;
+    char          operands[LINE_LENGTH], *s, *comma;
+    line_t        *line;
+
+    words = calloc(text_words + data_words, sizeof(unsigned int));
+    for (i = 0; i < line_count; i++) {
+        line = &lines[i];
+        cursor = words + (line->data ? text_words : 0) + line->offset;
+        if (strcmp(line->mnemonic, ".space") == 0) continue;
+        if (strcmp(line->mnemonic, ".word") != 0) {
+            *cursor = encode(line);
+            continue;
+        }
+        strcpy(operands, line->operands);
+        for (s = operands, n = 0; ; n++) {
+            if ((comma = strchr(s, ',')) != NULL) *comma = '\0';
+            cursor[n] = (unsigned int)value(line, trim(s));
+            if (comma == NULL) break;
+            s = comma + 1;
+        }
+    }
+    return words;
+}
+
+/*-----------------------------------------------------------------------------
+ *   Programa idatzi, prometheus-en formatu berean
+ *----------------------------------------------------------------------------*/
+
+static void write_program(const char *file_name, unsigned int *words) {
+    program_header_t  header;
+    unsigned int      i;
+    FILE              *fd;
+
+    if ((fd = fopen(file_name, "w")) == NULL)
+        __error(0, "Error while opening file", file_name);
+    if (binary) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, PROGRAM_MAGIC, sizeof(header.magic));
+        header.text_address = text_address;
+        header.data_address = data_address;
+        header.text_words = text_words;
+        header.data_words = data_words;
+        fwrite(&header, sizeof(header), 1, fd);
+        fwrite(words, sizeof(unsigned int), text_words + data_words, fd);
+    } else {
+        fprintf(fd, ".text %06X\n.data %06X\n", text_address, data_address);
+        for (i = 0; i < text_words + data_words; i++)
+            fprintf(fd, "%08X\n", words[i]);
+    }
+    fclose(fd);
+}
+
+int main(int argc, char *argv[]) {
+    int           opt, long_index = 0;
+    char          *output = NULL, *dot;
+    unsigned int  *words;
+    FILE          *fd;
+    static struct option long_options[] = {
+        {"format",     required_argument, 0,  'f' },
+        {"help",       no_argument,       0,  'h' },
+        {"output",     required_argument, 0,  'o' },
+        {"text",       required_argument, 0,  't' },
+        {0,            0,                 0,   0  }
+    };
+
+    text_address = USER_LOWEST_ADDRESS;
+    while ((opt = getopt_long(argc, argv, ":f:ho:t:", long_options, &long_index)) != -1) {
+      switch (opt) {
+        case 'f':   /* -f or --format */
+            if (strcmp(optarg, "text") == 0)
+                binary = 0;
+            else if (strcmp(optarg, "binary") == 0)
+                binary = 1;
+            else
+                __error(0, "Unknown output format", optarg);
+            break;
+        case 'o':   /* -o or --output */
+            output = optarg;
+            break;
+        case 't':   /* -t or --text: kodearen helbidea, hitzetan lerrokatuta */
+            text_address = strtoul(optarg, NULL, 0) & ~3u;
+            break;
+        default:
+            printf ("Uso: %s [OPTIONS] programa.s\n", argv[0]);
+            printf ("  -f  --format=FMT\t"
+                "Formato del programa: text o binary [text]\n");
+            printf ("  -h, --help\t\t"
+                "Ayuda\n");
+            printf ("  -o  --output=FILE\t"
+                "Fichero de salida [programa.elf]\n");
+            printf ("  -t  --text=ADDR\t"
+                "Dirección del segmento de código en bytes [%d]\n", USER_LOWEST_ADDRESS);
+            printf ("Instrucciones: ld st add sub li la addi beq bne blt jmp ldr str io halt\n");
+            printf ("Directivas: .text .data .word .space; etiquetas 'nombre:' y comentarios con ';'\n");
+            exit(opt == 'h' ? 0 : 1);
+      }
+    }
+    if (optind != argc - 1)
+        __error(0, "Expected one source file", NULL);
+
+    source_name = argv[optind];
+    if ((fd = fopen(source_name, "r")) == NULL)
+        __error(0, "Error while opening file", source_name);
+    read_source(fd);
+    fclose(fd);
+    if (text_words == 0)
+        __error(0, "Empty .text section", NULL);
+
+    // Datuak kodearen atzetik, prometheus-ek bezala
+    data_address = text_address + (text_words << 2);
+    if (((unsigned long)data_address + (data_words << 2)) > (1UL << VIRTUAL_BITS_DEFAULT))
+        __error(0, "Program does not fit in the virtual address space", NULL);
+    words = assemble();
+
+    if (output == NULL) {
+        output = malloc(strlen(source_name) + 5);
+        strcpy(output, source_name);
+        if ((dot = strrchr(output, '.')) != NULL && strchr(dot, '/') == NULL) *dot = '\0';
+        strcat(output, ".elf");
+    }
+    write_program(output, words);
+    printf("%s: %u palabras de código, %u de datos (.text %06X, .data %06X)\n",
+           output, text_words, data_words, text_address, data_address);
+    free(words);
+    return 0;
+}
+
+void __error(unsigned int line, const char *s, const char *detail) {
+    if (line > 0)
+        fprintf(stderr, "%s:%u: ", source_name, line);
+    fprintf(stderr, "☼☼☼ %s%s%s ☼☼☼\n", s, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
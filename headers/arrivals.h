@@ -0,0 +1,22 @@
+#include "kernel_simulator.h"
+
+// Llegada de un proceso: qué programa cargar y con qué parámetros
+struct arrival
+{
+    double time;    // Segundos simulados desde el arranque
+    char *path;     // Programa a cargar (NULL para el siguiente de prometheus)
+    int priority;   // Prioridad pedida (0 si no se indica)
+    int quantum_ms; // Quantum pedido (0 para uno aleatorio)
+    int deadline_ms; // Plazo relativo a la llegada (0 sin plazo)
+    int runtime_ms;  // Presupuesto de ejecución dentro del plazo (0 todo el plazo)
+    int deferred;   // El control de admisión la ha retenido alguna vez
+    struct arrival *next;
+};
+
+// Declaración de funciones de las llegadas de procesos
+void initialize_arrivals();
+int claim_arrivals(unsigned long epoch);
+void release_arrivals(unsigned long epoch);
+void fire_arrivals();
+void queue_fixed_arrival();
+struct arrival *next_arrival();
@@ -0,0 +1,8 @@
+#include "kernel_simulator.h"
+
+// Declaración de funciones de checkpoint y restauración del estado de la máquina
+void request_checkpoint();
+void checkpoint_if_requested();
+void open_checkpoint(const char *path, struct kernel_machine *m);
+void restore_checkpoint();
+void restore_timer_state();
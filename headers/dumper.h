@@ -0,0 +1,6 @@
+#include "kernel_simulator.h"
+
+// Declaración de funciones del volcado asíncrono de procesos
+void start_dumper();
+void request_dump();
+void dump_if_requested();
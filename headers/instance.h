@@ -0,0 +1,171 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "kernel_simulator.h"
+
+#define POOL_IDLE_NS 1000000 // Espera máxima de un hilo del pool sin instancias que toquen
+#define DEADLINE_BUCKETS 496 // Histograma del tiempo de respuesta: 8 cubetas por potencia de 2
+
+// Estado de una máquina simulada. Todo lo que antes eran variables globales de los módulos
+// vive aquí, así que en un mismo proceso del host pueden correr varias máquinas independientes.
+// Los hilos de una instancia la encuentran en la variable de hilo instance
+struct instance {
+    int index;                          // Línea del fichero de --instances, 0 si sólo hay una
+    struct kernel_machine kernel_machine;
+
+    // Condiciones y mutex para la sincronización de hilos (kernel_simulator.c)
+    int timer_init_flag;
+    pthread_mutex_t timer_init_mutex;
+    pthread_cond_t timer_init_cond;
+    pthread_mutex_t timer_mutex;
+    int loader_init_flag;
+    pthread_mutex_t loader_init_mutex;
+    pthread_cond_t loader_init_cond;
+    pthread_mutex_t loader_mutex;
+    pthread_cond_t loader_run_signal;
+    int scheduler_init_flag;
+    pthread_mutex_t scheduler_init_mutex;
+    pthread_cond_t scheduler_init_cond;
+    pthread_mutex_t scheduler_mutex;
+    pthread_cond_t scheduler_run_signal;
+    pthread_mutex_t pulse_mutex; // Lo tiene el reloj mientras ejecuta los núcleos y el planificador al repartir
+
+    // Memoria física y geometría de las páginas, fijada al arrancar (memory.c)
+    word *kernel_reserved_memory;
+    word *physical_memory;
+    unsigned page_bits;     // log2 de las palabras de una página
+    unsigned frame_size;    // Palabras por frame de usuario
+    unsigned frame_count;   // Frames de la memoria de usuario
+    unsigned virtual_pages; // Entradas de cada tabla de páginas
+    unsigned huge_order;    // log2 de las páginas base que forman una página grande
+    unsigned huge_pages;    // Páginas base por página grande (1 si no se usan)
+    unsigned char *frames_used;
+    struct frame_allocator *allocator;
+    unsigned *free_frames;
+    unsigned *free_slot;
+    size_t memory_bytes;      // Tamaño de la región de memoria física reservada al host
+    unsigned sink_frame;      // Frame sumidero de los procesos sin frame
+    unsigned long tlb_refills; // Fallos de TLB que han requerido recargar una entrada
+    address (*translate)(struct HT *thread, address virtual_address);
+
+    // Memoria comprimida (zpool.c)
+    struct zpool *zpool;
+    unsigned *zpool_frames; // Frame de cada ranura del pool, PAGE_INVALID si no tiene
+    unsigned *zpool_live;   // Palabras de páginas vivas de cada ranura
+
+    // Memoria compartida con los procesos trabajadores (shared.c)
+    struct shared_control *shared_control;
+    struct pcb_pool *pcb_pool;
+
+    // Planificador (scheduler.c)
+    struct process_queue ready_queue; // Cola de procesos listos: los EDF delante, por plazo
+    unsigned long migrations[3];      // Otro hilo del núcleo, otro núcleo de la CPU, otra CPU
+    _Atomic unsigned long edf_density; // Densidad reservada por los procesos EDF vivos, en millonésimas
+    unsigned long edf_admitted;       // Procesos con plazo admitidos en la clase EDF
+    unsigned long edf_rejected;       // Procesos con plazo que no pasaron el test y van como mejor esfuerzo
+    unsigned long edf_overruns;       // Procesos EDF degradados por agotar el presupuesto
+    unsigned long edf_preemptions;    // Procesos con quantum restante expulsados por uno EDF
+
+    // Plazos de los procesos terminados; los anota el reclamador (scheduler.c)
+    pthread_mutex_t deadline_mutex;   // No se toma ningún otro cerrojo con él
+    unsigned long deadline_met;
+    unsigned long deadline_missed;
+    unsigned long tardiness;          // Suma de los pulsos de retraso de los que no cumplieron
+    long max_lateness;                // Pulsos de la terminación más tardía respecto a su plazo
+    unsigned long response_buckets[DEADLINE_BUCKETS]; // Histograma logarítmico del tiempo de respuesta
+
+    // Reloj (system_clock.c)
+    int process_completed;              // Un proceso ha terminado o se ha bloqueado, dejando un hilo libre
+    unsigned long instructions_retired; // Instrucciones ejecutadas por todos los hilos
+    unsigned long smt_stall_cycles;     // Ciclos sin emitir por compartir el núcleo
+    unsigned long oom_kills;            // Procesos terminados por quedarse sin frames
+
+    // Ejecución en lockstep (lockstep.c)
+    unsigned long lockstep_vector_lanes; // Instrucciones ejecutadas por los núcleos SIMD
+    unsigned long lockstep_scalar_lanes; // Instrucciones que han caído al camino escalar
+    struct HT **lane_thread;
+    word *lane_instr;
+    int *lane_op, *lane_r1, *lane_r2, *lane_r3;
+    address *lane_addr;
+    int *lane_column;       // Columna del hilo en el banco de registros
+    address *lane_physical; // Dirección física de las cargas
+    int lane_count;
+    void (*decode_kernel)(int blocks);
+    void (*add_kernel)(int blocks);
+    void (*load_kernel)(int blocks);
+
+    // Compilador JIT (jit.c)
+    unsigned long jit_instructions; // Instrucciones ejecutadas en código nativo
+    unsigned jit_images;            // Imágenes compiladas
+    struct jit_image **image_cache; // Indexada por el contenido del segmento .text
+    unsigned image_cache_count;
+
+    // Temporizadores (timer.c)
+    struct timer *timers;
+    unsigned timer_count;
+
+    // Cargador (program_loader.c)
+    unsigned next_pid;          // Siguiente PID a asignar
+    unsigned program_index;     // Siguiente programa de prometheus a cargar
+    unsigned long image_words;  // Palabras de los segmentos de los programas cargados
+    unsigned long mapped_words; // Palabras de los frames que respaldan esos segmentos
+    struct arrival *held_head, *held_tail; // Llegadas retenidas, en orden de llegada
+    unsigned held_count;
+    int memory_pressure;        // Se ha pasado la marca alta y aún no se ha bajado de la baja
+    unsigned long arrivals_admitted; // Procesos cargados
+    unsigned long arrivals_deferred; // Llegadas que han tenido que esperar capacidad
+    unsigned long arrivals_shed;     // Llegadas descartadas con la cola de retenidas llena
+
+    // Llegadas (arrivals.c)
+    struct arrival *trace;      // Traza leída del fichero, ordenada por instante
+    unsigned trace_count;
+    unsigned trace_next;
+    double generated_time;      // Próxima llegada de los generadores de Poisson y on/off
+    unsigned short random_state[3];
+    _Atomic unsigned long arrival_deadline; // Pulso de la próxima llegada, ULONG_MAX si no hay
+    struct arrival *pending_head, *pending_tail; // Disparadas, esperan al cargador
+
+    // Controlador de interrupciones (interrupts.c)
+    struct tick_source *ticks;
+    struct irq_slot *irq_queue;
+    _Atomic unsigned long enqueue_position;
+    _Atomic unsigned long dequeue_position;
+    _Atomic unsigned long *irq_raised;
+    _Atomic unsigned long *irq_handled;
+    _Atomic unsigned long *irq_lost;
+    void (**irq_handlers)();
+    int irq_event; // eventfd en modo semáforo: una unidad por evento encolado
+
+    // E/S (io.c)
+    struct io_subsystem *io;
+
+    // Reclamador (reclaimer.c)
+    struct reclaim_queue *reclaim_queue;
+    pthread_mutex_t reclaim_mutex; // Lo tiene quien está devolviendo memoria de procesos retirados
+    pthread_cond_t reclaim_signal;
+    int reclaim_requested;
+
+    // Modelo de energía (power.c)
+    struct core_power *core_power; // Uno por núcleo, en memoria compartida
+    _Atomic unsigned long *awake_cores; // Bit por núcleo fuera de C6; sólo se visitan esos
+
+    // Servidor de introspección (introspection.c)
+    struct introspection *introspection;
+
+    // Ejecución en el pool de --instances (instance.c)
+    unsigned long long next_pulse_ns; // Instante del host en el que toca el siguiente pulso
+    unsigned long long started_ns;
+    unsigned long steals;             // Veces que otro hilo del pool se la ha llevado
+};
+
+extern __thread struct instance *instance;
+
+// Declaración de funciones de las instancias
+struct instance *create_instance(int index);
+void create_instance_thread(pthread_t *tid, void *(*routine)());
+void run_instances(struct instance **instances, int count, int pool_threads);
+void display_instance_summary();
+
+#endif // INSTANCE_H
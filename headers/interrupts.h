@@ -0,0 +1,26 @@
+#include "kernel_simulator.h"
+
+#define IRQ_QUEUE_SIZE 4096   // Eventos en vuelo; potencia de dos
+#define IRQ_HANDLERS_DEFAULT 2
+
+// Vectores del controlador de interrupciones
+enum irq_vector {
+    IRQ_SCHEDULER,  // Temporizador del planificador
+    IRQ_GENERATOR,  // Temporizador del generador de procesos de frecuencia fija
+    IRQ_ARRIVALS,   // Llegadas de la traza o de los generadores
+    IRQ_IO,         // Fin de peticiones de E/S
+    IRQ_COMPLETION, // Un proceso ha terminado o se ha bloqueado y ha dejado un hilo libre
+    IRQ_CHECKPOINT, // Temporizador de los checkpoints
+    IRQ_DUMP,       // Temporizador de las instantáneas
+    IRQ_VECTORS
+};
+
+// Declaración de funciones del controlador de interrupciones
+void initialize_interrupts();
+void start_interrupts();
+void register_irq_handler(enum irq_vector vector, void handler());
+int raise_irq(enum irq_vector vector);
+void publish_tick();
+unsigned long current_epoch();
+unsigned long wait_for_tick(unsigned long seen);
+void display_irq_statistics();
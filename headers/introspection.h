@@ -0,0 +1,9 @@
+#include "kernel_simulator.h"
+
+#define INTROSPECTION_MAX_PROCESSES 256 // Procesos que entran en cada instantánea
+#define INTROSPECTION_MAX_CLIENTS 16
+#define INTROSPECTION_LINE 128          // Longitud máxima de una orden de un cliente
+
+// Declaración de funciones del servidor de introspección
+void start_introspection();
+void publish_introspection();
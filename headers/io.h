@@ -0,0 +1,32 @@
+#include <pthread.h>
+#include "kernel_simulator.h"
+
+// Dispositivo de E/S simulado: atiende sus peticiones de una en una y en orden de llegada.
+// Los procesos bloqueados forman la cola de peticiones enlazados por su campo next
+struct io_device {
+    struct io_device_config config;
+    struct PCB *head;          // Petición en servicio
+    struct PCB *tail;
+    unsigned long done_pulse;  // Pulso en el que termina la petición en servicio
+    unsigned queue_length;
+    unsigned max_queue_length;
+    unsigned long requests;
+    unsigned long bytes;
+    unsigned long busy_pulses; // Pulsos de servicio de las peticiones ya empezadas
+};
+
+// Subsistema de E/S, en memoria compartida: los procesos trabajadores también encolan peticiones
+struct io_subsystem {
+    pthread_mutex_t lock;
+    unsigned long next_completion; // Primer done_pulse de los dispositivos; lo vigila el temporizador
+    int device_count;
+    struct io_device devices[MAX_IO_DEVICES];
+};
+
+// Declaración de funciones de la E/S
+void initialize_io();
+void io_submit(struct PCB *process);
+int claim_io_completion(unsigned long epoch);
+void release_io_completion(unsigned long epoch);
+void io_complete();
+void display_io_statistics();
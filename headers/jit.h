@@ -0,0 +1,28 @@
+#include "kernel_simulator.h"
+
+#define JIT_MAX_IMAGES 256 // Imágenes distintas que guarda la caché de cada instancia
+
+// Imagen de un programa traducida a código nativo del host
+struct jit_image {
+    word *text;           // Copia del segmento .text con el que se compiló (clave de la caché)
+    unsigned text_words;
+    unsigned *entry;      // Desplazamiento en code del punto de entrada de cada instrucción
+    unsigned char *code;  // Código x86-64 en memoria ejecutable
+    size_t code_size;
+    unsigned slot_count;  // Páginas distintas a las que acceden las cargas y los almacenamientos
+};
+
+// Estado que comparte el código nativo con el simulador durante una ejecución
+struct jit_context {
+    struct HT *thread;
+    int remaining; // Presupuesto de instrucciones sin gastar al salir
+};
+
+// Punto de entrada de una instrucción: devuelve el pc en el que se ha parado
+typedef address (*jit_entry)(int *registers, word **slots, int budget, struct jit_context *context);
+
+// Declaración de funciones del compilador JIT
+struct jit_image *jit_lookup(const word *text, unsigned text_words);
+word *jit_translate_miss(struct jit_context *context, unsigned slot, address virtual_address);
+int jit_execute(struct HT *thread, int budget);
+address mmu_translate(struct HT *thread, address virtual_address);
@@ -9,14 +9,73 @@
 
 #include <pthread.h>
 
-#define MEMORY_SIZE 16*1024*1024
+#define USER_MEMORY_DEFAULT_MB 48   // 12M palabras de memoria de usuario
+#define USER_MEMORY_MAX_MB 16383    // Las direcciones físicas son de 32 bits en palabras
 #define KERNEL_RESERVED 4*1024*1024
-#define FRAME_SIZE 65536
-
-#define FRAME_NUMBER 192
+#define KERNEL_FRAME_SIZE 65536
 #define KERNEL_FRAME_NUMBER 64
-#define TLB_SIZE 32  
+#define PCB_POOL_SIZE KERNEL_FRAME_NUMBER // Como mucho un proceso vivo por tabla de páginas del kernel
+
+// Los programas direccionan 24 bits en bytes, es decir 2^22 palabras
+#define VIRTUAL_BITS 22
+
+// Tamaños de página (log2 de palabras) para los que se genera una traducción especializada.
+// La tabla de páginas ocupa un frame del kernel, así que como mínimo 2^(22-16) palabras.
+// Un motor especializado (make engine PAGE=N) sólo tiene el suyo
+#ifdef ENGINE_PAGE_BITS
+ #define ENGINE_VARIANT(X, BITS) X(BITS)
+ #define PAGE_BITS_VARIANTS(X) ENGINE_VARIANT(X, ENGINE_PAGE_BITS)
+ #define PAGE_BITS_MIN ENGINE_PAGE_BITS
+ #define PAGE_BITS_MAX ENGINE_PAGE_BITS
+ #define PAGE_BITS_DEFAULT ENGINE_PAGE_BITS
+#else
+ #define PAGE_BITS_VARIANTS(X) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(17) X(18) X(19) X(20)
+ #define PAGE_BITS_MIN 8
+ #define PAGE_BITS_MAX 20
+ #define PAGE_BITS_DEFAULT 16
+#endif
+
+// Entradas de la tabla de páginas
+#define PAGE_INVALID 0xFFFFFFFF
+#define PAGE_HUGE 0x80000000       // La página forma parte de una página grande
+#define PAGE_FRAME_MASK 0x7FFFFFFF
+#define PAGE_COMPRESSED 0x40000000 // La entrada es una dirección del pool de memoria comprimida (zpool.c)
+#define PAGE_IS_COMPRESSED(entry) (((entry) & (PAGE_HUGE | PAGE_COMPRESSED)) == PAGE_COMPRESSED)
+
+#define CACHE_LINE 64
+#ifndef TLB_SIZE
+ #define TLB_SIZE 32 // make engine TLB=N lo cambia
+#endif
+#define TLB_HUGE_SIZE 8
 #define REGISTERS_COUNT 16
+#define MAX_IO_DEVICES 8
+
+// Definición de los códigos de operación
+#define LOAD_OP 0
+#define STORE_OP 1
+#define ADD_OP 2
+#define IO_OP 3    // Petición de E/S: dispositivo en R1 y bytes en los 24 bits bajos
+#define SUB_OP 4
+#define LI_OP 5    // R1 = inmediato de 24 bits con signo
+#define ADDI_OP 6  // R1 = R2 + inmediato de 16 bits con signo
+#define BEQ_OP 7   // Saltos condicionales: si R1 y R2 cumplen la condición, pc = destino de 20 bits
+#define BNE_OP 8
+#define BLT_OP 9   // Comparación con signo
+#define JMP_OP 10  // Salto incondicional a la dirección de 24 bits
+#define LDR_OP 11  // R1 = memoria[R2 + inmediato de 16 bits], dirección de bytes en registro
+#define STR_OP 12  // memoria[R2 + inmediato de 16 bits] = R1
+#define HALT_OP 15
+
+// Campos de una instrucción: código de operación, registros y dirección en bytes
+#define INSTR_OP(instr) (((instr) >> 28) & 0xF)
+#define INSTR_R1(instr) (((instr) >> 24) & 0xF)
+#define INSTR_R2(instr) (((instr) >> 20) & 0xF)
+#define INSTR_R3(instr) (((instr) >> 16) & 0xF)
+#define INSTR_ADDR(instr) (((instr) & 0xFFFFFF) / 4)
+#define INSTR_IMM(instr) ((instr) & 0xFFFFFF)
+#define INSTR_SIMM24(instr) ((int)((instr) << 8) >> 8)
+#define INSTR_SIMM16(instr) ((int)((instr) << 16) >> 16)
+#define INSTR_TARGET(instr) (((instr) & 0xFFFFF) / 4) // Destino de los saltos condicionales, en palabras
 // Definir el tamaño de la TLB
 
 
@@ -25,37 +84,88 @@
 typedef unsigned address;
 typedef unsigned word;
 
+// Cabecera de los programas en el formato binario de prometheus (prometheus/defines.h).
+// Le siguen las palabras de .text y las de .data
+#define PROGRAM_MAGIC "KSIMPRG1"
+struct program_header {
+    char magic[8];
+    unsigned text_address; // En bytes
+    unsigned data_address; // En bytes
+    unsigned text_words;
+    unsigned data_words;
+};
+
 struct MM {
     address data;
     address code;
     address pgb;
 };
-enum state {NEW, READY, RUNNING};
+enum state {NEW, READY, RUNNING, BLOCKED};
 struct PCB {
     struct PCB *next;
     int pid;
     enum state state;
     int quantum_ms;
+    int priority;      // Prioridad pedida al llegar (0 por defecto)
     address pc;
     int registers[REGISTERS_COUNT];
     struct MM mm;
+    int last_cpu;      // Último hilo en el que se ejecutó (afinidad)
+    int last_core;
+    int last_thread;
+    unsigned migrations;
+    unsigned tlb_refills;
+    struct jit_image *jit; // Código nativo de la imagen del proceso (NULL para interpretar)
+    word **jit_slots;      // Páginas del host a las que accede el código nativo
+    int out_of_memory;     // No se le pudo dar frame; el reloj lo termina al acabar su ráfaga
+    int io_device;         // Petición de E/S por la que está bloqueado
+    unsigned io_bytes;
+    int image;             // Imagen del programa para el perfilador (-1 si no se perfila)
+    double energy;         // Julios de los núcleos atribuidos al proceso
+    int deadline_ms;       // Plazo pedido, relativo a la llegada (0 sin plazo)
+    long release;          // Pulso de la llegada
+    long deadline;         // Pulso en el que vence el plazo
+    int edf;               // En la clase EDF; sale de ella al agotar el presupuesto
+    int budget_cycles;     // Ciclos de presupuesto que le quedan en la clase EDF
+    unsigned density;      // Presupuesto / plazo en millonésimas, reservado por el test de admisión
+    long last_run;         // Pulso en el que dejó su último hilo, o en el que se cargó
 };
 
 struct TLB {
-    unsigned char pages[TLB_SIZE];
-    unsigned char frames[TLB_SIZE];
+    unsigned pages[TLB_SIZE];
+    unsigned frames[TLB_SIZE];
+    unsigned huge_pages[TLB_HUGE_SIZE];  // Número de página grande
+    unsigned huge_frames[TLB_HUGE_SIZE]; // Primer frame de la página grande
 };
 void clear_tlb(struct TLB *tlb);
 
+// Estado del asignador de frames. Vive en memoria compartida para que los procesos
+// trabajadores asignen y liberen frames de la misma memoria física que el coordinador
+struct frame_allocator {
+    pthread_mutex_t lock;
+    unsigned frame_high_water; // Los frames por encima no se han usado nunca
+    unsigned free_count;       // Frames en la pila de libres
+    unsigned frames_allocated; // Frames de usuario en uso
+    int kernel_frames_used[KERNEL_FRAME_NUMBER];
+};
+
+// Cada hilo ocupa líneas de caché propias: los campos calientes, que se leen en cada pulso y
+// en cada pasada del planificador, van juntos en la primera y la TLB en las siguientes
 struct HT {
     address pc;
-    struct PCB *process;
     int quantum_cycles;
-    struct TLB tlb;
-    int registers[REGISTERS_COUNT];
+    struct PCB *process;
     address PTBR;
-};
+    int smt_credit;    // Crédito de emisión cuando el núcleo está compartido
+    int lane;          // Posición del hilo en el arena y columna en el banco de registros
+    int cpu;           // Posición del hilo en la topología
+    int core;
+    int id;
+    int tlb_pid;       // Proceso al que pertenecen las entradas de la TLB
+    struct TLB tlb __attribute__((aligned(CACHE_LINE)));
+} __attribute__((aligned(CACHE_LINE)));
 
+// Tablas de topología: apuntan a tramos contiguos del arena de hilos y de la tabla de núcleos
 struct cpu_core {
     struct HT *threads;
 };
@@ -64,6 +174,34 @@ struct CPU {
     struct cpu_core *cores;
 };
 
+// Políticas de colocación de procesos en los hilos
+enum placement_policy {
+    PLACEMENT_COMPACT, // Llenar los hilos de cada núcleo en orden
+    PLACEMENT_SPREAD   // Repartir entre núcleos libres antes de compartir núcleo
+};
+
+// Políticas de frecuencia de los núcleos
+enum governor_policy {
+    GOVERNOR_PERFORMANCE, // Siempre a la frecuencia máxima
+    GOVERNOR_SCHEDUTIL,   // La menor frecuencia que cubre 1,25 veces la carga medida
+    GOVERNOR_POWERSAVE    // Siempre a la frecuencia mínima
+};
+
+// Modelo de un dispositivo de E/S: cada petición tarda latency_us más bytes / bandwidth
+struct io_device_config {
+    char name[16];
+    double latency_us;
+    double bandwidth_mbps; // MB/s
+};
+
+// Origen de las llegadas de procesos
+enum arrival_model {
+    ARRIVALS_FIXED,   // Un programa de prometheus a la frecuencia del generador de procesos
+    ARRIVALS_TRACE,   // Instantes y programas leídos de una traza
+    ARRIVALS_POISSON, // Llegadas de Poisson
+    ARRIVALS_ONOFF    // Llegadas de Poisson sólo durante los periodos activos
+};
+
 struct kernel_machine {
     unsigned clock_rate;
     unsigned scheduler_rate;
@@ -72,30 +210,98 @@ struct kernel_machine {
     int cores_per_CPU;
     int threads_per_core;
     struct CPU *CPUs;
+    int core_count;           // Núcleos de todas las CPUs
+    int thread_count;         // Hilos de todos los núcleos
+    struct cpu_core *cores;   // Todos los núcleos, en orden CPU/núcleo
+    struct HT *threads;       // Arena de hilos, en orden CPU/núcleo/hilo
+    enum placement_policy placement;
+    enum governor_policy governor;
+    unsigned smt_rate; // % de instrucciones que retira un hilo cuando comparte núcleo
+    unsigned page_bits;  // log2 de las palabras de una página
+    unsigned huge_order; // log2 de las páginas base por página grande (0 sin páginas grandes)
+    unsigned long memory_words; // Palabras de memoria física de usuario
+    int transparent_hugepages;  // Pedir al host páginas grandes transparentes para la memoria simulada
+    const char *checkpoint_path; // Fichero donde se guardan los checkpoints
+    unsigned checkpoint_period;  // Segundos simulados entre checkpoints (0 los desactiva)
+    const char *restore_path;    // Checkpoint desde el que arrancar (NULL para arrancar en frío)
+    int lockstep;      // Ejecutar todos los hilos a la vez con instrucciones SIMD
+    int lanes;         // Columnas del banco de registros (hilos redondeados a múltiplo de 8)
+    int *registers;    // Banco de registros en estructura de arrays: registers[reg * lanes + lane]
+    int jit;           // Traducir los programas a código nativo del host
+    unsigned burst;    // Instrucciones que puede retirar cada hilo en un pulso
+    int workers;       // Procesos del host entre los que se reparten las CPUs (0 para uno solo)
+    int irq_handlers;  // Hilos que atienden las interrupciones
+    unsigned dump_period;  // Segundos simulados entre instantáneas de los procesos (0 las desactiva)
+    int dump_binary;       // Instantáneas en binario en lugar de texto
+    const char *dump_pids; // PIDs separados por comas que entran en las instantáneas (NULL todos)
+    enum arrival_model arrival_model;
+    const char *arrival_trace; // Fichero de la traza de llegadas
+    double arrival_rate;       // Llegadas por segundo simulado de los generadores
+    double arrival_on;         // Segundos simulados de cada periodo activo del modelo on/off
+    double arrival_off;        // Segundos simulados de cada periodo inactivo
+    unsigned max_ready;        // Procesos en la cola de listos a partir de los que no se admiten más (0 sin límite)
+    unsigned watermark_low;    // % de frames de usuario en uso por debajo del que se vuelve a admitir
+    unsigned watermark_high;   // % de frames de usuario en uso a partir del que se retienen las cargas
+    unsigned max_pending;      // Cargas retenidas a partir de las que se descartan las llegadas (0 sin descarte)
+    unsigned zswap_cold_ms;    // Ms sin ejecutarse tras los que se comprimen las páginas de un proceso listo (0 sin compresión)
+    unsigned edf_share;        // % de las llegadas generadas que piden plazo
+    unsigned edf_deadline_ms;  // Plazo y presupuesto de esas llegadas
+    unsigned edf_runtime_ms;
+    int io_device_count;
+    struct io_device_config io_devices[MAX_IO_DEVICES];
+    unsigned profile_period;    // Pulsos entre muestras del perfilador (0 lo desactiva)
+    const char *profile_prefix; // Prefijo de los ficheros del perfil
+    unsigned long pulse_limit;  // Pulsos tras los que termina la simulación (0 sin límite)
+    int unpaced;                // Dar los pulsos seguidos, sin esperar al intervalo del reloj
+    const char *instances_path; // Fichero con una máquina por línea para ejecutarlas a la vez
+    int pool_threads;           // Hilos del host que ejecutan los pulsos de las instancias
+    const char *socket_path;    // Socket UNIX del servidor de introspección (NULL sin servidor)
+};
+
+// Estructura de la cola de procesos
+struct process_queue
+{
+    struct PCB *head;
+    struct PCB *tail;
 };
 
-// Declaraciones externas de mutex y condiciones para la sincronización de hilos
-extern pthread_mutex_t timer_init_mutex;
-extern pthread_mutex_t loader_init_mutex;
-extern pthread_mutex_t scheduler_init_mutex;
-extern pthread_cond_t timer_init_cond;
-extern pthread_cond_t loader_init_cond;
-extern pthread_cond_t scheduler_init_cond;
-extern int timer_init_flag;
-extern int loader_init_flag;
-extern int scheduler_init_flag;
+// Topología y frecuencia que recorren los bucles calientes. En un motor especializado
+// (make engine TOPO=CxNxH CLOCK=HZ) son constantes y el compilador despliega los bucles;
+// si no, se leen de la configuración de la instancia
+#ifdef ENGINE_CPUS
+ #define MACHINE_CPUS ENGINE_CPUS
+ #define MACHINE_CORES_PER_CPU ENGINE_CORES_PER_CPU
+ #define MACHINE_THREADS_PER_CORE ENGINE_THREADS_PER_CORE
+ #define MACHINE_CORE_COUNT (ENGINE_CPUS * ENGINE_CORES_PER_CPU)
+ #define MACHINE_THREAD_COUNT (MACHINE_CORE_COUNT * ENGINE_THREADS_PER_CORE)
+ #define MACHINE_LANES ((MACHINE_THREAD_COUNT + 7) & ~7)
+#else
+ #define MACHINE_CPUS (instance->kernel_machine.num_CPUs)
+ #define MACHINE_CORES_PER_CPU (instance->kernel_machine.cores_per_CPU)
+ #define MACHINE_THREADS_PER_CORE (instance->kernel_machine.threads_per_core)
+ #define MACHINE_CORE_COUNT (instance->kernel_machine.core_count)
+ #define MACHINE_THREAD_COUNT (instance->kernel_machine.thread_count)
+ #define MACHINE_LANES (instance->kernel_machine.lanes)
+#endif
+#ifdef ENGINE_CLOCK_RATE
+ #define MACHINE_CLOCK_RATE ENGINE_CLOCK_RATE
+#else
+ #define MACHINE_CLOCK_RATE (instance->kernel_machine.clock_rate)
+#endif
 
-extern pthread_mutex_t timer_mutex;
-extern pthread_cond_t clock_pulse_signal;
+// Registro reg del hilo thread en el banco de registros
+#define HT_REGISTER(thread, reg) (instance->kernel_machine.registers[(reg) * MACHINE_LANES + (thread)->lane])
 
 // Declaración de funciones
 void notify_scheduler();
 void notify_process_generator();
+void notify_loader();
 void display_threads_status();
+void display_statistics();
 void initialize_memory();
 void free_memory();
 
-// Declaración de la estructura de la máquina
-extern struct kernel_machine kernel_machine;
+// Estado de la máquina: una instancia por máquina simulada
+#include "instance.h"
 
 #endif // KERNEL_SIMULATOR_H
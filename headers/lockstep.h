@@ -0,0 +1,6 @@
+#include "kernel_simulator.h"
+
+// Declaración de funciones de la ejecución en lockstep
+void lockstep_add(struct HT *thread);
+void lockstep_run();
+address mmu_translate(struct HT *thread, address virtual_address);
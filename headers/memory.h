@@ -5,16 +5,21 @@
 // Declaraciones internas y externas de la memoria física y la memoria reservada para el kernel
 typedef unsigned address;
 typedef unsigned word;
-extern word* physical_memory;
-extern word* kernel_reserved_memory;
 
 // Declaración de las funciones para la gestión de la memoria
 void initialize_memory();
 void free_memory();
-unsigned char allocate_frame();
-unsigned char allocate_kernel_frame();
-void deallocate_frame(unsigned char frame);
-void deallocate_kernel_frame(unsigned char frame);
+unsigned allocate_frames(unsigned count);
+unsigned allocate_frame();
+unsigned allocate_kernel_frame();
+void deallocate_frame(unsigned frame);
+void deallocate_kernel_frame(unsigned frame);
+address create_pagetable();
+void map_huge_range(address pagetable, address start, address end);
+address pagetable_translate(address pagetable, address virtual_address);
+unsigned mapped_pages(address pagetable);
+void mmu_read_block(address pagetable, address virtual_address, word *buffer, unsigned count);
+int mmu_write_block(address pagetable, address virtual_address, const word *buffer, unsigned count);
 address mmu_translate(struct HT *thread, address virtual_address);
 word mmu_fetch(struct HT *thread, address virtual_address);
 void mmu_store(struct HT *thread, address virtual_address, word data);
@@ -0,0 +1,34 @@
+#include "kernel_simulator.h"
+
+#define POWER_PSTATES 4               // Frecuencias de los núcleos, en % de la máxima
+#define POWER_PSTATE_LIST {100, 75, 50, 25}
+#define POWER_GOVERNOR_PULSES 1000    // Ventana del gobernador para medir la carga de un núcleo
+#define POWER_ACTIVE_W 8.0            // Potencia dinámica de un núcleo a la frecuencia máxima
+#define POWER_STATIC_W 1.5            // Fugas de un núcleo despierto, esté ocupado o no (C0/C1)
+#define POWER_PARKED_W 0.05           // Núcleo aparcado (C6)
+#define POWER_WAKE_J 0.0002           // Energía de despertar un núcleo aparcado
+
+// Estado de energía de un núcleo. En memoria compartida: lo actualiza quien ejecuta el núcleo,
+// el reloj o un proceso trabajador, salvo wakeups, que lo cuenta el planificador
+struct core_power {
+    unsigned frequency;           // % de la frecuencia máxima
+    unsigned credit;              // Crédito de ciclos; con 100 el núcleo ejecuta el pulso
+    unsigned long window_start;   // Pulso en el que empezó la ventana del gobernador
+    unsigned long window_busy;    // Pulsos de la ventana con algún hilo ocupado
+    unsigned long awake_pulses;   // Pulsos fuera de C6
+    unsigned long busy_pulses;
+    unsigned long throttled_pulses; // Pulsos ocupados sin ejecutar por la frecuencia reducida
+    unsigned long frequency_sum;  // Suma de la frecuencia de los pulsos ocupados
+    unsigned long wakeups;
+    unsigned long completed;      // Procesos terminados en el núcleo
+    double energy;                // Julios fuera de C6, sin contar los despertares
+    double completed_energy;      // Julios atribuidos a los procesos terminados
+} __attribute__((aligned(CACHE_LINE)));
+
+// Declaración de funciones del modelo de energía
+void initialize_power();
+int power_pulse(int c, struct cpu_core *core, int busy, unsigned long epoch);
+void wake_core(struct HT *thread);
+void power_completion(struct HT *thread);
+double machine_energy();
+void display_power_statistics();
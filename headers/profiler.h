@@ -0,0 +1,18 @@
+#include <sys/types.h>
+#include "kernel_simulator.h"
+
+#define PROFILE_TABLE_SIZE 65536      // Instrucciones distintas del histograma; potencia de dos
+#define PROFILE_MAX_IMAGES 1024
+#define PROFILE_MAX_THREADS 24        // Hilos y procesos trabajadores del host con contadores
+#define PROFILE_HOST_SAMPLES 32768    // Pilas del host guardadas por hilo
+#define PROFILE_DEPTH 32              // Marcos por pila del host
+#define PROFILE_HOST_PERIOD_NS 1000000 // Tiempo de CPU del hilo entre dos muestras del host
+#define PROFILE_TOP 10                // Instrucciones y funciones que se listan en el informe
+
+// Declaración de funciones del perfilador
+void start_profiler();
+int profile_image(const char *path);
+void profile_thread(const char *name);
+void profile_process(const char *name, pid_t pid);
+void profile_tick();
+void profile_if_requested();
@@ -1,19 +1,11 @@
 #include <pthread.h>
 
-// Declaraciones externas de mutex y condiciones para la sincronización de hilos
-extern pthread_mutex_t loader_init_mutex;
-extern pthread_mutex_t loader_mutex;
-extern pthread_cond_t loader_init_cond;
-extern pthread_cond_t loader_run_signal;
-extern int loader_init_flag;
-
-extern pthread_mutex_t scheduler_mutex;
-
 // Declaración de funciones
 void add_new_task(struct PCB*);
-unsigned char allocate_frame();
-unsigned char allocate_kernel_frame();
-
-// Declaraciones externas de memoria
-extern word* physical_memory;
-extern word* kernel_reserved_memory;
+unsigned ready_count(unsigned limit);
+address create_pagetable();
+void map_huge_range(address pagetable, address start, address end);
+address pagetable_translate(address pagetable, address virtual_address);
+unsigned mapped_pages(address pagetable);
+void release_pagetable(address pagetable);
+int mmu_write_block(address pagetable, address virtual_address, const word *buffer, unsigned count);
@@ -0,0 +1,29 @@
+#include "kernel_simulator.h"
+
+// Cada proceso retirado conserva su PCB hasta que lo devuelve el reclamador, así que nunca hay
+// más que PCBs en la reserva
+#define RECLAIM_QUEUE_SIZE PCB_POOL_SIZE
+
+// Proceso terminado cuya memoria aún no se ha devuelto
+struct retired_process {
+    struct PCB *process;
+    address pagetable;
+    unsigned long epoch; // Pulso en el que terminó
+};
+
+// Cola de procesos retirados, en memoria compartida: los procesos trabajadores también
+// retiran los procesos que terminan en sus CPUs
+struct reclaim_queue {
+    pthread_mutex_t lock;
+    unsigned count;
+    unsigned max_count;        // Procesos retirados a la espera a la vez, como mucho
+    unsigned long reclaimed;   // Procesos cuya memoria ha devuelto el reclamador
+    struct retired_process entries[RECLAIM_QUEUE_SIZE];
+};
+
+// Declaración de funciones del reclamador
+void initialize_reclaimer();
+void start_reclaimer();
+void retire_process(struct PCB *process);
+void notify_reclaimer();
+void drain_reclaimer();
@@ -1,19 +1,11 @@
 #include <pthread.h>
 
-// Declaraciones externas de mutex y condiciones para la sincronización de hilos
-extern pthread_mutex_t scheduler_init_mutex;
-extern pthread_mutex_t scheduler_mutex;
-extern pthread_cond_t scheduler_init_cond;
-extern pthread_cond_t scheduler_run_signal;
-extern int scheduler_init_flag;
+#define EDF_DENSITY_LIMIT 95 // % de los hilos que puede reservar la clase EDF
+
+void wake_process(struct PCB *process);
+void account_deadline(struct PCB *process, unsigned long epoch);
+void display_deadline_statistics();
 
 #ifdef DEBUG
   void display_threads_status();
 #endif
-
-// Estructura de la cola de procesos
-struct process_queue
-{
-    struct PCB *head;
-    struct PCB *tail;
-};
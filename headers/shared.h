@@ -0,0 +1,26 @@
+#include <pthread.h>
+#include "kernel_simulator.h"
+
+// Contadores que cada proceso trabajador publica al final de cada pulso
+struct worker_stats {
+    unsigned long instructions_retired;
+    unsigned long smt_stall_cycles;
+    unsigned long tlb_refills;
+    unsigned long oom_kills;
+    int process_completed;
+} __attribute__((aligned(CACHE_LINE)));
+
+// Control de los procesos trabajadores, en memoria compartida con el coordinador
+struct shared_control {
+    pthread_barrier_t pulse_start; // El coordinador abre el pulso
+    pthread_barrier_t pulse_end;   // Todos los trabajadores han terminado el pulso
+    struct worker_stats stats[];   // Uno por trabajador
+};
+
+// Declaración de funciones de la memoria compartida entre procesos
+void *shared_alloc(size_t bytes);
+void shared_free(void *memory, size_t bytes);
+void initialize_shared_mutex(pthread_mutex_t *mutex);
+void initialize_pcb_pool();
+struct PCB *allocate_pcb();
+void free_pcb(struct PCB *process);
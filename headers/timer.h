@@ -0,0 +1,16 @@
+#include <pthread.h>
+
+#define MAX_TIMERS 8 // Número máximo de temporizadores
+
+// Estructura de un temporizador: levanta su interrupción cada target_pulse pulsos de reloj
+struct timer
+{
+    unsigned long target_pulse;
+    unsigned long pulse_counter;
+    int vector;
+};
+
+// Declaración de funciones
+void request_checkpoint();
+void request_dump();
+void restore_timer_state();
@@ -0,0 +1,42 @@
+#include "kernel_simulator.h"
+
+#define ZPOOL_MAX_PERCENT 20     // Frames de usuario que puede ocupar el pool, como mucho
+#define ZPOOL_ACCEPT_PERCENT 75  // Una página sólo se guarda si comprimida ocupa como mucho esto
+#define ZPOOL_MIN_MATCH 2        // Palabras de la repetición más corta que codifica el compresor
+#define ZPOOL_HASH_BITS 12
+#define ZPOOL_NONE 0xFFFFFFFF
+
+// Pool de memoria comprimida. Las páginas comprimidas se van añadiendo seguidas en una ranura
+// abierta, que es un frame de usuario; la entrada de la tabla de páginas guarda PAGE_COMPRESSED
+// y la dirección en el pool, ranura y palabra. Una ranura devuelve su frame cuando no le queda
+// ninguna página viva. En memoria compartida: los procesos trabajadores descomprimen en sus
+// fallos de página. Se guarda tal cual en los checkpoints, salvo el cerrojo
+struct zpool {
+    pthread_mutex_t lock;
+    unsigned open_slot;             // Ranura en la que se añaden las páginas (ZPOOL_NONE si no hay)
+    unsigned fill;                  // Palabras ocupadas de la ranura abierta
+    unsigned max_slots;             // Ranuras como mucho: ZPOOL_MAX_PERCENT de los frames
+    unsigned slots_used;            // Ranuras con frame
+    unsigned peak_slots;
+    unsigned long stored_pages;     // Páginas comprimidas que están ahora en el pool
+    unsigned long stored_words;     // Palabras que ocupan, cabeceras incluidas
+    unsigned long compressed;       // Páginas comprimidas en total
+    unsigned long original_words;   // Palabras de esas páginas antes y después de comprimirlas
+    unsigned long packed_words;
+    unsigned long zero_pages;       // Páginas a cero devueltas sin pasar por el pool
+    unsigned long rejected;         // Páginas que no comprimían lo bastante y siguen en su frame
+    unsigned long frames_reclaimed; // Frames devueltos al comprimir o descartar páginas
+    unsigned long faults;           // Fallos de página que han descomprimido una página
+    unsigned long fault_ns;         // Tiempo del host atendiendo esos fallos
+    unsigned long max_fault_ns;
+};
+
+// Declaración de funciones de la memoria comprimida
+void initialize_zpool();
+void free_zpool();
+unsigned zpool_reserve();
+void zpool_balance();
+word zpool_fault(address pagetable, unsigned page);
+void zpool_read(word entry, word *page);
+void zpool_release(word entry);
+void display_zpool_statistics();
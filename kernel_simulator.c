@@ -1,7 +1,22 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
 #include <pthread.h>
 #include "kernel_simulator.h"
+#include "checkpoint.h"
+#include "shared.h"
+#include "arrivals.h"
+#include "io.h"
+#include "interrupts.h"
+#include "profiler.h"
+#include "system_clock.h"
+#include "introspection.h"
+#include "reclaimer.h"
+#include "power.h"
+#include "scheduler.h"
+#include "zpool.h"
 
 //Colores
 #define RESET "\033[0m"
@@ -17,51 +32,415 @@ extern void *run_clock();
 extern void *run_timer();
 extern void *run_loader();
 extern void *run_scheduler();
-extern word* physical_memory;
+extern void start_workers();
+extern void start_dumper();
 
-// Estructura de la máquina simulada
-struct kernel_machine kernel_machine;
+// Definir DEBUG_PRINT si no está definido
+#ifndef DEBUG_PRINT
+#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+#endif
 
-// Condiciones y mutex para la sincronización de hilos
-pthread_cond_t clock_pulse_signal = PTHREAD_COND_INITIALIZER;
+// Procesa el modelo de llegadas de --arrivals. Las trazas tienen una línea por llegada,
+// "instante programa [prioridad [quantum_ms]]", con el instante en segundos simulados
+static void parse_arrivals(char *spec, struct kernel_machine *m) {
+    char *argument = strchr(spec, ':');
+    if (argument != NULL)
+        *argument++ = '\0';
 
-int timer_init_flag = 0;
-pthread_mutex_t timer_init_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t timer_init_cond = PTHREAD_COND_INITIALIZER;
-pthread_mutex_t timer_mutex = PTHREAD_MUTEX_INITIALIZER;
+    if (strcmp(spec, "fixed") == 0 && argument == NULL) {
+        m->arrival_model = ARRIVALS_FIXED;
+    } else if (strcmp(spec, "trace") == 0 && argument != NULL && *argument != '\0') {
+        m->arrival_model = ARRIVALS_TRACE;
+        m->arrival_trace = argument;
+    } else if (strcmp(spec, "poisson") == 0 && argument != NULL &&
+               sscanf(argument, "%lf", &m->arrival_rate) == 1 && m->arrival_rate > 0) {
+        m->arrival_model = ARRIVALS_POISSON;
+    } else if (strcmp(spec, "onoff") == 0 && argument != NULL &&
+               sscanf(argument, "%lf:%lf:%lf", &m->arrival_rate, &m->arrival_on, &m->arrival_off) == 3 &&
+               m->arrival_rate > 0 && m->arrival_on > 0 && m->arrival_off >= 0) {
+        m->arrival_model = ARRIVALS_ONOFF;
+    } else {
+        fprintf(stderr, RED"Error: Modelo de llegadas no válido: %s%s%s"RESET"\n", spec, argument ? ":" : "", argument ? argument : "");
+        exit(EXIT_FAILURE);
+    }
+}
 
-int loader_init_flag = 0;
-pthread_mutex_t loader_init_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t loader_init_cond = PTHREAD_COND_INITIALIZER;
-pthread_mutex_t loader_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t loader_run_signal = PTHREAD_COND_INITIALIZER;
+// Procesa las opciones de la línea de comandos
+static void parse_options(int argc, char *argv[], struct kernel_machine *m) {
+    int opt, long_index = 0;
+    static struct option long_options[] = {
+        {"arrivals",   required_argument, 0,  'a' },
+        {"burst",      required_argument, 0,  'B' },
+        {"checkpoint", required_argument, 0,  'c' },
+        {"checkpoint-every", required_argument, 0, 'C' },
+        {"device",     required_argument, 0,  'D' },
+        {"dump-every", required_argument, 0,  'd' },
+        {"dump-format", required_argument, 0, 'f' },
+        {"dump-pids",  required_argument, 0,  'P' },
+        {"edf-mix",    required_argument, 0,  'E' },
+        {"pulses",     required_argument, 0,  'e' },
+        {"governor",   required_argument, 0,  'g' },
+        {"help",       no_argument,       0,  'h' },
+        {"huge-order", required_argument, 0,  'H' },
+        {"instances",  required_argument, 0,  'x' },
+        {"irq-handlers", required_argument, 0, 'I' },
+        {"jit",        no_argument,       0,  'j' },
+        {"profile",    required_argument, 0,  'k' },
+        {"lockstep",   no_argument,       0,  'l' },
+        {"max-ready",  required_argument, 0,  'q' },
+        {"memory",     required_argument, 0,  'm' },
+        {"page-bits",  required_argument, 0,  'b' },
+        {"placement",  required_argument, 0,  'p' },
+        {"pool",       required_argument, 0,  'X' },
+        {"profile-out", required_argument, 0, 'o' },
+        {"restore",    required_argument, 0,  'r' },
+        {"shed",       required_argument, 0,  'S' },
+        {"smt-rate",   required_argument, 0,  's' },
+        {"socket",     required_argument, 0,  'u' },
+        {"thp",        no_argument,       0,  't' },
+        {"unpaced",    no_argument,       0,  'U' },
+        {"watermarks", required_argument, 0,  'W' },
+        {"workers",    required_argument, 0,  'w' },
+        {"zswap",      required_argument, 0,  'z' },
+        {0,            0,                 0,   0  }
+    };
 
-int scheduler_init_flag = 0;
-pthread_mutex_t scheduler_init_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t scheduler_init_cond = PTHREAD_COND_INITIALIZER;
-pthread_mutex_t scheduler_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t scheduler_run_signal = PTHREAD_COND_INITIALIZER;
+    m->placement = PLACEMENT_COMPACT;
+    m->governor = GOVERNOR_PERFORMANCE;
+    m->smt_rate = 100;
+    m->page_bits = PAGE_BITS_DEFAULT;
+    m->huge_order = 0;
+    m->memory_words = (unsigned long)USER_MEMORY_DEFAULT_MB << 18;
+    m->transparent_hugepages = 0;
+    m->checkpoint_path = "kernel.ckpt";
+    m->checkpoint_period = 0;
+    m->restore_path = NULL;
+    m->lockstep = 0;
+    m->jit = 0;
+    m->burst = 1;
+    m->workers = 0;
+    m->irq_handlers = IRQ_HANDLERS_DEFAULT;
+    m->dump_period = 0;
+    m->dump_binary = 0;
+    m->dump_pids = NULL;
+    m->arrival_model = ARRIVALS_FIXED;
+    m->arrival_trace = NULL;
+    m->max_ready = 0;
+    m->watermark_low = 80;
+    m->watermark_high = 95;
+    m->max_pending = 0;
+    m->zswap_cold_ms = 0;
+    m->edf_share = 0;
+    m->edf_deadline_ms = 0;
+    m->edf_runtime_ms = 0;
+    m->io_device_count = 0;
+    m->profile_period = 0;
+    m->profile_prefix = "profile";
+    m->pulse_limit = 0;
+    m->unpaced = 0;
+    m->instances_path = NULL;
+    m->pool_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    m->socket_path = NULL;
 
-// Definir DEBUG_PRINT si no está definido
-#ifndef DEBUG_PRINT
-#define DEBUG_PRINT(...) printf(__VA_ARGS__)
+    while ((opt = getopt_long(argc, argv, "a:b:B:c:C:d:D:e:E:f:g:hH:I:jk:lm:o:p:P:q:r:s:S:tu:Uw:W:x:X:z:", long_options, &long_index)) != -1) {
+        switch (opt) {
+        case 'a':
+            parse_arrivals(optarg, m);
+            break;
+        case 'B':
+            m->burst = atoi(optarg);
+            if (m->burst < 1 || m->burst > 1000000) {
+                fprintf(stderr, RED"Error: La ráfaga debe estar entre 1 y 1000000 instrucciones. Recibido: %s"RESET"\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+#if defined(__x86_64__)
+            m->jit = 1;
+#else
+            fprintf(stderr, RED"Error: El JIT sólo genera código x86-64"RESET"\n");
+            exit(EXIT_FAILURE);
 #endif
+            break;
+        case 'l':
+            m->lockstep = 1;
+            break;
+        case 'q':
+            m->max_ready = atoi(optarg);
+            break;
+        case 'S':
+            m->max_pending = atoi(optarg);
+            break;
+        case 'z':
+            m->zswap_cold_ms = atoi(optarg);
+            break;
+        case 'E':
+            m->edf_runtime_ms = 0;
+            if (sscanf(optarg, "%u:%u:%u", &m->edf_share, &m->edf_deadline_ms, &m->edf_runtime_ms) < 2 ||
+                m->edf_share > 100 || m->edf_deadline_ms == 0) {
+                fprintf(stderr, RED"Error: La mezcla EDF debe ser PCT:PLAZO[:PRESUPUESTO] con 0 <= PCT <= 100 y PLAZO > 0. Recibido: %s"RESET"\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'W':
+            if (sscanf(optarg, "%u:%u", &m->watermark_low, &m->watermark_high) != 2 ||
+                m->watermark_low > m->watermark_high || m->watermark_high > 100) {
+                fprintf(stderr, RED"Error: Las marcas de memoria deben ser BAJA:ALTA con 0 <= BAJA <= ALTA <= 100. Recibido: %s"RESET"\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'c':
+            m->checkpoint_path = optarg;
+            break;
+        case 'C':
+            m->checkpoint_period = atoi(optarg);
+            break;
+        case 'r':
+            m->restore_path = optarg;
+            break;
+        case 'd':
+            m->dump_period = atoi(optarg);
+            break;
+        case 'D': {
+            struct io_device_config *device = &m->io_devices[m->io_device_count];
+            if (m->io_device_count == MAX_IO_DEVICES ||
+                sscanf(optarg, "%15[^:]:%lf:%lf", device->name, &device->latency_us, &device->bandwidth_mbps) != 3 ||
+                device->latency_us < 0 || device->bandwidth_mbps <= 0) {
+                fprintf(stderr, RED"Error: Dispositivo no válido (NOMBRE:LATENCIA_US:MB/S, hasta %d): %s"RESET"\n",
+                        MAX_IO_DEVICES, optarg);
+                exit(EXIT_FAILURE);
+            }
+            m->io_device_count++;
+            break;
+        }
+        case 'e':
+            m->pulse_limit = strtoul(optarg, NULL, 10);
+            break;
+        case 'U':
+            m->unpaced = 1;
+            break;
+        case 'x':
+            m->instances_path = optarg;
+            break;
+        case 'X':
+            m->pool_threads = atoi(optarg);
+            if (m->pool_threads < 1) {
+                fprintf(stderr, RED"Error: El pool necesita al menos un hilo. Recibido: %s"RESET"\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            if (strcmp(optarg, "text") == 0)
+                m->dump_binary = 0;
+            else if (strcmp(optarg, "binary") == 0)
+                m->dump_binary = 1;
+            else {
+                fprintf(stderr, RED"Error: Formato de instantánea desconocido: %s"RESET"\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'P':
+            m->dump_pids = optarg;
+            break;
+        case 'b':
+            m->page_bits = atoi(optarg);
+            if (m->page_bits < PAGE_BITS_MIN || m->page_bits > PAGE_BITS_MAX) {
+                fprintf(stderr, RED"Error: El tamaño de página debe estar entre 2^%d y 2^%d palabras. Recibido: 2^%u"RESET"\n",
+                        PAGE_BITS_MIN, PAGE_BITS_MAX, m->page_bits);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'H': {
+            // El orden se comprueba aquí contra la página más pequeña y abajo contra la de --page-bits
+            int order = atoi(optarg);
+            if (order < 0 || order > VIRTUAL_BITS - PAGE_BITS_MIN) {
+                fprintf(stderr, RED"Error: El orden de las páginas grandes debe estar entre 0 y %d. Recibido: %d"RESET"\n",
+                        VIRTUAL_BITS - PAGE_BITS_MIN, order);
+                exit(EXIT_FAILURE);
+            }
+            m->huge_order = order;
+            break;
+        }
+        case 'I':
+            m->irq_handlers = atoi(optarg);
+            if (m->irq_handlers < 1 || m->irq_handlers > 64) {
+                fprintf(stderr, RED"Error: Los manejadores de interrupciones deben estar entre 1 y 64. Recibido: %d"RESET"\n", m->irq_handlers);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'k':
+            m->profile_period = atoi(optarg);
+            break;
+        case 'o':
+            m->profile_prefix = optarg;
+            break;
+        case 'm': {
+            long megabytes = atol(optarg);
+            if (megabytes < 1 || megabytes > USER_MEMORY_MAX_MB) {
+                fprintf(stderr, RED"Error: La memoria de usuario debe estar entre 1 y %d MB. Recibido: %ld MB"RESET"\n",
+                        USER_MEMORY_MAX_MB, megabytes);
+                exit(EXIT_FAILURE);
+            }
+            m->memory_words = (unsigned long)megabytes << 18; // 2^20 bytes / 4 bytes por palabra
+            break;
+        }
+        case 't':
+            m->transparent_hugepages = 1;
+            break;
+        case 'u':
+            m->socket_path = optarg;
+            break;
+        case 'w':
+            m->workers = atoi(optarg);
+            if (m->workers < 0) {
+                fprintf(stderr, RED"Error: El número de procesos trabajadores no puede ser negativo"RESET"\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            if (strcmp(optarg, "compact") == 0)
+                m->placement = PLACEMENT_COMPACT;
+            else if (strcmp(optarg, "spread") == 0)
+                m->placement = PLACEMENT_SPREAD;
+            else {
+                fprintf(stderr, RED"Error: Política de colocación desconocida: %s"RESET"\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'g':
+            if (strcmp(optarg, "performance") == 0)
+                m->governor = GOVERNOR_PERFORMANCE;
+            else if (strcmp(optarg, "schedutil") == 0)
+                m->governor = GOVERNOR_SCHEDUTIL;
+            else if (strcmp(optarg, "powersave") == 0)
+                m->governor = GOVERNOR_POWERSAVE;
+            else {
+                fprintf(stderr, RED"Error: Gobernador de frecuencia desconocido: %s"RESET"\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            m->smt_rate = atoi(optarg);
+            if (m->smt_rate < 1 || m->smt_rate > 100) {
+                fprintf(stderr, RED"Error: El ritmo SMT debe estar entre 1%% y 100%%. Recibido: %u%%"RESET"\n", m->smt_rate);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'h':
+        default:
+            printf("Uso: %s [OPCIONES]\n", argv[0]);
+            printf("  -a  --arrivals=MODELO\t"
+                   "Llegadas de procesos: fixed, trace:FILE, poisson:TASA u onoff:TASA:ON:OFF [fixed]\n");
+            printf("  -b  --page-bits=N\t"
+                   "Tamaño de página de 2^N palabras, entre %d y %d [%d]\n", PAGE_BITS_MIN, PAGE_BITS_MAX, PAGE_BITS_DEFAULT);
+            printf("  -B  --burst=N\t\t"
+                   "Instrucciones que retira cada hilo por pulso, sin pasar del quantum [1]\n");
+            printf("  -c  --checkpoint=FILE\t"
+                   "Fichero de los checkpoints [kernel.ckpt]\n");
+            printf("  -C  --checkpoint-every=S\t"
+                   "Guardar un checkpoint cada S segundos simulados, 0 nunca [0]\n");
+            printf("  -D  --device=N:US:MB\t"
+                   "Dispositivo de E/S con su latencia en us y su ancho de banda en MB/s; se repite por dispositivo [disk:5000:200 nic:50:1250]\n");
+            printf("  -d  --dump-every=S\t"
+                   "Instantánea de los procesos en processes/ cada S segundos simulados, 0 sólo con SIGUSR1 [0]\n");
+            printf("  -e  --pulses=N\t\t"
+                   "Terminar tras N pulsos del reloj e imprimir el resumen, 0 sin límite [0]\n");
+            printf("  -E  --edf-mix=PCT:D[:R]\t"
+                   "Dar al PCT%% de las llegadas generadas un plazo de D ms y un presupuesto EDF de R ms, D si se omite [0]\n");
+            printf("  -f  --dump-format=FMT\t"
+                   "Formato de las instantáneas: text o binary [text]\n");
+            printf("  -g  --governor=POL\t"
+                   "Frecuencia de los núcleos: performance, schedutil o powersave [performance]\n");
+            printf("  -H  --huge-order=N\t"
+                   "Páginas grandes de 2^N páginas para segmentos de datos grandes, 0 las desactiva [0]\n");
+            printf("  -I  --irq-handlers=N\t"
+                   "Hilos que atienden las interrupciones de los temporizadores y la E/S [%d]\n", IRQ_HANDLERS_DEFAULT);
+            printf("  -j  --jit\t\t"
+                   "Traducir los programas a código x86-64 nativo\n");
+            printf("  -k  --profile=N\t"
+                   "Muestrear los hilos cada N pulsos y las pilas del host; el perfil se escribe con SIGUSR2 y al terminar, 0 sin perfil [0]\n");
+            printf("  -l  --lockstep\t\t"
+                   "Ejecutar los hilos a la vez con instrucciones SIMD\n");
+            printf("  -m  --memory=MB\t"
+                   "Memoria física de usuario en MB, hasta %d [%d]\n", USER_MEMORY_MAX_MB, USER_MEMORY_DEFAULT_MB);
+            printf("  -o  --profile-out=PREF\t"
+                   "Prefijo de los ficheros del perfil, PREF.folded y PREF.txt [profile]\n");
+            printf("  -p  --placement=POL\t"
+                   "Colocación de procesos: compact o spread [compact]\n");
+            printf("  -P  --dump-pids=LISTA\t"
+                   "PIDs separados por comas que entran en las instantáneas [todos]\n");
+            printf("  -q  --max-ready=N\t"
+                   "Retener las cargas mientras haya N procesos en la cola de listos, 0 sin límite [0]\n");
+            printf("  -r  --restore=FILE\t"
+                   "Arrancar desde un checkpoint en lugar de configurar la máquina\n");
+            printf("  -s  --smt-rate=PCT\t"
+                   "%% de instrucciones que retira un hilo con hermanos ocupados [100]\n");
+            printf("  -S  --shed=N\t\t"
+                   "Descartar las llegadas cuando ya hay N cargas retenidas, 0 nunca [0]\n");
+            printf("  -t  --thp\t\t"
+                   "Pedir páginas grandes transparentes al host para la memoria simulada\n");
+            printf("  -u  --socket=PATH\t"
+                   "Servir el estado de la máquina en un socket UNIX; con --instances, PATH.N por instancia, N su línea en el fichero\n");
+            printf("  -U  --unpaced\t\t"
+                   "Dar los pulsos seguidos sin esperar al reloj, para medir el ritmo del simulador con --pulses\n");
+            printf("  -w  --workers=N\t"
+                   "Repartir las CPUs simuladas entre N procesos del host, 0 uno solo [0]\n");
+            printf("  -W  --watermarks=B:A\t"
+                   "Retener las cargas desde el A%% de frames de usuario en uso hasta bajar del B%% [80:95]\n");
+            printf("  -x  --instances=FILE\t"
+                   "Simular una máquina por línea, \"CPUS NUCLEOS HILOS RELOJ PLANIFICADOR GENERADOR [OPCIONES]\"; "
+                   "las opciones de la línea de comandos son las de por defecto\n");
+            printf("  -X  --pool=N\t\t"
+                   "Hilos del host que dan los pulsos de las instancias de --instances [CPUs del host]\n");
+            printf("  -z  --zswap=MS\t\t"
+                   "Al pasar la marca alta, comprimir en memoria las páginas de los procesos listos que llevan MS ms sin ejecutarse, 0 nunca [0]\n");
+            printf("  -h, --help\t\tAyuda\n");
+            exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
+    if (m->lockstep && (m->jit || m->burst > 1)) {
+        fprintf(stderr, RED"Error: El modo lockstep ejecuta una instrucción por hilo y pulso; no admite --jit ni --burst"RESET"\n");
+        exit(EXIT_FAILURE);
+    }
+    if (m->workers > 0 && m->jit) {
+        fprintf(stderr, RED"Error: El código del JIT se genera en el coordinador y los procesos trabajadores no lo ven"RESET"\n");
+        exit(EXIT_FAILURE);
+    }
+    if (m->instances_path != NULL && (m->restore_path != NULL || m->checkpoint_period > 0 || m->dump_period > 0 ||
+                                      m->profile_period > 0 || m->workers > 0)) {
+        fprintf(stderr, RED"Error: Las instancias de --instances no admiten checkpoints, instantáneas, perfiles ni procesos trabajadores"RESET"\n");
+        exit(EXIT_FAILURE);
+    }
+    if (m->huge_order > VIRTUAL_BITS - m->page_bits) {
+        fprintf(stderr, RED"Error: Una página grande de 2^%u palabras no cabe en el espacio virtual de 2^%d"RESET"\n",
+                m->page_bits + m->huge_order, VIRTUAL_BITS);
+        exit(EXIT_FAILURE);
+    }
+    if ((m->memory_words >> m->page_bits) < (1ul << m->huge_order)) {
+        fprintf(stderr, RED"Error: La memoria de usuario no tiene sitio para una página de 2^%u palabras"RESET"\n",
+                m->page_bits + m->huge_order);
+        exit(EXIT_FAILURE);
+    }
+}
 
-// Configura los parámetros iniciales de la máquina
-static void setup_machine(struct kernel_machine *m) {
+// Configura los parámetros iniciales de la máquina. Sólo se pregunta al leer de la entrada
+// estándar; las líneas de --instances traen los mismos valores en el mismo orden
+static void setup_machine(FILE *in, struct kernel_machine *m) {
     double clock_rate = 2000.0;
+    int prompt = in == stdin;
 
-    printf("Num. de CPUs: ");
-    scanf("%d", &m->num_CPUs);
+    if (prompt) printf("Num. de CPUs: ");
+    fscanf(in, "%d", &m->num_CPUs);
 
-    printf("Num. núcleos por CPU: ");
-    scanf("%d", &m->cores_per_CPU);
+    if (prompt) printf("Num. núcleos por CPU: ");
+    fscanf(in, "%d", &m->cores_per_CPU);
 
-    printf("Num. hilos por núcleo: ");
-    scanf("%d", &m->threads_per_core);
+    if (prompt) printf("Num. hilos por núcleo: ");
+    fscanf(in, "%d", &m->threads_per_core);
 
-    printf("Frecuencia del reloj (Hz): ");
-    scanf("%lf", &clock_rate);
+    if (prompt) printf("Frecuencia del reloj (Hz): ");
+    fscanf(in, "%lf", &clock_rate);
     
     
     m->clock_rate = (unsigned)clock_rate;
@@ -71,113 +450,278 @@ static void setup_machine(struct kernel_machine *m) {
     }
 
     unsigned scheduler_rate;
-    printf("Frecuencia del planificador (Hz): ");
-    scanf("%u", &scheduler_rate);
+    if (prompt) printf("Frecuencia del planificador (Hz): ");
+    fscanf(in, "%u", &scheduler_rate);
     m->scheduler_rate = scheduler_rate;
 
-    printf("Frecuencia del generador de procesos (Hz): ");
-    scanf("%u", &m->process_generator_rate);
+    if (prompt) printf("Frecuencia del generador de procesos (Hz): ");
+    fscanf(in, "%u", &m->process_generator_rate);
 }
 
-// Inicializa la estructura de la máquina, asignando memoria
+// Inicializa la estructura de la máquina, asignando memoria. Todos los hilos van en un único
+// arena contiguo alineado a línea de caché y las CPUs y núcleos son tablas de índices sobre él
 static void initialize_machine(struct kernel_machine *m) {
+#ifdef ENGINE_CPUS
+    if (m->num_CPUs != ENGINE_CPUS || m->cores_per_CPU != ENGINE_CORES_PER_CPU || m->threads_per_core != ENGINE_THREADS_PER_CORE) {
+        fprintf(stderr, RED"Error: Este motor está compilado para %dx%dx%d y la máquina es %dx%dx%d"RESET"\n",
+                ENGINE_CPUS, ENGINE_CORES_PER_CPU, ENGINE_THREADS_PER_CORE, m->num_CPUs, m->cores_per_CPU, m->threads_per_core);
+        exit(EXIT_FAILURE);
+    }
+#endif
+#ifdef ENGINE_CLOCK_RATE
+    if (m->clock_rate != ENGINE_CLOCK_RATE) {
+        fprintf(stderr, RED"Error: Este motor está compilado para un reloj de %dHz y la máquina tiene %uHz"RESET"\n",
+                ENGINE_CLOCK_RATE, m->clock_rate);
+        exit(EXIT_FAILURE);
+    }
+#endif
+    m->core_count = m->num_CPUs * m->cores_per_CPU;
+    m->thread_count = m->core_count * m->threads_per_core;
+
     m->CPUs = malloc(m->num_CPUs * sizeof(struct CPU));
-    if (!m->CPUs) {
+    m->cores = malloc(m->core_count * sizeof(struct cpu_core));
+    if (!m->CPUs || !m->cores) {
         perror(RED"Error: No se pudo asignar memoria para las CPUs"RESET);
         exit(EXIT_FAILURE);
     }
 
-    for (int i = 0; i < m->num_CPUs; i++) {
-        m->CPUs[i].cores = malloc(m->cores_per_CPU * sizeof(struct cpu_core));
-        if (!m->CPUs[i].cores) {
-            perror(RED"Error: No se pudo asignar memoria para los núcleos de las CPUs"RESET);
-            exit(EXIT_FAILURE);
-        }
+    if (m->workers > m->num_CPUs) {
+        fprintf(stderr, RED"Error: No puede haber más procesos trabajadores (%d) que CPUs (%d)"RESET"\n",
+                m->workers, m->num_CPUs);
+        exit(EXIT_FAILURE);
+    }
 
-        for (int j = 0; j < m->cores_per_CPU; j++) {
-            m->CPUs[i].cores[j].threads = malloc(m->threads_per_core * sizeof(struct HT));
-            if (!m->CPUs[i].cores[j].threads) {
-                perror(RED"Error: No se pudo asignar memoria para los hilos de las CPUs"RESET);
-                exit(EXIT_FAILURE);
-            }
+    // El arena y el banco de registros van en memoria compartida para que los procesos
+    // trabajadores ejecuten sobre los mismos hilos que ve el planificador
+    m->threads = shared_alloc(m->thread_count * sizeof(struct HT));
 
-            for (int k = 0; k < m->threads_per_core; k++) {
-                m->CPUs[i].cores[j].threads[k].process = NULL;
-                m->CPUs[i].cores[j].threads[k].quantum_cycles = 0;
-                clear_tlb(&m->CPUs[i].cores[j].threads[k].tlb);
-            }
-        }
+    for (int i = 0; i < m->num_CPUs; i++)
+        m->CPUs[i].cores = &m->cores[i * m->cores_per_CPU];
+    for (int c = 0; c < m->core_count; c++)
+        m->cores[c].threads = &m->threads[c * m->threads_per_core];
+
+    for (int t = 0; t < m->thread_count; t++) {
+        struct HT *thread = &m->threads[t];
+        thread->process = NULL;
+        thread->quantum_cycles = 0;
+        thread->tlb_pid = -1;
+        thread->smt_credit = 0;
+        thread->cpu = t / (m->cores_per_CPU * m->threads_per_core);
+        thread->core = (t / m->threads_per_core) % m->cores_per_CPU;
+        thread->id = t % m->threads_per_core;
+        thread->lane = t;
+        clear_tlb(&thread->tlb);
     }
+
+    // Banco de registros en estructura de arrays, alineado para cargas de 256 bits
+    m->lanes = (m->thread_count + 7) & ~7;
+    m->registers = shared_alloc(REGISTERS_COUNT * m->lanes * sizeof(int));
+
     initialize_memory();
+    initialize_pcb_pool();
+    initialize_reclaimer();
+    initialize_power();
+    initialize_interrupts();
+    initialize_io();
 }
 
 // Libera la memoria asignada a la máquina
 static void free_machine(struct kernel_machine *m) {
-    for (int i = 0; i < m->num_CPUs; i++) {
-        for (int j = 0; j < m->cores_per_CPU; j++) {
-            free(m->CPUs[i].cores[j].threads);
-        }
-        free(m->CPUs[i].cores);
-    }
+    shared_free(m->threads, m->thread_count * sizeof(struct HT));
+    free(m->cores);
     free(m->CPUs);
+    shared_free(m->registers, REGISTERS_COUNT * m->lanes * sizeof(int));
     free_memory();
 }
 
 // Señaliza al planificador para que se ejecute
 void notify_scheduler() {
-    pthread_mutex_lock(&scheduler_mutex);
-    pthread_cond_signal(&scheduler_run_signal);
-    pthread_mutex_unlock(&scheduler_mutex);
+    pthread_mutex_lock(&instance->scheduler_mutex);
+    pthread_cond_signal(&instance->scheduler_run_signal);
+    pthread_mutex_unlock(&instance->scheduler_mutex);
 }
 
-// Señaliza al generador de procesos para que se ejecute
+// Señaliza al generador de procesos para que se ejecute: una llegada más para el cargador
 void notify_process_generator() {
-    pthread_mutex_lock(&loader_mutex);
-    pthread_cond_signal(&loader_run_signal);
-    pthread_mutex_unlock(&loader_mutex);
+    pthread_mutex_lock(&instance->loader_mutex);
+    queue_fixed_arrival();
+    pthread_cond_signal(&instance->loader_run_signal);
+    pthread_mutex_unlock(&instance->loader_mutex);
+}
+
+// Despierta al cargador sin llegadas nuevas, para que reintente las cargas retenidas
+void notify_loader() {
+    pthread_mutex_lock(&instance->loader_mutex);
+    pthread_cond_signal(&instance->loader_run_signal);
+    pthread_mutex_unlock(&instance->loader_mutex);
 }
 
 #ifdef DEBUG
 // Imprime el estado de los hilos para depuración
 void display_threads_status() {
-    for (int i = 0; i < kernel_machine.num_CPUs; i++) {
-        for (int j = 0; j < kernel_machine.cores_per_CPU; j++) {
-            for (int k = 0; k < kernel_machine.threads_per_core; k++) {
-                struct HT *thread = &kernel_machine.CPUs[i].cores[j].threads[k];
-                if (thread->process == NULL) {
-                    printf(YELLOW"CPU %d"RESET" -> "BLUE"núcleo %d"RESET" -> "GREEN"hilo %d: "RESET"Nungun proceso asignado\n", i, j, k);
-                } else {
-                    printf(YELLOW"CPU %d"RESET" -> "BLUE"núcleo %d"RESET" -> "GREEN"hilo %d: "RESET" Proceso num %d y %d ciclos de quantum restantes\n",
-                           i, j, k, thread->process->pid, thread->quantum_cycles);
-                }
-            }
+    for (int t = 0; t < instance->kernel_machine.thread_count; t++) {
+        struct HT *thread = &instance->kernel_machine.threads[t];
+        if (thread->process == NULL) {
+            printf(YELLOW"CPU %d"RESET" -> "BLUE"núcleo %d"RESET" -> "GREEN"hilo %d: "RESET"Nungun proceso asignado\n",
+                   thread->cpu, thread->core, thread->id);
+        } else {
+            printf(YELLOW"CPU %d"RESET" -> "BLUE"núcleo %d"RESET" -> "GREEN"hilo %d: "RESET" Proceso num %d y %d ciclos de quantum restantes\n",
+                   thread->cpu, thread->core, thread->id, thread->process->pid, thread->quantum_cycles);
         }
     }
 }
+
+// Imprime las estadísticas acumuladas de la simulación
+void display_statistics() {
+    printf("Migraciones: %lu entre hilos del núcleo, %lu entre núcleos, %lu entre CPUs; recargas de TLB: %lu\n",
+           instance->migrations[0], instance->migrations[1], instance->migrations[2], instance->tlb_refills);
+    printf("Instrucciones retiradas: %lu; ciclos perdidos por contención SMT: %lu\n",
+           instance->instructions_retired, instance->smt_stall_cycles);
+    if (instance->kernel_machine.lockstep)
+        printf("Lockstep: %lu instrucciones en carriles SIMD, %lu por el camino escalar\n",
+               instance->lockstep_vector_lanes, instance->lockstep_scalar_lanes);
+    if (instance->kernel_machine.jit)
+        printf("JIT: %u imágenes compiladas, %lu instrucciones en código nativo, %lu interpretadas\n",
+               instance->jit_images, instance->jit_instructions, instance->instructions_retired - instance->jit_instructions);
+    printf("Frames de usuario: %u en uso, %u tocados alguna vez, %u en total\n",
+           instance->allocator->frames_allocated, instance->allocator->frame_high_water, instance->frame_count);
+    printf("Admisión: %lu procesos admitidos, %lu retenidos alguna vez, %lu llegadas descartadas, %lu terminados sin memoria\n",
+           instance->arrivals_admitted, instance->arrivals_deferred, instance->arrivals_shed, instance->oom_kills);
+    printf("Reclamación: %lu procesos devueltos fuera del reloj, hasta %u retirados a la vez\n",
+           instance->reclaim_queue->reclaimed, instance->reclaim_queue->max_count);
+    display_zpool_statistics();
+    display_power_statistics();
+    display_deadline_statistics();
+    display_io_statistics();
+    display_irq_statistics();
+    if (instance->mapped_words > 0)
+        printf("Fragmentación interna: %lu de %lu palabras asignadas sin usar (%.1f%%)\n",
+               instance->mapped_words - instance->image_words, instance->mapped_words, 100.0 * (instance->mapped_words - instance->image_words) / instance->mapped_words);
+}
 #endif
 
+// Crea una instancia por línea de --instances, arranca sus hilos y da sus pulsos en el pool.
+// Cada línea se procesa como la línea de comandos original seguida de sus opciones
+static void run_instance_file(int argc, char *argv[]) {
+    const char *path = instance->kernel_machine.instances_path;
+    int pool_threads = instance->kernel_machine.pool_threads;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, RED"Error: No se pudo abrir el fichero de instancias %s"RESET"\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    struct instance **instances = NULL;
+    int count = 0, line_number = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        // Las opciones guardan punteros a sus argumentos: la copia vive tanto como la instancia
+        char *copy = strdup(line), *tokens[64];
+        int n = 0;
+        for (char *token = strtok(copy, " \t\r\n"); token != NULL && n < 64; token = strtok(NULL, " \t\r\n"))
+            tokens[n++] = token;
+        if (n == 0) {
+            free(copy);
+            continue;
+        }
+        if (n < 6) {
+            fprintf(stderr, RED"Error: La línea %d de %s necesita CPUS NUCLEOS HILOS RELOJ PLANIFICADOR GENERADOR"RESET"\n",
+                    line_number, path);
+            exit(EXIT_FAILURE);
+        }
+
+        char machine[256];
+        snprintf(machine, sizeof(machine), "%s %s %s %s %s %s", tokens[0], tokens[1], tokens[2], tokens[3], tokens[4], tokens[5]);
+        char **options = malloc((argc + n - 6 + 1) * sizeof(char *));
+        memcpy(options, argv, argc * sizeof(char *));
+        memcpy(options + argc, tokens + 6, (n - 6) * sizeof(char *));
+        options[argc + n - 6] = NULL;
+
+        instance = create_instance(line_number);
+        optind = 0; // Volver a empezar getopt desde el principio
+        parse_options(argc + n - 6, options, &instance->kernel_machine);
+        FILE *in = fmemopen(machine, strlen(machine), "r");
+        setup_machine(in, &instance->kernel_machine);
+        fclose(in);
+        initialize_machine(&instance->kernel_machine);
+
+        // El reloj de la instancia es el pool; los demás hilos duermen hasta que les toca
+        pthread_t timer_tid, loader_tid, scheduler_tid;
+        start_interrupts();
+        start_introspection();
+        start_reclaimer();
+        create_instance_thread(&timer_tid, run_timer);
+        create_instance_thread(&loader_tid, run_loader);
+        create_instance_thread(&scheduler_tid, run_scheduler);
+        pthread_detach(timer_tid);
+        pthread_detach(loader_tid);
+        pthread_detach(scheduler_tid);
+        wait_for_system_start();
+
+        instances = realloc(instances, (count + 1) * sizeof(struct instance *));
+        instances[count++] = instance;
+    }
+    fclose(f);
+
+    if (count == 0) {
+        fprintf(stderr, RED"Error: El fichero de instancias %s no tiene ninguna máquina"RESET"\n", path);
+        exit(EXIT_FAILURE);
+    }
+    run_instances(instances, count, pool_threads);
+}
+
 // Función principal
-int main(int argc, char const *argv[]) {
-    setup_machine(&kernel_machine);
-    initialize_machine(&kernel_machine);
+int main(int argc, char *argv[]) {
+    instance = create_instance(0);
+    parse_options(argc, argv, &instance->kernel_machine);
+    if (instance->kernel_machine.instances_path != NULL) {
+        run_instance_file(argc, argv);
+        return 0;
+    }
+
+    if (instance->kernel_machine.restore_path != NULL)
+        open_checkpoint(instance->kernel_machine.restore_path, &instance->kernel_machine);
+    else
+        setup_machine(stdin, &instance->kernel_machine);
+    initialize_machine(&instance->kernel_machine);
+    if (instance->kernel_machine.restore_path != NULL)
+        restore_checkpoint();
+    if (instance->kernel_machine.workers > 0)
+        start_workers(); // Antes de crear hilos: fork sólo copia el hilo que lo llama
 
     pthread_t clock_tid, timer_tid, loader_tid, scheduler_tid;
 
     // Lanzar hilos de los diferentes subsistemas
     DEBUG_PRINT(MAGENTA"Kernel: Comezado la configuracion..."RESET"\n");
-    pthread_create(&clock_tid, NULL, run_clock, NULL);
-    pthread_create(&timer_tid, NULL, run_timer, NULL);
-    pthread_create(&loader_tid, NULL, run_loader, NULL);
-    pthread_create(&scheduler_tid, NULL, run_scheduler, NULL);
+    start_profiler(); // Después del fork: los trabajadores no heredan sus manejadores
+    start_dumper();
+    start_interrupts();
+    start_introspection();
+    start_reclaimer();
+    create_instance_thread(&clock_tid, run_clock);
+    create_instance_thread(&timer_tid, run_timer);
+    create_instance_thread(&loader_tid, run_loader);
+    create_instance_thread(&scheduler_tid, run_scheduler);
 
-    // Esperar a que los hilos terminen
+    // Con --pulses el reloj termina solo; los demás hilos duermen esperando trabajo
     pthread_join(clock_tid, NULL);
+    if (instance->kernel_machine.pulse_limit > 0) {
+        display_instance_summary();
+        exit(EXIT_SUCCESS);
+    }
+
+    // Esperar a que los hilos terminen
     pthread_join(timer_tid, NULL);
     pthread_join(loader_tid, NULL);
     pthread_join(scheduler_tid, NULL);
     
     DEBUG_PRINT(MAGENTA"Kernel: Configuracion terminada"RESET"\n");
 
-    free_machine(&kernel_machine);
+    free_machine(&instance->kernel_machine);
     return 0;
 }
@@ -0,0 +1,205 @@
+/*═════════════════════════════════════════════════════════════════════════════
+ *   ktop.c
+ *
+ *      ./ktop
+        ./ktop -s kernel.sock -i 500
+        ./ktop -s sweep.sock.3 -n 1 -b
+ *
+ *   kernel_simulator --socket=PATH zerbitzariaren bezeroa: laburpena, hari
+ *   bakoitzaren egoera eta prozesuak erakusten ditu aldian behin, top-en
+ *   antzera. Zerbitzariak argazki batetik erantzuten du, beraz simulazioa
+ *   ez da inoiz gelditzen bezeroaren zain.
+ *
+ *════════════════════════════════════════════════════════════════════════════*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LINE_LENGTH    256
+#define MAX_LINES      4096
+
+// Erantzun bat: zerbitzariaren lerroak, lerro hutsa arte
+typedef struct reply_t {
+    unsigned int  count;
+    char          lines[MAX_LINES][LINE_LENGTH];
+} reply_t;
+
+char          *socket_path = "kernel.sock";
+int           batch;
+FILE          *from_server;
+int           server;
+
+void __error(const char *s, const char *detail);
+
+/*-----------------------------------------------------------------------------
+ *   Zerbitzariarekiko konexioa
+ *----------------------------------------------------------------------------*/
+
+static void connect_server(void) {
+    struct sockaddr_un address;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    if ((server = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        connect(server, (struct sockaddr *)&address, sizeof(address)) < 0)
+        __error("Cannot connect to the simulator", socket_path);
+    from_server = fdopen(server, "r");
+}
+
+// Agindu bat bidali eta erantzun osoa irakurri
+static void request(const char *command, reply_t *reply) {
+    char line[LINE_LENGTH];
+    size_t length;
+
+    snprintf(line, sizeof(line), "%s\n", command);
+    if (write(server, line, strlen(line)) != (ssize_t)strlen(line))
+        __error("Connection closed by the simulator", NULL);
+
+    reply->count = 0;
+    while (1) {
+        if (fgets(line, sizeof(line), from_server) == NULL)
+            __error("Connection closed by the simulator", NULL);
+        length = strlen(line);
+        if (length > 0 && line[length - 1] == '\n') line[--length] = '\0';
+        if (length == 0) break;
+        if (reply->count < MAX_LINES)
+            strcpy(reply->lines[reply->count++], line);
+    }
+}
+
+// Laburpeneko gako baten balioa, "gakoa balioa..." lerroetatik
+static const char *value(reply_t *reply, const char *key) {
+    unsigned int  i;
+    size_t        length = strlen(key);
+
+    for (i = 0; i < reply->count; i++)
+        if (strncmp(reply->lines[i], key, length) == 0 && reply->lines[i][length] == ' ')
+            return reply->lines[i] + length + 1;
+    return "0";
+}
+
+static double seconds_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*-----------------------------------------------------------------------------
+ *   Pantaila
+ *----------------------------------------------------------------------------*/
+
+static void draw(reply_t *summary, reply_t *threads, reply_t *processes, double instructions_rate) {
+    unsigned int  i, busy = 0, total = 0, used = 0, high = 0, frames = 0;
+    int           cpu, core, id, pid, quantum, thread, priority, quantum_ms;
+    unsigned int  pc, migrations, refills;
+    char          state[16];
+
+    if (!batch) printf("\033[H\033[2J");
+    sscanf(value(summary, "hilos"), "%u %u", &busy, &total);
+    sscanf(value(summary, "frames"), "%u %u %u", &used, &high, &frames);
+
+    printf("ktop - %s   pulso %s (%s pulsos/s)\n", socket_path, value(summary, "pulso"), value(summary, "ritmo"));
+    printf("Hilos: %u/%u ocupados   Listos: %s   Bloqueados: %s   Retenidos: %s\n",
+           busy, total, value(summary, "listos"), value(summary, "bloqueados"), value(summary, "retenidos"));
+    printf("Frames: %u en uso, %u tocados, %u en total (%.1f%%)\n",
+           used, high, frames, frames ? 100.0 * used / frames : 0.0);
+    printf("Instrucciones: %s (%.0f/s)   Admitidos: %s   Descartados: %s\n\n",
+           value(summary, "instrucciones"), instructions_rate, value(summary, "admitidos"), value(summary, "descartados"));
+
+    printf("CPU NUC HILO    PID  QUANTUM       PC\n");
+    for (i = 0; i < threads->count; i++) {
+        if (sscanf(threads->lines[i], "%d %d %d %d %d %u", &cpu, &core, &id, &pid, &quantum, &pc) != 6) continue;
+        if (pid < 0)
+            printf("%3d %3d %4d      -        -        -\n", cpu, core, id);
+        else
+            printf("%3d %3d %4d %6d %8d %8u\n", cpu, core, id, pid, quantum, pc);
+    }
+
+    printf("\n   PID ESTADO      HILO PRIO QUANTUM       PC  MIGR  TLB\n");
+    for (i = 0; i < processes->count; i++) {
+        if (sscanf(processes->lines[i], "%d %15s %d %d %d %u %u %u", &pid, state, &thread, &priority,
+                   &quantum_ms, &pc, &migrations, &refills) != 8) continue;
+        printf("%6d %-10s %5d %4d %7d %8u %5u %4u\n", pid, state, thread, priority, quantum_ms, pc, migrations, refills);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    int           opt, long_index = 0;
+    unsigned int  interval_ms = 1000, iterations = 0, n;
+    double        last_time = 0, now;
+    unsigned long last_instructions = 0, instructions;
+    reply_t       *summary, *threads, *processes;
+    static struct option long_options[] = {
+        {"batch",      no_argument,       0,  'b' },
+        {"help",       no_argument,       0,  'h' },
+        {"interval",   required_argument, 0,  'i' },
+        {"iterations", required_argument, 0,  'n' },
+        {"socket",     required_argument, 0,  's' },
+        {0,            0,                 0,   0  }
+    };
+
+    while ((opt = getopt_long(argc, argv, ":bhi:n:s:", long_options, &long_index)) != -1) {
+      switch (opt) {
+        case 'b':   /* -b or --batch */
+            batch = 1;
+            break;
+        case 'i':   /* -i or --interval */
+            interval_ms = atoi(optarg);
+            if (interval_ms == 0) interval_ms = 1;
+            break;
+        case 'n':   /* -n or --iterations */
+            iterations = atoi(optarg);
+            break;
+        case 's':   /* -s or --socket */
+            socket_path = optarg;
+            break;
+        default:
+            printf ("Uso: %s [OPTIONS]\n", argv[0]);
+            printf ("  -b  --batch\t\t"
+                "Escribir cada pantalla detrás de la anterior, sin borrar\n");
+            printf ("  -h, --help\t\t"
+                "Ayuda\n");
+            printf ("  -i  --interval=MS\t"
+                "Milisegundos entre pantallas [1000]\n");
+            printf ("  -n  --iterations=N\t"
+                "Pantallas que se muestran, 0 sin límite [0]\n");
+            printf ("  -s  --socket=PATH\t"
+                "Socket del simulador (kernel_simulator --socket=PATH) [kernel.sock]\n");
+            exit(opt == 'h' ? 0 : 1);
+      }
+    }
+
+    summary = malloc(sizeof(reply_t));
+    threads = malloc(sizeof(reply_t));
+    processes = malloc(sizeof(reply_t));
+    connect_server();
+
+    for (n = 0; iterations == 0 || n < iterations; n++) {
+        if (n > 0) usleep(interval_ms * 1000);
+        request("summary", summary);
+        request("threads", threads);
+        request("processes", processes);
+
+        // Instrukzio erritmoa bi laburpenen artean kalkulatzen da
+        now = seconds_now();
+        instructions = strtoul(value(summary, "instrucciones"), NULL, 10);
+        draw(summary, threads, processes, n > 0 ? (instructions - last_instructions) / (now - last_time) : 0.0);
+        last_time = now;
+        last_instructions = instructions;
+    }
+    return 0;
+}
+
+void __error(const char *s, const char *detail) {
+    fprintf(stderr, "☼☼☼ %s%s%s ☼☼☼\n", s, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
@@ -5,17 +5,73 @@
  *----------------------------------------------------------------------------*/
 
 #define VIRTUAL_BITS_DEFAULT  24      // bitak
-#define PAGE_SIZE_BITS        8
+#define PAGE_SIZE_BITS        18      // bytetan: 2^16 hitzeko orriak, simulatzailearen berdinak
 #define USER_LOWEST_ADDRESS   0
 
 #define PROG_NAME_DEFAULT	  "prog"
 #define FIRST_NUMBER_DEFAULT  0
 #define HOW_MANY_DEFAULT      50
-#define MAX_LINE_LENGTH       20    // Kode lerro baten gehienezko tamaina 
 #define MAX_LINES_DEFAULT	  20
 
 #define VALUE                 400
 
+#define JOBS_DEFAULT          1       // Programak sortzen dituzten hariak
+#define IO_DEVICES_DEFAULT    2       // S/I gailuak: 0 diskoa, 1 sarea
+#define IO_BYTES_DEFAULT      65536   // S/I eskaera baten gehienezko tamaina, bytetan
+#define PATH_LENGTH           256
+#define REPEAT_DEFAULT        1000    // Nukleoek datuak zenbat aldiz zeharkatzen dituzten
+
+// Formatu bitarra: goiburua eta ondoren .text eta .data hitzak, simulatzailearen berdina
+#define PROGRAM_MAGIC         "KSIMPRG1"
+
+/*-----------------------------------------------------------------------------
+ *   Aginduen kodeketa: prometheus eta mihiztatzailea
+ *----------------------------------------------------------------------------*/
+
+#define LOAD(reg, addr)        (0x00000000u | ((reg) << 24) | (addr))
+#define STORE(reg, addr)       (0x10000000u | ((reg) << 24) | (addr))
+#define ADD(dst, src1, src2)   (0x20000000u | ((dst) << 24) | ((src1) << 20) | ((src2) << 16))
+#define IO(device, bytes)      (0x30000000u | ((device) << 24) | ((bytes) & 0xFFFFFF))
+#define SUB(dst, src1, src2)   (0x40000000u | ((dst) << 24) | ((src1) << 20) | ((src2) << 16))
+#define LI(reg, imm)           (0x50000000u | ((reg) << 24) | ((imm) & 0xFFFFFF))
+#define ADDI(dst, src, imm)    (0x60000000u | ((dst) << 24) | ((src) << 20) | ((imm) & 0xFFFF))
+#define BEQ(reg1, reg2, addr)  (0x70000000u | ((reg1) << 24) | ((reg2) << 20) | ((addr) & 0xFFFFF))
+#define BNE(reg1, reg2, addr)  (0x80000000u | ((reg1) << 24) | ((reg2) << 20) | ((addr) & 0xFFFFF))
+#define BLT(reg1, reg2, addr)  (0x90000000u | ((reg1) << 24) | ((reg2) << 20) | ((addr) & 0xFFFFF))
+#define JMP(addr)              (0xA0000000u | ((addr) & 0xFFFFFF))
+#define LDR(dst, base, imm)    (0xB0000000u | ((dst) << 24) | ((base) << 20) | ((imm) & 0xFFFF))
+#define STR(src, base, imm)    (0xC0000000u | ((src) << 24) | ((base) << 20) | ((imm) & 0xFFFF))
+#define HALT                   0xF0000000u
+
+#define BRANCH_LIMIT           0x100000   // Jauzi baldintzatuen helburuak: 20 bit, bytetan
+#define IMMEDIATE_LIMIT        0x800000   // li: 24 biteko zenbaki osoa, zeinuduna
+#define OFFSET_LIMIT           0x8000     // addi, ldr eta str: 16 biteko zenbaki osoa, zeinuduna
+
+typedef struct program_header_t {
+    char          magic[8];
+    unsigned int  text_address;   // bytetan
+    unsigned int  data_address;   // bytetan
+    unsigned int  text_words;
+    unsigned int  data_words;
+} program_header_t;
+
+// Datuetarako sarbideen lokalitatea
+typedef enum access_t {
+    ACCESS_UNIFORM,     // ausazkoa, berdin banatuta
+    ACCESS_SEQUENTIAL,  // bata bestearen atzetik
+    ACCESS_STRIDED,     // urrats finkoarekin
+    ACCESS_ZIPF,        // helbide gutxi batzuk oso beroak
+    ACCESS_PHASES       // lan-multzo txiki bat, faseka aldatzen dena
+} access_t;
+
+// Begiztadun nukleoak: luze exekutatzen diren programak
+typedef enum kernel_t {
+    KERNEL_NONE,        // agindu zerrenda zuzena, jauzirik gabe
+    KERNEL_REDUCE,      // datu guztien batura
+    KERNEL_SCAN,        // urrats finkoko irakurri-batu-idatzi
+    KERNEL_CHASE        // erakusleen katea, ausazko ziklo batean
+} kernel_t;
+
 typedef struct configuration_t {
     unsigned int  virtual_bits;
     unsigned int  offset_bits;
@@ -26,6 +82,23 @@ typedef struct configuration_t {
     char		  *prog_name;
     unsigned int  first_number;
     unsigned int  how_many;
+    unsigned int  max_data;       // datu-segmentuaren gehienezko tamaina, hitzetan
+    unsigned int  jobs;
+    int           binary;         // programak formatu bitarrean idatzi
+    int           use_mix;        // 0: ld ld add st blokeak, 1: mix_* portzentajeak
+    unsigned int  mix_load, mix_store, mix_add;
+    access_t      access;
+    unsigned int  stride;         // ACCESS_STRIDED: urratsa hitzetan
+    double        zipf_s;         // ACCESS_ZIPF: berretzailea
+    unsigned int  window;         // ACCESS_PHASES: lan-multzoa hitzetan
+    unsigned int  phase_length;   // ACCESS_PHASES: sarbideak fase bakoitzeko
+    unsigned int  io_percent;     // S/I aginduen portzentajea (0: bat ere ez)
+    unsigned int  io_devices;
+    unsigned int  io_max_bytes;
+    kernel_t      kernel;
+    unsigned int  scan_stride;    // KERNEL_SCAN: urratsa hitzetan
+    unsigned int  repeat;         // nukleoaren kanpo-begiztaren itzulikopurua
+    unsigned long seed;
 } configuration_t;
 
 
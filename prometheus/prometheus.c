@@ -4,15 +4,20 @@
  *      ./prometheus -s 0 -nprog -f0  -l20   -p60
         ./prometheus -s 3 -nprog -f60 -l1000 -p1
         ./prometheus -s 9 -nprog -f61 -l20   -p60
+        ./prometheus -s 1 -nbig -p5000 -j8 -l4000 -d100000 -m40,20,40 -azipf:1.1 -obinary
+        ./prometheus -s 2 -nloop -p20 -d4096 -kscan:16 -r100000
  *
  *════════════════════════════════════════════════════════════════════════════*/
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <time.h>
 #include <string.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "defines.h"
 
@@ -22,76 +27,394 @@ unsigned int     user_lowest;
 unsigned int     user_highest;
 unsigned int     user_space;
 
+// Programa bakoitzaren laburpena, manifesturako
+typedef struct program_stats_t {
+    unsigned int  code_words;
+    unsigned int  data_words;
+    unsigned int  loads, stores, adds, ios, branches;
+} program_stats_t;
+
+// Programa bakoitzak bere sorgailua du: emaitza ez dago hari kopuruaren menpe
+typedef struct rng_t {
+    unsigned long state;
+} rng_t;
+
+// Lokalitate-sorgailuaren egoera
+typedef struct locality_t {
+    unsigned int  position;
+    double        *cdf;          // ACCESS_ZIPF: banaketa metatua
+    unsigned int  window_start;
+    unsigned int  phase_left;
+} locality_t;
+
+program_stats_t  *stats;
+unsigned int     next_program;   // Hurrengo programa, hari guztien artean partekatua
+
 void __konfigurazioa(int argc, char *argv[]);
 void __error(int cod, char *s);
 void __message(int cod);
 
-int main(int argc, char *argv[]) {
-    FILE             *fd;
-    char             line[MAX_LINE_LENGTH], file_name[MAX_LINE_LENGTH];
-    unsigned int     i, pnum, datum;
-    unsigned int     code_start, code_size;
-    unsigned int     data_start, data_size;
-    unsigned int     var_offset;
-    unsigned char    reg1, reg2, reg3;
+/*-----------------------------------------------------------------------------
+ *   Ausazko zenbakiak (xorshift64*)
+ *----------------------------------------------------------------------------*/
 
-    __konfigurazioa(argc, argv);   // Konfigurazioa
+static void rng_seed(rng_t *rng, unsigned long seed, unsigned int pnum) {
+    unsigned long z = seed * 0x9E3779B97F4A7C15UL + pnum + 1;   // splitmix64
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    rng->state = (z ^ (z >> 31)) | 1;
+}
 
-    user_lowest   = USER_LOWEST_ADDRESS;
-    user_highest  = (1 << conf.virtual_bits) - 1;
-    user_space    = user_highest - user_lowest + 1;
+static unsigned long rng_next(rng_t *rng) {
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 2685821657736338717UL;
+}
 
-    __message(0);
+static unsigned int rng_below(rng_t *rng, unsigned int n) {
+    return (rng_next(rng) >> 32) % n;
+}
 
-    for(pnum = conf.first_number; pnum < (conf.first_number + conf.how_many); pnum++){
+static double rng_unit(rng_t *rng) {
+    return (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
 
-        sprintf(file_name,"%s%03d.elf", conf.prog_name, pnum);
-        if((fd = fopen(file_name, "w")) == NULL){
-            __error(0,"Error while opening file");
-        } // if
+/*-----------------------------------------------------------------------------
+ *   Datuetarako sarbideen lokalitatea
+ *----------------------------------------------------------------------------*/
 
-        code_start = user_lowest & ~conf.offset_mask;
-        code_size = 4 + (rand() % conf.max_lines); // Gutxienez, agindu multzo bat 
-        data_start = (code_start + ((code_size >> 2) << 2) + 1) << 2;
-        data_size = 4 + (rand() % conf.max_lines);
+static void locality_init(locality_t *loc, rng_t *rng, unsigned int data_size) {
+    unsigned int i;
+    double sum = 0;
+
+    memset(loc, 0, sizeof(*loc));
+    loc->position = rng_below(rng, data_size);
+    if (conf.access == ACCESS_ZIPF) {
+        loc->cdf = malloc(data_size * sizeof(double));
+        for (i = 0; i < data_size; i++) {
+            sum += 1.0 / pow(i + 1, conf.zipf_s);
+            loc->cdf[i] = sum;
+        }
+        for (i = 0; i < data_size; i++) loc->cdf[i] /= sum;
+    }
+}
 
-        sprintf(line,".text %06X\n", code_start);
-        fputs(line, fd);
-        sprintf(line,".data %06X\n", data_start);
-        fputs(line, fd);
+static unsigned int next_offset(locality_t *loc, rng_t *rng, unsigned int data_size) {
+    unsigned int low, high, mid, window;
+    double u;
+
+    switch (conf.access) {
+    case ACCESS_SEQUENTIAL:
+        loc->position = (loc->position + 1) % data_size;
+        return loc->position;
+    case ACCESS_STRIDED:
+        loc->position = (loc->position + conf.stride) % data_size;
+        return loc->position;
+    case ACCESS_ZIPF:   // lehen hitzak dira beroenak
+        u = rng_unit(rng);
+        low = 0; high = data_size - 1;
+        while (low < high) {
+            mid = (low + high) / 2;
+            if (loc->cdf[mid] < u) low = mid + 1; else high = mid;
+        }
+        return low;
+    case ACCESS_PHASES:
+        if (loc->phase_left == 0) {
+            loc->window_start = rng_below(rng, data_size);
+            loc->phase_left = conf.phase_length;
+        }
+        loc->phase_left--;
+        window = conf.window < data_size ? conf.window : data_size;
+        return (loc->window_start + rng_below(rng, window)) % data_size;
+    default:
+        return rng_below(rng, data_size);
+    }
+}
 
-        for (i=0; i < (code_size >> 2); i++) { //  lau lerrotako blokeak: ld ld add st
-            reg1 = rand() % 16;
-            var_offset  = (rand() % data_size) << 2;
-            sprintf(line,"0%1X%06X\n", reg1, data_start + var_offset); //ld
-            fputs(line, fd);
+/*-----------------------------------------------------------------------------
+ *   Programak sortu
+ *----------------------------------------------------------------------------*/
 
-            reg2 = (reg1 + 1) % 16;
-            var_offset  = (((var_offset >> 2) + 1) % data_size) << 2;
-            sprintf(line,"0%1X%06X\n", reg2, data_start + var_offset); // ld
-            fputs(line, fd);
+// Nukleoaren kodea idatzi (words NULL bada, luzera bakarrik kalkulatu). Erregistroak:
+// r0 beti 0, r1 kanpo-begizta, r2 erakuslea, r3 barne-begizta. Emaitza datuen azken hitzean
+static unsigned int emit_kernel(unsigned int *words, unsigned int code_start, unsigned int data_start,
+                                unsigned int elements, unsigned int start) {
+    unsigned int n = 0, outer, inner, steps;
+    unsigned int result = data_start + (elements << 2);
+
+#define EMIT(instr) do { if (words != NULL) words[n] = (instr); n++; } while (0)
+#define HERE        (code_start + (n << 2))
+    EMIT(LI(1, conf.repeat));
+    EMIT(LI(0, 0));
+    switch (conf.kernel) {
+    case KERNEL_REDUCE:   // r4 += datuak[i]
+        outer = HERE;
+        EMIT(LI(2, data_start));
+        EMIT(LI(3, elements));
+        EMIT(LI(4, 0));
+        inner = HERE;
+        EMIT(LDR(5, 2, 0));
+        EMIT(ADD(4, 4, 5));
+        EMIT(ADDI(2, 2, 4));
+        EMIT(ADDI(3, 3, -1));
+        EMIT(BNE(3, 0, inner));
+        EMIT(STORE(4, result));
+        break;
+    case KERNEL_SCAN:     // datuak[i] += 1, S hitzetik behin
+        steps = (elements + conf.scan_stride - 1) / conf.scan_stride;
+        EMIT(LI(6, 1));
+        outer = HERE;
+        EMIT(LI(2, data_start));
+        EMIT(LI(3, steps));
+        inner = HERE;
+        EMIT(LDR(5, 2, 0));
+        EMIT(ADD(5, 5, 6));
+        EMIT(STR(5, 2, 0));
+        EMIT(ADDI(2, 2, conf.scan_stride << 2));
+        EMIT(ADDI(3, 3, -1));
+        EMIT(BNE(3, 0, inner));
+        break;
+    default:              // KERNEL_CHASE: r2 = datuak[r2], katearen hurrengo helbidea
+        EMIT(LI(2, data_start + (start << 2)));
+        outer = HERE;
+        EMIT(LI(3, elements));
+        inner = HERE;
+        EMIT(LDR(2, 2, 0));
+        EMIT(ADDI(3, 3, -1));
+        EMIT(BNE(3, 0, inner));
+        EMIT(STORE(2, result));
+        break;
+    }
+    EMIT(ADDI(1, 1, -1));
+    EMIT(BNE(1, 0, outer));
+    EMIT(HALT);
+#undef EMIT
+#undef HERE
+    return n;
+}
+
+// Agindu motak zenbatu, manifesturako
+static void count_instructions(program_stats_t *st, unsigned int *words, unsigned int count) {
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        switch (words[i] >> 28) {
+            case 0x0: case 0xB: st->loads++; break;
+            case 0x1: case 0xC: st->stores++; break;
+            case 0x3: st->ios++; break;
+            case 0x7: case 0x8: case 0x9: case 0xA: st->branches++; break;
+            case 0xF: break;
+            default: st->adds++; break;
+        }
+    }
+}
+
+// Sattolo: ziklo bakar bat datu guztien artean; hitz bakoitzak hurrengoaren helbidea du
+static void chase_cycle(unsigned int *data, rng_t *rng, unsigned int data_start, unsigned int elements) {
+    unsigned int i, j, t, *order = malloc(elements * sizeof(unsigned int));
+
+    for (i = 0; i < elements; i++) order[i] = i;
+    for (i = elements - 1; i > 0; i--) {
+        j = rng_below(rng, i);
+        t = order[i]; order[i] = order[j]; order[j] = t;
+    }
+    for (i = 0; i < elements; i++)
+        data[order[i]] = data_start + (order[(i + 1) % elements] << 2);
+    free(order);
+}
+
+// Programa bat memorian osatu eta fitxategira idazketa bakar batean bota
+static void generate_program(unsigned int pnum) {
+    rng_t            rng;
+    locality_t       loc;
+    program_stats_t  *st = &stats[pnum - conf.first_number];
+    unsigned int     i, r, offset, reg1, reg2, reg3;
+    unsigned int     code_start, code_size, data_start, data_size, instructions;
+    unsigned int     *words;
+    char             file_name[PATH_LENGTH], *text, *cursor;
+    FILE             *fd;
+
+    rng_seed(&rng, conf.seed, pnum);
+    code_start = user_lowest & ~conf.offset_mask;
+    code_size = 4 + rng_below(&rng, conf.max_lines); // Gutxienez, agindu multzo bat
+    data_size = 4 + rng_below(&rng, conf.max_data);
+    memset(st, 0, sizeof(*st));
+
+    if (conf.kernel != KERNEL_NONE) {
+        // Nukleoa: kode finkoa eta datuen ondoren emaitzaren hitza
+        st->code_words = emit_kernel(NULL, code_start, 0, data_size, 0);
+        data_start = code_start + (st->code_words << 2);
+        st->data_words = data_size + 1;
+        words = malloc((st->code_words + st->data_words) * sizeof(unsigned int));
+        for (i = 0; i < st->data_words; i++)
+            words[st->code_words + i] = (rng_below(&rng, VALUE)) - (VALUE >> 1);
+        if (conf.kernel == KERNEL_CHASE)
+            chase_cycle(words + st->code_words, &rng, data_start, data_size);
+        emit_kernel(words, code_start, data_start, data_size, rng_below(&rng, data_size));
+        count_instructions(st, words, st->code_words);
+        data_size = st->data_words;
+        goto write;
+    }
+
+    instructions = conf.use_mix ? code_size : (code_size >> 2) << 2;
+    data_start = code_start + ((instructions + 1) << 2);
+
+    st->code_words = instructions + 1;
+    st->data_words = data_size;
+    words = malloc((st->code_words + data_size) * sizeof(unsigned int));
+    locality_init(&loc, &rng, data_size);
 
+    if (!conf.use_mix) {
+        for (i = 0; i < instructions; i += 4) { //  lau lerrotako blokeak: ld ld add st
+            reg1 = rng_below(&rng, 16);
+            reg2 = (reg1 + 1) % 16;
             reg3 = (reg1 + 2) % 16;
-            sprintf(line,"2%1X%1X%1X0000\n", reg3, reg1, reg2); // add
-            fputs(line, fd);
+            offset = next_offset(&loc, &rng, data_size);
+            words[i]     = LOAD(reg1, data_start + (offset << 2));
+            offset = (offset + 1) % data_size;
+            words[i + 1] = LOAD(reg2, data_start + (offset << 2));
+            words[i + 2] = ADD(reg3, reg1, reg2);
+            offset = (offset + 1) % data_size;
+            words[i + 3] = STORE(reg3, data_start + (offset << 2));
+        }
+        st->loads = st->adds = st->stores = instructions >> 2;
+        st->loads *= 2;
+    } else {
+        for (i = 0; i < instructions; i++) {
+            r = rng_below(&rng, 100);
+            if (r < conf.mix_load) {
+                words[i] = LOAD(rng_below(&rng, 16), data_start + (next_offset(&loc, &rng, data_size) << 2));
+                st->loads++;
+            } else if (r < conf.mix_load + conf.mix_store) {
+                words[i] = STORE(rng_below(&rng, 16), data_start + (next_offset(&loc, &rng, data_size) << 2));
+                st->stores++;
+            } else {
+                words[i] = ADD(rng_below(&rng, 16), rng_below(&rng, 16), rng_below(&rng, 16));
+                st->adds++;
+            }
+        }
+    }
+    // S/I aginduak beste agindu batzuen ordez; portzentajerik gabe sorgailuaren sekuentzia ez da aldatzen
+    if (conf.io_percent > 0) {
+        for (i = 0; i < instructions; i++) {
+            if (rng_below(&rng, 100) >= conf.io_percent) continue;
+            switch (words[i] >> 28) {
+                case 0: st->loads--; break;
+                case 1: st->stores--; break;
+                default: st->adds--; break;
+            }
+            words[i] = IO(rng_below(&rng, conf.io_devices), 1 + rng_below(&rng, conf.io_max_bytes));
+            st->ios++;
+        }
+    }
+    words[instructions] = HALT; // exit
 
-            var_offset  = (((var_offset >> 2) + 1) % data_size) << 2;
-            sprintf(line,"1%1X%06X\n", reg3, data_start + var_offset); // st
-            fputs(line, fd);
-        } // for code
+    for (i = 0; i < data_size; i++)
+        words[st->code_words + i] = (rng_below(&rng, VALUE)) - (VALUE >> 1);
+    free(loc.cdf);
+
+write:
+    snprintf(file_name, PATH_LENGTH, "%s%03d.elf", conf.prog_name, pnum);
+    if ((fd = fopen(file_name, "w")) == NULL) {
+        __error(0, "Error while opening file");
+    }
+
+    if (conf.binary) {
+        program_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, PROGRAM_MAGIC, sizeof(header.magic));
+        header.text_address = code_start;
+        header.data_address = data_start;
+        header.text_words = st->code_words;
+        header.data_words = data_size;
+        fwrite(&header, sizeof(header), 1, fd);
+        fwrite(words, sizeof(unsigned int), st->code_words + data_size, fd);
+    } else {
+        text = malloc(32 + (size_t)(st->code_words + data_size) * 9);
+        cursor = text;
+        cursor += sprintf(cursor, ".text %06X\n.data %06X\n", code_start, data_start);
+        for (i = 0; i < st->code_words + data_size; i++)
+            cursor += sprintf(cursor, "%08X\n", words[i]);
+        fwrite(text, 1, cursor - text, fd);
+        free(text);
+    }
+
+    fclose(fd);
+    free(words);
+}
 
-        sprintf(line,"F0000000\n"); // exit
-        fputs(line, fd);
+// Hari bakoitzak programak hartzen ditu, amaitu arte
+static void *generator_thread(void *arg) {
+    unsigned int pnum;
 
-        for (i=0; i < data_size; i++) {
-            datum = (rand() % VALUE) - (VALUE >> 1);
-            sprintf(line,"%08X\n", datum);
-            fputs(line, fd);
-         } // for data
+    while ((pnum = __sync_fetch_and_add(&next_program, 1)) < conf.first_number + conf.how_many)
+        generate_program(pnum);
+    return NULL;
+}
 
-         fclose(fd);
+// Sortutako multzoaren manifestua: parametroak eta programa bakoitzaren laburpena
+static void write_manifest(void) {
+    char          file_name[PATH_LENGTH];
+    const char    *access[] = {"uniform", "seq", "stride", "zipf", "phases"};
+    const char    *kernel[] = {"none", "reduce", "scan", "chase"};
+    unsigned int  i;
+    FILE          *fd;
+
+    snprintf(file_name, PATH_LENGTH, "%s.manifest", conf.prog_name);
+    if ((fd = fopen(file_name, "w")) == NULL) {
+        __error(0, "Error while opening manifest");
     }
+    fprintf(fd, "# prometheus seed=%lu first=%u programs=%u lines=%u data=%u page_bits=%u format=%s\n",
+            conf.seed, conf.first_number, conf.how_many, conf.max_lines, conf.max_data,
+            conf.offset_bits - 2, conf.binary ? "binary" : "text");
+    if (conf.use_mix)
+        fprintf(fd, "# mix=%u,%u,%u", conf.mix_load, conf.mix_store, conf.mix_add);
+    else
+        fprintf(fd, "# mix=ld-ld-add-st");
+    fprintf(fd, " access=%s stride=%u zipf=%.2f window=%u phase=%u io=%u:%u:%u\n", access[conf.access],
+            conf.stride, conf.zipf_s, conf.window, conf.phase_length, conf.io_percent, conf.io_devices, conf.io_max_bytes);
+    fprintf(fd, "# kernel=%s stride=%u repeat=%u\n", kernel[conf.kernel], conf.scan_stride, conf.repeat);
+    fprintf(fd, "# file code_words data_words loads stores adds ios branches\n");
+    for (i = 0; i < conf.how_many; i++)
+        fprintf(fd, "%s%03d.elf %u %u %u %u %u %u %u\n", conf.prog_name, conf.first_number + i,
+                stats[i].code_words, stats[i].data_words, stats[i].loads, stats[i].stores, stats[i].adds,
+                stats[i].ios, stats[i].branches);
+    fclose(fd);
+}
 
+int main(int argc, char *argv[]) {
+    pthread_t        *threads;
+    unsigned int     i;
+
+    __konfigurazioa(argc, argv);   // Konfigurazioa
+
+    user_lowest   = USER_LOWEST_ADDRESS;
+    user_highest  = (1 << conf.virtual_bits) - 1;
+    user_space    = user_highest - user_lowest + 1;
+
+    // Kodeak eta datuek helbide-espazioan sartu behar dute
+    if (((unsigned long)conf.max_lines + conf.max_data + 16) * 4 > user_space) {
+        __error(0, "Code and data do not fit in the virtual address space");
+    }
+    // Nukleoek helbideak li-rekin kargatzen dituzte eta jauziek 20 bit dituzte
+    if (conf.kernel != KERNEL_NONE && ((unsigned long)conf.max_data + 64) * 4 >= IMMEDIATE_LIMIT) {
+        __error(0, "Kernel data must stay below the reach of li");
+    }
+
+    __message(0);
+
+    stats = calloc(conf.how_many, sizeof(program_stats_t));
+    threads = malloc(conf.jobs * sizeof(pthread_t));
+    next_program = conf.first_number;
+    for (i = 0; i < conf.jobs; i++)
+        pthread_create(&threads[i], NULL, generator_thread, NULL);
+    for (i = 0; i < conf.jobs; i++)
+        pthread_join(threads[i], NULL);
+
+    write_manifest();
+    free(threads);
+    free(stats);
     return 0;
 
 } // main
@@ -99,13 +422,21 @@ int main(int argc, char *argv[]) {
 void __konfigurazioa(int argc, char *argv[]){
 
     int opt, long_index;
-    int seed = 0;
     static struct option long_options[] = {
+        {"access",     required_argument, 0,  'a' },
+        {"page-bits",  required_argument, 0,  'b' },
+        {"data",       required_argument, 0,  'd' },
         {"first",      required_argument, 0,  'f' },
         {"help",       no_argument,       0,  'h' },
+        {"io",         required_argument, 0,  'i' },
+        {"jobs",       required_argument, 0,  'j' },
+        {"kernel",     required_argument, 0,  'k' },
         {"lines",      required_argument, 0,  'l' },
+        {"mix",        required_argument, 0,  'm' },
         {"name",       required_argument, 0,  'n' },
+        {"format",     required_argument, 0,  'o' },
         {"programs",   required_argument, 0,  'p' },
+        {"repeat",     required_argument, 0,  'r' },
         {"seed",       required_argument, 0,  's' },
         {0,            0,                 0,   0  }
     };
@@ -113,60 +444,159 @@ void __konfigurazioa(int argc, char *argv[]){
     conf.virtual_bits = VIRTUAL_BITS_DEFAULT;
     conf.offset_bits  = PAGE_SIZE_BITS;
     conf.max_lines    = MAX_LINES_DEFAULT;
+    conf.max_data     = 0;
     conf.prog_name    = PROG_NAME_DEFAULT;
     conf.first_number = FIRST_NUMBER_DEFAULT;
     conf.how_many = HOW_MANY_DEFAULT;
+    conf.jobs = JOBS_DEFAULT;
+    conf.binary = 0;
+    conf.use_mix = 0;
+    conf.access = ACCESS_UNIFORM;
+    conf.stride = 1;
+    conf.zipf_s = 1.0;
+    conf.window = 64;
+    conf.phase_length = 256;
+    conf.seed = 0;
+    conf.io_percent = 0;
+    conf.io_devices = IO_DEVICES_DEFAULT;
+    conf.io_max_bytes = IO_BYTES_DEFAULT;
+    conf.kernel = KERNEL_NONE;
+    conf.scan_stride = 1;
+    conf.repeat = REPEAT_DEFAULT;
 
     long_index =0;
-    while ((opt = getopt_long(argc, argv,":f:hl:n:p:s:", 
+    while ((opt = getopt_long(argc, argv,":a:b:d:f:hi:j:k:l:m:n:o:p:r:s:", 
                         long_options, &long_index )) != -1) {
       switch(opt) {
+        case 'a':   /* -a or --access: datuetarako sarbideen lokalitatea */
+            if (strcmp(optarg, "uniform") == 0)
+                conf.access = ACCESS_UNIFORM;
+            else if (strcmp(optarg, "seq") == 0)
+                conf.access = ACCESS_SEQUENTIAL;
+            else if (sscanf(optarg, "stride:%u", &conf.stride) == 1 && conf.stride > 0)
+                conf.access = ACCESS_STRIDED;
+            else if (sscanf(optarg, "zipf:%lf", &conf.zipf_s) == 1 && conf.zipf_s > 0)
+                conf.access = ACCESS_ZIPF;
+            else if (sscanf(optarg, "phases:%u:%u", &conf.window, &conf.phase_length) == 2 &&
+                     conf.window > 0 && conf.phase_length > 0)
+                conf.access = ACCESS_PHASES;
+            else
+                __error(0, "Unknown access pattern");
+            break;
+        case 'b':   /* -b or --page-bits: simulatzailearen orri-tamaina, hitzetan */
+            conf.offset_bits = atoi(optarg) + 2;
+            break;
+        case 'd':   /* -d or --data */
+            conf.max_data = atoi(optarg);
+            break;
         case 'f':   /* -f or --first */ 
             conf.first_number = atoi(optarg);
             break; 
         case 'h':   /* -h or --help */
         case '?':
             printf ("Uso: %s [OPTIONS]\n", argv[0]);
+            printf ("  -a  --access=PAT\t"
+                "Localidad de los accesos a datos: uniform, seq, stride:K, zipf:S o phases:W:L [uniform]\n");
+            printf ("  -b  --page-bits=N\t"
+                "Páginas de 2^N palabras, como en el simulador [%d]\n", PAGE_SIZE_BITS - 2);
+            printf ("  -d  --data=NNN\t"
+                "Tamaño máximo del segmento de datos en palabras [el de --lines]\n");
             printf ("  -f  --first=NNN\t"
                 "Primer número del nombre [%d]\n", FIRST_NUMBER_DEFAULT);
             printf ("  -h, --help\t\t"
                "Ayuda\n");
+            printf ("  -i  --io=P[:D[:B]]\t"
+                "%% de instrucciones de E/S, en D dispositivos y de hasta B bytes [0:%d:%d]\n", IO_DEVICES_DEFAULT, IO_BYTES_DEFAULT);
+            printf ("  -j  --jobs=N\t\t"
+                "Hilos que generan programas en paralelo [%d]\n", JOBS_DEFAULT);
+            printf ("  -k  --kernel=K\t"
+                "Programas con bucles: reduce, scan[:S] o chase; ignoran --lines, --mix e --io\n");
             printf ("  -l  --lines=NNN\t"
                 "Número de líneas (aproximado) [%d]\n", MAX_LINES_DEFAULT);
+            printf ("  -m  --mix=L,S,A\t"
+                "%% de cargas, almacenamientos y sumas; sin él, bloques ld ld add st\n");
             printf ("  -n  --name=SSS\t"
                "Inicial del nombre del programa [%s]\n", PROG_NAME_DEFAULT);
+            printf ("  -o  --format=FMT\t"
+                "Formato de los programas: text o binary [text]\n");
             printf ("  -p  --programs=NNN\t"
                 "Número máximo de programas [%d]\n", HOW_MANY_DEFAULT);
+            printf ("  -r  --repeat=N\t"
+                "Veces que un kernel recorre sus datos [%d]\n", REPEAT_DEFAULT);
             printf ("  -s  --seed=N\t"
-                "Semilla para crear numeros aleatorios [%d]\n", seed);
+                "Semilla para crear numeros aleatorios [%lu]\n", conf.seed);
 
             printf ("Ejemplos:\n");
             printf ("  ./prometheus -s 0 -nprog -f0  -l20   -p60\n");
             printf ("  ./prometheus -s 3 -nprog -f60 -l1000 -p1\n");
             printf ("  ./prometheus -s 9 -nprog -f61 -l20   -p60\n");
+            printf ("  ./prometheus -s 1 -nbig -p5000 -j8 -l4000 -d100000 -m40,20,40 -azipf:1.1 -obinary\n");
+            printf ("  ./prometheus -s 2 -nloop -p20 -d4096 -kscan:16 -r100000\n");
             exit(0);
+        case 'i':   /* -i or --io: S/I aginduen portzentajea, gailuak eta gehienezko tamaina */
+            if (sscanf(optarg, "%u:%u:%u", &conf.io_percent, &conf.io_devices, &conf.io_max_bytes) < 1 ||
+                conf.io_percent > 100 || conf.io_devices < 1 || conf.io_devices > 16 ||
+                conf.io_max_bytes < 1 || conf.io_max_bytes > 0xFFFFFF)
+                __error(0, "Invalid I/O specification");
+            break;
+        case 'j':   /* -j or --jobs */
+            conf.jobs = atoi(optarg);
+            if (conf.jobs < 1) conf.jobs = 1;
+            break;
+        case 'k':   /* -k or --kernel: begiztadun programak */
+            if (strcmp(optarg, "reduce") == 0)
+                conf.kernel = KERNEL_REDUCE;
+            else if (strcmp(optarg, "chase") == 0)
+                conf.kernel = KERNEL_CHASE;
+            else if (strcmp(optarg, "scan") == 0 ||
+                     (sscanf(optarg, "scan:%u", &conf.scan_stride) == 1 &&
+                      conf.scan_stride > 0 && (conf.scan_stride << 2) < OFFSET_LIMIT))
+                conf.kernel = KERNEL_SCAN;
+            else
+                __error(0, "Unknown kernel");
+            break;
         case 'l':   /* -l or --lines */ 
             conf.max_lines = atoi(optarg);
             break;
+        case 'm':   /* -m or --mix: ld, st eta add portzentajeak */
+            if (sscanf(optarg, "%u,%u,%u", &conf.mix_load, &conf.mix_store, &conf.mix_add) != 3 ||
+                conf.mix_load + conf.mix_store + conf.mix_add != 100)
+                __error(0, "The instruction mix must add up to 100");
+            conf.use_mix = 1;
+            break;
         case 'n':   /* -n or --name */ 
             conf.prog_name = optarg;
             break; 
+        case 'o':   /* -o or --format */
+            if (strcmp(optarg, "text") == 0)
+                conf.binary = 0;
+            else if (strcmp(optarg, "binary") == 0)
+                conf.binary = 1;
+            else
+                __error(0, "Unknown output format");
+            break;
         case 'p':   /* -p or --programs */ 
             conf.how_many = atoi(optarg);
             break;
+        case 'r':   /* -r or --repeat */
+            conf.repeat = strtoul(optarg, NULL, 10);
+            if (conf.repeat < 1 || conf.repeat >= IMMEDIATE_LIMIT)
+                __error(0, "Invalid repeat count");
+            break;
         case 's':
-            seed = atoi(optarg);
+            conf.seed = strtoul(optarg, NULL, 10);
             break; 
         default:
             __error(0, "Unknown argument option"); 
       } 
     } 
 
+    if (conf.max_lines == 0) conf.max_lines = 1;
+    if (conf.max_data == 0) conf.max_data = conf.max_lines;
+
     conf.offset_mask    = (1 << conf.offset_bits) - 1;
     conf.num_page_bits  = conf.virtual_bits - conf.offset_bits;
     conf.pages          = 1 << conf.num_page_bits;
-
-    srand (seed);
 } 
 
 /*----------------------------------------------------------------------------- 
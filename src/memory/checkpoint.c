@@ -0,0 +1,437 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "kernel_simulator.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "checkpoint.h"
+#include "shared.h"
+#include "io.h"
+#include "reclaimer.h"
+#include "interrupts.h"
+#include "zpool.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define MAGENTA "\033[35m"
+
+#define CHECKPOINT_MAGIC "KSIMCKPT"
+#define CHECKPOINT_VERSION 13
+#define CHECKPOINT_BUFFER (4 * 1024 * 1024)
+
+// Cabecera del fichero de checkpoint. Le siguen, en este orden: los PCBs, los hilos, el banco
+// de registros, la pila de frames libres, los frames del kernel en uso, los temporizadores, el pool de memoria comprimida y los frames de usuario en uso agrupados en
+// tramos contiguos, los del pool incluidos
+struct checkpoint_header
+{
+    char magic[8];
+    unsigned version;
+    struct kernel_machine machine; // Configuración; los punteros no se usan
+    unsigned pcb_count;
+    unsigned thread_count;
+    unsigned tlb_size;             // Los hilos se guardan tal cual y un motor puede tener otra TLB
+    unsigned virtual_pages;
+    unsigned frame_high_water;
+    unsigned free_count;
+    unsigned timer_count;
+    unsigned next_pid;
+    unsigned program_index;
+    unsigned long image_words;
+    unsigned long mapped_words;
+    unsigned long epoch;           // Pulso del checkpoint; los plazos de los PCBs cuentan desde él
+};
+
+// Un PCB y dónde estaba: en la cola de listos (-1, en el orden de la cola), bloqueado en la
+// cola de su dispositivo de E/S (-2, en el orden de la cola) o en un hilo
+#define CHECKPOINT_READY -1
+#define CHECKPOINT_BLOCKED -2
+struct checkpoint_pcb
+{
+    struct PCB pcb;
+    int thread;
+};
+
+// Contador de un temporizador. Se identifica por su vector: al restaurar se registran de nuevo
+// y no tienen por qué hacerlo en el mismo orden
+struct checkpoint_timer
+{
+    int vector;
+    unsigned long pulse_counter;
+};
+
+// Tramo de frames de usuario consecutivos; un tramo vacío marca el final
+struct checkpoint_run
+{
+    unsigned first;
+    unsigned count;
+};
+
+volatile int checkpoint_pending = 0; // El reloj debe tomar un checkpoint al acabar el pulso
+
+static char *mapped_file = NULL;     // Checkpoint proyectado en memoria durante la restauración
+static size_t mapped_size;
+static struct checkpoint_timer restored_counters[MAX_TIMERS];
+static unsigned restored_timers = 0;
+
+// Abandonar una restauración: el checkpoint no cuadra con su propio contenido o con la máquina
+static void reject_checkpoint(const char *reason)
+{
+    fprintf(stderr, RED"Checkpoint: Archivo corrupto (%s)"RESET"\n", reason);
+    exit(EXIT_FAILURE);
+}
+
+// Tomar las siguientes bytes del checkpoint proyectado, sin pasar del final del fichero
+static char *take_section(char **cursor, size_t bytes)
+{
+    char *section = *cursor;
+    if (bytes > mapped_size - (size_t)(section - mapped_file))
+        reject_checkpoint("truncado");
+    *cursor += bytes;
+    return section;
+}
+
+// Hilo a partir de su índice en el arena
+static struct HT *thread_at(int index)
+{
+    return &instance->kernel_machine.threads[index];
+}
+
+// Escribir el estado completo de la máquina; la máquina tiene que estar parada
+static void write_checkpoint(const char *path)
+{
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, RED"Checkpoint: Error al abrir el archivo %s"RESET"\n", tmp_path);
+        return;
+    }
+    setvbuf(f, NULL, _IOFBF, CHECKPOINT_BUFFER);
+
+    struct checkpoint_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.machine = instance->kernel_machine;
+    header.thread_count = instance->kernel_machine.thread_count;
+    header.tlb_size = TLB_SIZE;
+    header.virtual_pages = instance->virtual_pages;
+    header.frame_high_water = instance->allocator->frame_high_water;
+    header.free_count = instance->allocator->free_count;
+    header.timer_count = instance->timer_count;
+    header.next_pid = instance->next_pid;
+    header.program_index = instance->program_index;
+    header.image_words = instance->image_words;
+    header.mapped_words = instance->mapped_words;
+    header.epoch = current_epoch();
+    for (struct PCB *p = instance->ready_queue.head; p != NULL; p = p->next)
+        header.pcb_count++;
+    for (int d = 0; d < instance->io->device_count; d++)
+        header.pcb_count += instance->io->devices[d].queue_length;
+    for (int t = 0; t < header.thread_count; t++)
+        if (thread_at(t)->process != NULL)
+            header.pcb_count++;
+    fwrite(&header, sizeof(header), 1, f);
+
+    // PCBs: primero la cola de listos en orden, después las colas de los dispositivos y por
+    // último los que están en ejecución. Las peticiones en servicio vuelven a empezar al restaurar
+    struct checkpoint_pcb record;
+    for (struct PCB *p = instance->ready_queue.head; p != NULL; p = p->next)
+    {
+        record.pcb = *p;
+        record.thread = CHECKPOINT_READY;
+        fwrite(&record, sizeof(record), 1, f);
+    }
+    for (int d = 0; d < instance->io->device_count; d++)
+        for (struct PCB *p = instance->io->devices[d].head; p != NULL; p = p->next)
+        {
+            record.pcb = *p;
+            record.thread = CHECKPOINT_BLOCKED;
+            fwrite(&record, sizeof(record), 1, f);
+        }
+    for (int t = 0; t < header.thread_count; t++)
+    {
+        struct HT *thread = thread_at(t);
+        if (thread->process == NULL) continue;
+        record.pcb = *thread->process;
+        record.thread = t;
+        fwrite(&record, sizeof(record), 1, f);
+    }
+
+    // Contexto de los hilos, TLBs incluidas
+    for (int t = 0; t < header.thread_count; t++)
+        fwrite(thread_at(t), sizeof(struct HT), 1, f);
+    fwrite(instance->kernel_machine.registers, sizeof(int), REGISTERS_COUNT * instance->kernel_machine.lanes, f);
+
+    // Asignador de frames: la pila de libres; los usados salen de los tramos de frames
+    fwrite(instance->free_frames, sizeof(unsigned), instance->allocator->free_count, f);
+
+    // Tablas de páginas en los frames del kernel
+    fwrite(instance->allocator->kernel_frames_used, sizeof(instance->allocator->kernel_frames_used), 1, f);
+    for (int i = 0; i < KERNEL_FRAME_NUMBER; i++)
+        if (instance->allocator->kernel_frames_used[i])
+            fwrite(instance->kernel_reserved_memory + i * KERNEL_FRAME_SIZE, sizeof(word), instance->virtual_pages, f);
+
+    struct checkpoint_timer timer;
+    memset(&timer, 0, sizeof(timer));
+    for (int i = 0; i < instance->timer_count; i++)
+    {
+        timer.vector = instance->timers[i].vector;
+        timer.pulse_counter = instance->timers[i].pulse_counter;
+        fwrite(&timer, sizeof(timer), 1, f);
+    }
+
+    // Pool de memoria comprimida: su estado y las ranuras; las páginas van en sus frames
+    fwrite(instance->zpool, sizeof(struct zpool), 1, f);
+    fwrite(instance->zpool_frames, sizeof(unsigned), instance->zpool->max_slots, f);
+    fwrite(instance->zpool_live, sizeof(unsigned), instance->zpool->max_slots, f);
+
+    // Frames de usuario en uso, en tramos contiguos
+    struct checkpoint_run run;
+    for (unsigned i = 0; i < instance->allocator->frame_high_water; i += run.count)
+    {
+        run.first = i;
+        for (run.count = 0; i + run.count < instance->allocator->frame_high_water && instance->frames_used[i + run.count]; run.count++);
+        if (run.count == 0)
+        {
+            run.count = 1;
+            continue;
+        }
+        fwrite(&run, sizeof(run), 1, f);
+        fwrite(instance->physical_memory + ((address)run.first << instance->page_bits), sizeof(word), (size_t)run.count * instance->frame_size, f);
+    }
+    run.first = 0;
+    run.count = 0;
+    fwrite(&run, sizeof(run), 1, f);
+
+    if (fclose(f) != 0 || rename(tmp_path, path) != 0)
+    {
+        fprintf(stderr, RED"Checkpoint: Error al escribir el archivo %s"RESET"\n", path);
+        return;
+    }
+    DEBUG_PRINT(MAGENTA"Checkpoint:"RESET" Estado guardado en %s (%u procesos, %u frames)\n",
+                path, header.pcb_count, instance->allocator->frames_allocated);
+}
+
+// Pedir un checkpoint; lo tomará el reloj entre dos pulsos
+void request_checkpoint()
+{
+    checkpoint_pending = 1;
+}
+
+// Tomar el checkpoint pedido, si lo hay. Lo llama el hilo del reloj al acabar un pulso y para
+// el resto de subsistemas tomando sus mutex en el mismo orden que ellos: timer, loader, scheduler
+// y E/S, que ahora avanza en los manejadores de interrupciones
+void checkpoint_if_requested()
+{
+    if (!checkpoint_pending) return;
+    checkpoint_pending = 0;
+
+    pthread_mutex_lock(&instance->timer_mutex);
+    pthread_mutex_lock(&instance->loader_mutex);
+    pthread_mutex_lock(&instance->scheduler_mutex);
+    pthread_mutex_lock(&instance->io->lock);
+    drain_reclaimer(); // Los frames de los procesos retirados no deben quedar en uso en el checkpoint
+    write_checkpoint(instance->kernel_machine.checkpoint_path);
+    pthread_mutex_unlock(&instance->io->lock);
+    pthread_mutex_unlock(&instance->scheduler_mutex);
+    pthread_mutex_unlock(&instance->loader_mutex);
+    pthread_mutex_unlock(&instance->timer_mutex);
+}
+
+// Proyectar un checkpoint en memoria y recuperar la configuración de la máquina
+void open_checkpoint(const char *path, struct kernel_machine *m)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, RED"Checkpoint: Error al abrir el archivo %s"RESET"\n", path);
+        exit(EXIT_FAILURE);
+    }
+    mapped_size = st.st_size;
+    mapped_file = mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped_file == MAP_FAILED || mapped_size < sizeof(struct checkpoint_header))
+    {
+        fprintf(stderr, RED"Checkpoint: Error al proyectar el archivo %s"RESET"\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    struct checkpoint_header *header = (struct checkpoint_header *)mapped_file;
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 || header->version != CHECKPOINT_VERSION)
+    {
+        fprintf(stderr, RED"Checkpoint: %s no es un checkpoint válido"RESET"\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (header->tlb_size != TLB_SIZE)
+    {
+        fprintf(stderr, RED"Checkpoint: %s es de una TLB de %u entradas y este ejecutable tiene %d"RESET"\n",
+                path, header->tlb_size, TLB_SIZE);
+        exit(EXIT_FAILURE);
+    }
+
+    if (header->machine.page_bits < PAGE_BITS_MIN || header->machine.page_bits > PAGE_BITS_MAX ||
+        header->machine.huge_order > VIRTUAL_BITS - header->machine.page_bits)
+        reject_checkpoint("geometría de páginas");
+
+    // Sólo se recupera la geometría y los ritmos; el resto de opciones son las de la línea de comandos
+    m->clock_rate = header->machine.clock_rate;
+    m->scheduler_rate = header->machine.scheduler_rate;
+    m->process_generator_rate = header->machine.process_generator_rate;
+    m->num_CPUs = header->machine.num_CPUs;
+    m->cores_per_CPU = header->machine.cores_per_CPU;
+    m->threads_per_core = header->machine.threads_per_core;
+    m->page_bits = header->machine.page_bits;
+    m->huge_order = header->machine.huge_order;
+    m->memory_words = header->machine.memory_words;
+}
+
+// Restaurar el estado guardado en la máquina ya inicializada y liberar la proyección. Cada
+// sección se comprueba contra el tamaño del fichero y cada cuenta contra la máquina antes de usarla
+void restore_checkpoint()
+{
+    struct checkpoint_header *header = (struct checkpoint_header *)mapped_file;
+    char *cursor = mapped_file + sizeof(struct checkpoint_header);
+    if (header->pcb_count > PCB_POOL_SIZE)
+        reject_checkpoint("más procesos que PCBs");
+    if (header->thread_count != instance->kernel_machine.thread_count)
+        reject_checkpoint("número de hilos");
+    if (header->virtual_pages != instance->virtual_pages)
+        reject_checkpoint("tamaño de las tablas de páginas");
+    if (header->frame_high_water > instance->frame_count || header->free_count > instance->frame_count)
+        reject_checkpoint("frames de usuario");
+    if (header->timer_count > MAX_TIMERS)
+        reject_checkpoint("temporizadores");
+
+    // PCBs y cola de listos
+    struct checkpoint_pcb *records = (struct checkpoint_pcb *)take_section(&cursor, header->pcb_count * sizeof(struct checkpoint_pcb));
+    struct PCB **pcbs = malloc(header->pcb_count * sizeof(struct PCB *));
+    instance->ready_queue.head = instance->ready_queue.tail = NULL;
+    for (unsigned i = 0; i < header->pcb_count; i++)
+    {
+        struct checkpoint_pcb *record = &records[i];
+        if (record->thread < CHECKPOINT_BLOCKED || record->thread >= (int)header->thread_count)
+            reject_checkpoint("hilo de un proceso");
+
+        struct PCB *process = allocate_pcb();
+        if (process == NULL)
+            reject_checkpoint("sin PCBs libres");
+        *process = record->pcb;
+        process->next = NULL;
+        process->jit = NULL; // El código nativo no se guarda: los procesos restaurados se interpretan
+        process->jit_slots = NULL;
+        process->image = -1; // Las imágenes del perfilador son de la ejecución que guardó el checkpoint
+        process->release -= header->epoch; // El reloj restaurado vuelve a empezar en el pulso 0
+        process->deadline -= header->epoch;
+        process->last_run -= header->epoch;
+        atomic_fetch_add(&instance->edf_density, process->density);
+        pcbs[i] = process;
+        if (record->thread == CHECKPOINT_BLOCKED)
+            io_submit(process);
+        else if (record->thread == CHECKPOINT_READY)
+        {
+            if (instance->ready_queue.head == NULL)
+                instance->ready_queue.head = process;
+            else
+                instance->ready_queue.tail->next = process;
+            instance->ready_queue.tail = process;
+        }
+    }
+
+    // Hilos: el contexto se copia tal cual y el proceso se enlaza con su nuevo PCB
+    struct HT *saved_threads = (struct HT *)take_section(&cursor, header->thread_count * sizeof(struct HT));
+    size_t register_bytes = REGISTERS_COUNT * instance->kernel_machine.lanes * sizeof(int);
+    memcpy(instance->kernel_machine.registers, take_section(&cursor, register_bytes), register_bytes);
+    for (int t = 0; t < header->thread_count; t++)
+    {
+        struct HT *thread = thread_at(t);
+        *thread = saved_threads[t];
+        thread->process = NULL;
+    }
+    for (unsigned i = 0; i < header->pcb_count; i++)
+        if (records[i].thread >= 0)
+            thread_at(records[i].thread)->process = pcbs[i];
+    free(pcbs);
+
+    // Asignador de frames
+    instance->allocator->frame_high_water = header->frame_high_water;
+    instance->allocator->free_count = header->free_count;
+    memcpy(instance->free_frames, take_section(&cursor, header->free_count * sizeof(unsigned)), header->free_count * sizeof(unsigned));
+    for (unsigned i = 0; i < instance->allocator->free_count; i++)
+    {
+        if (instance->free_frames[i] >= instance->frame_count)
+            reject_checkpoint("frame libre");
+        instance->free_slot[instance->free_frames[i]] = i;
+    }
+
+    memcpy(instance->allocator->kernel_frames_used, take_section(&cursor, sizeof(instance->allocator->kernel_frames_used)),
+           sizeof(instance->allocator->kernel_frames_used));
+    for (int i = 0; i < KERNEL_FRAME_NUMBER; i++)
+    {
+        if (!instance->allocator->kernel_frames_used[i]) continue;
+        memcpy(instance->kernel_reserved_memory + i * KERNEL_FRAME_SIZE,
+               take_section(&cursor, header->virtual_pages * sizeof(word)), header->virtual_pages * sizeof(word));
+    }
+
+    // Los contadores de los temporizadores se aplican cuando el hilo del timer los registra
+    restored_timers = header->timer_count;
+    memcpy(restored_counters, take_section(&cursor, restored_timers * sizeof(struct checkpoint_timer)),
+           restored_timers * sizeof(struct checkpoint_timer));
+
+    // Pool de memoria comprimida: todo salvo el cerrojo. La geometría es la misma, así que
+    // también el número de ranuras
+    struct zpool *saved_pool = (struct zpool *)take_section(&cursor, sizeof(struct zpool));
+    if (saved_pool->max_slots != instance->zpool->max_slots)
+        reject_checkpoint("ranuras del pool comprimido");
+    size_t pool_state = offsetof(struct zpool, open_slot);
+    memcpy((char *)instance->zpool + pool_state, (char *)saved_pool + pool_state, sizeof(struct zpool) - pool_state);
+    size_t slot_bytes = instance->zpool->max_slots * sizeof(unsigned);
+    memcpy(instance->zpool_frames, take_section(&cursor, slot_bytes), slot_bytes);
+    memcpy(instance->zpool_live, take_section(&cursor, slot_bytes), slot_bytes);
+
+    // Frames de usuario
+    instance->allocator->frames_allocated = 0;
+    for (;;)
+    {
+        struct checkpoint_run *run = (struct checkpoint_run *)take_section(&cursor, sizeof(struct checkpoint_run));
+        if (run->count == 0) break;
+        if (run->first >= instance->frame_count || run->count > instance->frame_count - run->first)
+            reject_checkpoint("tramo de frames");
+
+        size_t words = (size_t)run->count * instance->frame_size;
+        memcpy(instance->physical_memory + ((address)run->first << instance->page_bits),
+               take_section(&cursor, words * sizeof(word)), words * sizeof(word));
+        memset(instance->frames_used + run->first, 1, run->count);
+        instance->allocator->frames_allocated += run->count;
+    }
+
+    instance->next_pid = header->next_pid;
+    instance->program_index = header->program_index;
+    instance->image_words = header->image_words;
+    instance->mapped_words = header->mapped_words;
+
+    DEBUG_PRINT(MAGENTA"Checkpoint:"RESET" Estado restaurado (%u procesos, %u frames)\n",
+                header->pcb_count, instance->allocator->frames_allocated);
+    munmap(mapped_file, mapped_size);
+    mapped_file = NULL;
+}
+
+// Recuperar los contadores de los temporizadores restaurados una vez registrados, cada uno en
+// el temporizador de su vector
+void restore_timer_state()
+{
+    for (unsigned i = 0; i < restored_timers; i++)
+        for (int t = 0; t < instance->timer_count; t++)
+            if (instance->timers[t].vector == restored_counters[i].vector)
+                instance->timers[t].pulse_counter = restored_counters[i].pulse_counter % instance->timers[t].target_pulse;
+    restored_timers = 0;
+}
@@ -0,0 +1,331 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include "kernel_simulator.h"
+#include "scheduler.h"
+#include "dumper.h"
+#include "io.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define MAGENTA "\033[35m"
+
+#define DUMP_MAGIC "KSIMDUMP"
+#define DUMP_VERSION 1
+#define DUMP_BUFFER (4 * 1024 * 1024)
+#define DUMP_MAX_PENDING 4 // Instantáneas sin escribir; si el escritor no da abasto se descartan
+#define DUMP_MAX_PIDS 64
+
+// Cabecera de una instantánea binaria. Le sigue, por cada proceso, su dump_record, los
+// números de sus páginas con frame y el contenido de esas páginas en el mismo orden
+struct dump_header
+{
+    char magic[8];
+    unsigned version;
+    unsigned page_bits;
+    unsigned long sequence;
+    unsigned process_count;
+};
+
+struct dump_record
+{
+    int pid;
+    address pc;
+    int registers[REGISTERS_COUNT];
+    address code;
+    address data;
+    unsigned page_count;
+};
+
+// Copia de un proceso tomada entre dos pulsos
+struct dump_process
+{
+    struct dump_record record;
+    unsigned *pages;  // Páginas virtuales con frame, en orden
+    word *contents;   // page_count * frame_size palabras
+};
+
+struct dump_snapshot
+{
+    unsigned long sequence;
+    unsigned count;
+    struct dump_process *processes;
+    struct dump_snapshot *next;
+};
+
+unsigned mapped_pages(address pagetable);
+void mmu_read_block(address pagetable, address virtual_address, word *buffer, unsigned count);
+
+static volatile sig_atomic_t dump_pending = 0; // El reloj debe tomar una instantánea al acabar el pulso
+
+// Cola de instantáneas copiadas que esperan al hilo escritor
+static pthread_mutex_t dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dump_ready = PTHREAD_COND_INITIALIZER;
+static struct dump_snapshot *queue_head = NULL, *queue_tail = NULL;
+static int queue_length = 0;
+static unsigned long next_sequence = 0;
+
+// Procesos seleccionados con --dump-pids; sin selección se vuelcan todos
+static int selected_pids[DUMP_MAX_PIDS];
+static int selected_count = 0;
+
+// Función para saber si un proceso entra en las instantáneas
+static int is_selected(int pid)
+{
+    if (selected_count == 0) return 1;
+    for (int i = 0; i < selected_count; i++)
+        if (selected_pids[i] == pid)
+            return 1;
+    return 0;
+}
+
+// Copiar las páginas con frame de un proceso, una lectura de bloque por página
+static void copy_process(struct dump_process *copy, struct PCB *process, address pagetable, address pc)
+{
+    copy->record.pid = process->pid;
+    copy->record.pc = pc;
+    copy->record.code = process->mm.code;
+    copy->record.data = process->mm.data;
+    copy->record.page_count = mapped_pages(pagetable);
+    copy->pages = malloc(copy->record.page_count * sizeof(unsigned));
+    copy->contents = malloc((size_t)copy->record.page_count * instance->frame_size * sizeof(word));
+
+    unsigned n = 0;
+    for (unsigned page = 0; page < instance->virtual_pages && n < copy->record.page_count; page++)
+    {
+        if (instance->kernel_reserved_memory[pagetable + page] == PAGE_INVALID) continue;
+        copy->pages[n] = page;
+        mmu_read_block(pagetable, page << instance->page_bits, copy->contents + (size_t)n * instance->frame_size, instance->frame_size);
+        n++;
+    }
+}
+
+// Copiar los procesos seleccionados. Sólo se bloquea el planificador, y sólo mientras se
+// copian las tablas de páginas y los frames; el formateo y la escritura quedan para después
+static struct dump_snapshot *take_snapshot()
+{
+    struct dump_snapshot *snapshot = malloc(sizeof(struct dump_snapshot));
+    snapshot->sequence = next_sequence++;
+    snapshot->count = 0;
+    snapshot->next = NULL;
+
+    pthread_mutex_lock(&instance->scheduler_mutex);
+    unsigned capacity = instance->kernel_machine.thread_count;
+    for (struct PCB *p = instance->ready_queue.head; p != NULL; p = p->next)
+        capacity++;
+    pthread_mutex_lock(&instance->io->lock);
+    for (int d = 0; d < instance->io->device_count; d++)
+        capacity += instance->io->devices[d].queue_length;
+    snapshot->processes = malloc(capacity * sizeof(struct dump_process));
+
+    // Los procesos en ejecución tienen el pc y los registros en su hilo
+    for (int t = 0; t < instance->kernel_machine.thread_count; t++)
+    {
+        struct HT *thread = &instance->kernel_machine.threads[t];
+        if (thread->process == NULL || !is_selected(thread->process->pid)) continue;
+
+        struct dump_process *copy = &snapshot->processes[snapshot->count++];
+        copy_process(copy, thread->process, thread->PTBR, thread->pc);
+        for (int r = 0; r < REGISTERS_COUNT; r++)
+            copy->record.registers[r] = HT_REGISTER(thread, r);
+    }
+    for (struct PCB *p = instance->ready_queue.head; p != NULL; p = p->next)
+    {
+        if (!is_selected(p->pid)) continue;
+
+        struct dump_process *copy = &snapshot->processes[snapshot->count++];
+        copy_process(copy, p, p->mm.pgb, p->pc);
+        memcpy(copy->record.registers, p->registers, sizeof(p->registers));
+    }
+
+    // Los bloqueados en E/S guardaron su contexto en el PCB al bloquearse, como los listos
+    for (int d = 0; d < instance->io->device_count; d++)
+        for (struct PCB *p = instance->io->devices[d].head; p != NULL; p = p->next)
+        {
+            if (!is_selected(p->pid)) continue;
+
+            struct dump_process *copy = &snapshot->processes[snapshot->count++];
+            copy_process(copy, p, p->mm.pgb, p->pc);
+            memcpy(copy->record.registers, p->registers, sizeof(p->registers));
+        }
+    pthread_mutex_unlock(&instance->io->lock);
+    pthread_mutex_unlock(&instance->scheduler_mutex);
+
+    return snapshot;
+}
+
+// Escribir una instantánea en texto: sólo las palabras distintas de cero, con su dirección,
+// así que no se pierde nada de lo que haya detrás de un cero
+static void write_text(FILE *f, struct dump_snapshot *snapshot)
+{
+    fprintf(f, "Instantánea %lu: %u procesos\n", snapshot->sequence, snapshot->count);
+    for (unsigned i = 0; i < snapshot->count; i++)
+    {
+        struct dump_process *copy = &snapshot->processes[i];
+        fprintf(f, "\n.Proceso %d: pc x%.6x\n.Registros:", copy->record.pid, copy->record.pc);
+        for (int r = 0; r < REGISTERS_COUNT; r++)
+            fprintf(f, " r%d=%.8x", r, copy->record.registers[r]);
+        fprintf(f, "\n");
+
+        int section = -1;
+        for (unsigned n = 0; n < copy->record.page_count; n++)
+        {
+            const word *contents = copy->contents + (size_t)n * instance->frame_size;
+            for (unsigned j = 0; j < instance->frame_size; j++)
+            {
+                if (contents[j] == 0) continue;
+                address addr = (copy->pages[n] << instance->page_bits) + j;
+                int is_data = addr >= copy->record.data;
+                if (is_data != section)
+                {
+                    fprintf(f, is_data ? "\n.Datos:\n" : "\n.Texto:\n");
+                    section = is_data;
+                }
+                fprintf(f, "x%.6x: [%.8x]\n", addr, contents[j]);
+            }
+        }
+    }
+}
+
+// Escribir una instantánea en binario, con páginas completas
+static void write_binary(FILE *f, struct dump_snapshot *snapshot)
+{
+    struct dump_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DUMP_MAGIC, sizeof(header.magic));
+    header.version = DUMP_VERSION;
+    header.page_bits = instance->page_bits;
+    header.sequence = snapshot->sequence;
+    header.process_count = snapshot->count;
+    fwrite(&header, sizeof(header), 1, f);
+
+    for (unsigned i = 0; i < snapshot->count; i++)
+    {
+        struct dump_process *copy = &snapshot->processes[i];
+        fwrite(&copy->record, sizeof(copy->record), 1, f);
+        fwrite(copy->pages, sizeof(unsigned), copy->record.page_count, f);
+        fwrite(copy->contents, sizeof(word) * instance->frame_size, copy->record.page_count, f);
+    }
+}
+
+// Función para escribir y liberar una instantánea
+static void write_snapshot(struct dump_snapshot *snapshot)
+{
+    char path[256], tmp_path[272];
+    snprintf(path, sizeof(path), "processes/snapshot-%.6lu.%s", snapshot->sequence,
+             instance->kernel_machine.dump_binary ? "bin" : "txt");
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL)
+        fprintf(stderr, RED"Dumper: Error al abrir el archivo %s"RESET"\n", tmp_path);
+    else
+    {
+        setvbuf(f, NULL, _IOFBF, DUMP_BUFFER);
+        if (instance->kernel_machine.dump_binary)
+            write_binary(f, snapshot);
+        else
+            write_text(f, snapshot);
+        if (fclose(f) != 0 || rename(tmp_path, path) != 0)
+            fprintf(stderr, RED"Dumper: Error al escribir %s"RESET"\n", path);
+        else
+            DEBUG_PRINT(MAGENTA"Dumper:"RESET" Instantánea de %u procesos guardada en %s\n", snapshot->count, path);
+    }
+
+    for (unsigned i = 0; i < snapshot->count; i++)
+    {
+        free(snapshot->processes[i].pages);
+        free(snapshot->processes[i].contents);
+    }
+    free(snapshot->processes);
+    free(snapshot);
+}
+
+// Hilo escritor: formatea y escribe las instantáneas mientras la máquina sigue ejecutando
+static void *run_dumper()
+{
+    pthread_mutex_lock(&dump_mutex);
+    while (1)
+    {
+        while (queue_head == NULL)
+            pthread_cond_wait(&dump_ready, &dump_mutex);
+
+        struct dump_snapshot *snapshot = queue_head;
+        queue_head = snapshot->next;
+        if (queue_head == NULL)
+            queue_tail = NULL;
+        queue_length--;
+
+        pthread_mutex_unlock(&dump_mutex);
+        write_snapshot(snapshot);
+        pthread_mutex_lock(&dump_mutex);
+    }
+    return NULL;
+}
+
+// Manejador de SIGUSR1: sólo marca la petición, la instantánea la toma el reloj
+static void dump_signal(int signal)
+{
+    (void)signal;
+    dump_pending = 1;
+}
+
+// Función para arrancar el hilo escritor y atender SIGUSR1
+void start_dumper()
+{
+    if (instance->kernel_machine.dump_pids != NULL)
+    {
+        char *list = strdup(instance->kernel_machine.dump_pids);
+        for (char *pid = strtok(list, ","); pid != NULL && selected_count < DUMP_MAX_PIDS; pid = strtok(NULL, ","))
+            selected_pids[selected_count++] = atoi(pid);
+        free(list);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = dump_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+
+    pthread_t dumper_tid;
+    create_instance_thread(&dumper_tid, run_dumper);
+    pthread_detach(dumper_tid);
+}
+
+// Pedir una instantánea; la tomará el reloj entre dos pulsos
+void request_dump()
+{
+    dump_pending = 1;
+}
+
+// Tomar la instantánea pedida, si la hay, y pasársela al hilo escritor
+void dump_if_requested()
+{
+    if (!dump_pending) return;
+    dump_pending = 0;
+
+    pthread_mutex_lock(&dump_mutex);
+    int full = queue_length >= DUMP_MAX_PENDING;
+    pthread_mutex_unlock(&dump_mutex);
+    if (full)
+    {
+        fprintf(stderr, RED"Dumper: El escritor va retrasado, se descarta la instantánea"RESET"\n");
+        return;
+    }
+
+    struct dump_snapshot *snapshot = take_snapshot();
+
+    pthread_mutex_lock(&dump_mutex);
+    if (queue_tail == NULL)
+        queue_head = snapshot;
+    else
+        queue_tail->next = snapshot;
+    queue_tail = snapshot;
+    queue_length++;
+    pthread_cond_signal(&dump_ready);
+    pthread_mutex_unlock(&dump_mutex);
+}
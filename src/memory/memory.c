@@ -1,8 +1,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <limits.h>
+#include <sys/mman.h>
 #include "kernel_simulator.h"
+#include "shared.h"
+#include "zpool.h"
 //#include "memory.h" no necesario ya
 
 //Colores
@@ -12,123 +14,406 @@
 #define CYAN "\033[36m"
 #define MAGENTA "\033[35m"
 
-// Punteros a la memoria física y la memoria reservada para el kernel
-typedef unsigned address;
-typedef unsigned word;
-word* kernel_reserved_memory;
-word* physical_memory;
+// Los frames por encima de frame_high_water nunca se han usado y siguen a cero tal y como
+// los entrega mmap; los liberados por debajo se apilan en free_frames para reutilizarlos.
+// free_slot guarda la posición de cada frame en la pila para poder sacarlo de en medio.
+// El frame sumidero, detrás de los de usuario, recibe los accesos de un proceso al que no se
+// le ha podido dar frame hasta que el reloj lo termina al final del pulso
 
-// Arreglos para llevar el control de los frames utilizados
-int frames_used[FRAME_NUMBER];
-int kernel_frames_used[KERNEL_FRAME_NUMBER];
+static address mmu_translate_miss(struct HT *thread, address virtual_address);
 
-// Inicializar la memoria física
+// Camino rápido de la traducción especializado para cada tamaño de página: el
+// desplazamiento y la máscara son constantes y sólo se sale de aquí si fallan las TLBs
+#define DEFINE_MMU_TRANSLATE(BITS)                                                      \
+static address mmu_translate_##BITS(struct HT *thread, address virtual_address)         \
+{                                                                                       \
+    unsigned page = virtual_address >> BITS;                                            \
+    address offset = virtual_address & ((1u << BITS) - 1);                              \
+    struct TLB *tlb = &thread->tlb;                                                     \
+                                                                                        \
+    for (int i = 0; i < TLB_SIZE && tlb->pages[i] != PAGE_INVALID; i++)                 \
+        if (tlb->pages[i] == page)                                                      \
+            return (tlb->frames[i] << BITS) + offset;                                   \
+                                                                                        \
+    unsigned huge_page = page >> instance->huge_order;                                            \
+    for (int i = 0; i < TLB_HUGE_SIZE && tlb->huge_pages[i] != PAGE_INVALID; i++)       \
+        if (tlb->huge_pages[i] == huge_page)                                            \
+            return ((tlb->huge_frames[i] + (page & (instance->huge_pages - 1))) << BITS) + offset; \
+                                                                                        \
+    return mmu_translate_miss(thread, virtual_address);                                 \
+}
+
+#define SELECT_MMU_TRANSLATE(BITS) case BITS: instance->translate = mmu_translate_##BITS; break;
+
+PAGE_BITS_VARIANTS(DEFINE_MMU_TRANSLATE)
+
+// Inicializar la memoria física. La región se reserva con MAP_NORESERVE y el host sólo
+// la respalda cuando se toca, así que el arranque no depende del tamaño configurado.
+// Con procesos trabajadores la región y el asignador se comparten con ellos
 void initialize_memory()
 {
-    kernel_reserved_memory = malloc(MEMORY_SIZE * sizeof(word));
-    memset(kernel_reserved_memory, 0, MEMORY_SIZE * sizeof(word));
-    physical_memory = kernel_reserved_memory + KERNEL_RESERVED;
+    instance->page_bits = instance->kernel_machine.page_bits;
+    instance->frame_size = 1u << instance->page_bits;
+    instance->frame_count = instance->kernel_machine.memory_words >> instance->page_bits;
+    instance->virtual_pages = 1u << (VIRTUAL_BITS - instance->page_bits);
+    instance->huge_order = instance->kernel_machine.huge_order;
+    instance->huge_pages = 1u << instance->huge_order;
+
+    switch (instance->page_bits)
+    {
+    PAGE_BITS_VARIANTS(SELECT_MMU_TRANSLATE)
+    default:
+        fprintf(stderr, RED"Memoria física: Tamaño de página no soportado: 2^%u palabras"RESET"\n", instance->page_bits);
+        exit(EXIT_FAILURE);
+    }
+
+    instance->sink_frame = instance->frame_count;
+    instance->memory_bytes = (KERNEL_RESERVED + (size_t)(instance->frame_count + 1) * instance->frame_size) * sizeof(word);
+    instance->kernel_reserved_memory = shared_alloc(instance->memory_bytes);
+    if (instance->kernel_machine.transparent_hugepages)
+        madvise(instance->kernel_reserved_memory, instance->memory_bytes, MADV_HUGEPAGE);
+    instance->physical_memory = instance->kernel_reserved_memory + KERNEL_RESERVED;
+
+    // Las tablas del asignador tampoco cuestan nada hasta que se tocan
+    instance->frames_used = shared_alloc(instance->frame_count * sizeof(unsigned char));
+    instance->free_frames = shared_alloc(instance->frame_count * sizeof(unsigned));
+    instance->free_slot = shared_alloc(instance->frame_count * sizeof(unsigned));
+    instance->allocator = shared_alloc(sizeof(struct frame_allocator));
+    initialize_shared_mutex(&instance->allocator->lock);
+    initialize_zpool();
+
+    DEBUG_PRINT(MAGENTA"Memoria física:"RESET" %u frames de %u palabras, alcance de la TLB %u palabras\n",
+                instance->frame_count, instance->frame_size, (TLB_SIZE + TLB_HUGE_SIZE * instance->huge_pages) * instance->frame_size);
 }
 
 // Liberar la memoria física
 void free_memory()
 {
-    free(kernel_reserved_memory);
+    free_zpool();
+    shared_free(instance->allocator, sizeof(struct frame_allocator));
+    shared_free(instance->free_slot, instance->frame_count * sizeof(unsigned));
+    shared_free(instance->free_frames, instance->frame_count * sizeof(unsigned));
+    shared_free(instance->frames_used, instance->frame_count * sizeof(unsigned char));
+    shared_free(instance->kernel_reserved_memory, instance->memory_bytes);
 }
 
-// Obtener un frame disponible en la memoria de usuario
-unsigned char allocate_frame()
+// Apilar un frame libre que ya se ha usado alguna vez
+static void push_free_frame(unsigned frame)
+{
+    instance->free_slot[frame] = instance->allocator->free_count;
+    instance->free_frames[instance->allocator->free_count++] = frame;
+}
+
+// Sacar un frame de la pila de libres, esté donde esté
+static void remove_free_frame(unsigned frame)
 {
-    for (int i = 0; i < FRAME_NUMBER; i++)
+    unsigned last = instance->free_frames[--instance->allocator->free_count];
+    instance->free_frames[instance->free_slot[frame]] = last;
+    instance->free_slot[last] = instance->free_slot[frame];
+}
+
+// Marcar como usados los frames [first, first + count)
+static void claim_frames(unsigned first, unsigned count)
+{
+    for (unsigned j = 0; j < count; j++)
+        instance->frames_used[first + j] = 1;
+    instance->allocator->frames_allocated += count;
+}
+
+// Buscar un bloque de frames contiguos y alineado a su tamaño, con el asignador bloqueado.
+// Devuelve PAGE_INVALID si no hay ninguno
+static unsigned find_frames(unsigned count)
+{
+    unsigned first;
+
+    // Un frame suelto se reutiliza de la pila de libres, que ya está respaldada por el host
+    if (count == 1 && instance->allocator->free_count > 0)
     {
-        if (frames_used[i] == 0)
-        {
-            frames_used[i] = 1;
-            memset(physical_memory + i * FRAME_SIZE, 0, FRAME_SIZE * sizeof(word));
-            return (i);
-        }
+        first = instance->free_frames[instance->allocator->free_count - 1];
+        remove_free_frame(first);
+        claim_frames(first, 1);
+        memset(instance->physical_memory + ((address)first << instance->page_bits), 0, instance->frame_size * sizeof(word));
+        return first;
+    }
+
+    // Frames nunca usados: ya están a cero, no hace falta limpiarlos
+    first = (instance->allocator->frame_high_water + count - 1) & ~(count - 1);
+    if (first + count <= instance->frame_count)
+    {
+        while (instance->allocator->frame_high_water < first)
+            push_free_frame(instance->allocator->frame_high_water++);
+        instance->allocator->frame_high_water = first + count;
+        claim_frames(first, count);
+        return first;
     }
-    fprintf(stderr, RED"Memoria física: No hay espacio disponible en las páginas del usuario\n"RESET"\n");
-    exit(EXIT_FAILURE);
+
+    // Buscar un bloque alineado entre los frames ya usados que estén libres
+    for (first = 0; first + count <= instance->allocator->frame_high_water; first += count)
+    {
+        unsigned j;
+        for (j = 0; j < count && instance->frames_used[first + j] == 0; j++);
+        if (j < count) continue;
+
+        for (j = 0; j < count; j++)
+            remove_free_frame(first + j);
+        claim_frames(first, count);
+        memset(instance->physical_memory + ((address)first << instance->page_bits), 0, (size_t)count * instance->frame_size * sizeof(word));
+        return first;
+    }
+    return PAGE_INVALID;
+}
+
+// Obtener un bloque de frames contiguos y alineado a su tamaño en la memoria de usuario,
+// o PAGE_INVALID si no queda sitio
+unsigned allocate_frames(unsigned count)
+{
+    pthread_mutex_lock(&instance->allocator->lock);
+    unsigned first = find_frames(count);
+    pthread_mutex_unlock(&instance->allocator->lock);
+    return first;
+}
+
+// Obtener un frame disponible en la memoria de usuario
+unsigned allocate_frame()
+{
+    return allocate_frames(1);
 }
 
-// Obtener un frame disponible en la memoria del kernel
-unsigned char allocate_kernel_frame()
+// Obtener un frame disponible en la memoria del kernel, o PAGE_INVALID si no queda ninguno
+unsigned allocate_kernel_frame()
 {
+    pthread_mutex_lock(&instance->allocator->lock);
     for (int i = 0; i < KERNEL_FRAME_NUMBER; i++)
     {
-        if (kernel_frames_used[i] == 0)
+        if (instance->allocator->kernel_frames_used[i] == 0)
         {
-            kernel_frames_used[i] = 1;
-            memset(kernel_reserved_memory + i * FRAME_SIZE, 0, FRAME_SIZE * sizeof(word));
+            instance->allocator->kernel_frames_used[i] = 1;
+            pthread_mutex_unlock(&instance->allocator->lock);
+            memset(instance->kernel_reserved_memory + i * KERNEL_FRAME_SIZE, 0, KERNEL_FRAME_SIZE * sizeof(word));
             return (i);
         }
     }
-    fprintf(stderr, RED "Memoria física: No hay espacio disponible en las páginas del kernel\n"RESET"\n");
-    exit(EXIT_FAILURE);
+    pthread_mutex_unlock(&instance->allocator->lock);
+    return PAGE_INVALID;
 }
 
 // Liberar un frame en la memoria de usuario
-void deallocate_frame(unsigned char frame)
+void deallocate_frame(unsigned frame)
 {
-    frames_used[(int)frame] = 0;
+    pthread_mutex_lock(&instance->allocator->lock);
+    instance->frames_used[frame] = 0;
+    instance->allocator->frames_allocated--;
+    push_free_frame(frame);
+    pthread_mutex_unlock(&instance->allocator->lock);
 }
 
 // Liberar un frame en la memoria del kernel
-void deallocate_kernel_frame(unsigned char frame)
+void deallocate_kernel_frame(unsigned frame)
 {
-    kernel_frames_used[(int)frame] = 0;
+    pthread_mutex_lock(&instance->allocator->lock);
+    instance->allocator->kernel_frames_used[frame] = 0;
+    pthread_mutex_unlock(&instance->allocator->lock);
 }
 
-// Traducir una dirección virtual a una dirección física usando la MMU
-address mmu_translate(struct HT *thread, address virtual_address)
+// Crear una tabla de páginas vacía en el espacio del kernel; PAGE_INVALID si no hay frames del kernel
+address create_pagetable()
 {
-    int i;
-    unsigned char frame;
-    unsigned char page = virtual_address >> 16;
-    address offset = virtual_address & 0xFFFF;
+    unsigned frame = allocate_kernel_frame();
+    if (frame == PAGE_INVALID) return PAGE_INVALID;
 
-    struct TLB *tlb = &thread->tlb;
+    address pagetable = frame * KERNEL_FRAME_SIZE;
+    memset(instance->kernel_reserved_memory + pagetable, 0xFF, instance->virtual_pages * sizeof(word));
+    return pagetable;
+}
 
-    // Buscar en la TLB
-    for(i = 0; (i < TLB_SIZE && tlb->pages[i] != UCHAR_MAX); i++)
+// Obtener la entrada de una página, asignándole un frame si todavía no lo tiene o
+// descomprimiéndola si está en el pool. Sin frames libres devuelve PAGE_INVALID y la página
+// se queda como estaba
+static word map_page(address pagetable, unsigned page)
+{
+    word entry = instance->kernel_reserved_memory[pagetable + page];
+    if (entry == PAGE_INVALID)
     {
-        if(tlb->pages[i] == page)
-        {
-            frame = tlb->frames[i];
-            return (frame << 16) + offset;
-        }
+        entry = allocate_frame();
+        if (entry != PAGE_INVALID)
+            instance->kernel_reserved_memory[pagetable + page] = entry;
     }
+    else if (PAGE_IS_COMPRESSED(entry))
+        entry = zpool_fault(pagetable, page);
+    return entry;
+}
 
-    // Si no está en la TLB, buscar en la tabla de páginas
-    address pagetable = thread->PTBR;
-    frame = kernel_reserved_memory[pagetable + page];
+// Respaldar con páginas grandes todo el rango de direcciones virtuales [start, end). Si no
+// quedan bloques grandes el resto del rango se queda para páginas base
+void map_huge_range(address pagetable, address start, address end)
+{
+    unsigned first = (start >> instance->page_bits) & ~(instance->huge_pages - 1);
+    unsigned last = ((end - 1) >> instance->page_bits) | (instance->huge_pages - 1);
 
-    // Si no está en la tabla de páginas, pedir frame
-    if (frame == UCHAR_MAX)
+    for (unsigned page = first; page <= last && page < instance->virtual_pages; page += instance->huge_pages)
     {
-        frame = allocate_frame();
-        kernel_reserved_memory[pagetable + page] = frame;
+        // Una página grande no puede solaparse con páginas base ya asignadas
+        unsigned j;
+        for (j = 0; j < instance->huge_pages && instance->kernel_reserved_memory[pagetable + page + j] == PAGE_INVALID; j++);
+        if (j < instance->huge_pages) continue;
+
+        unsigned frame = allocate_frames(instance->huge_pages);
+        if (frame == PAGE_INVALID) break;
+        for (j = 0; j < instance->huge_pages; j++)
+            instance->kernel_reserved_memory[pagetable + page + j] = (frame + j) | PAGE_HUGE;
     }
+}
+
+// Traducir una dirección virtual recorriendo directamente la tabla de páginas, sin pasar por la TLB.
+// Sin frames libres la traducción cae en el frame sumidero
+address pagetable_translate(address pagetable, address virtual_address)
+{
+    word entry = map_page(pagetable, virtual_address >> instance->page_bits);
+    if (entry == PAGE_INVALID) entry = instance->sink_frame;
+    return ((entry & PAGE_FRAME_MASK) << instance->page_bits) + (virtual_address & (instance->frame_size - 1));
+}
 
-    // Actualizacion de TLB
-    if (i < TLB_SIZE)
+// Contar las páginas con frame asignado de una tabla de páginas
+unsigned mapped_pages(address pagetable)
+{
+    unsigned count = 0;
+    for (unsigned i = 0; i < instance->virtual_pages; i++)
+        if (instance->kernel_reserved_memory[pagetable + i] != PAGE_INVALID)
+            count++;
+    return count;
+}
+
+// Entrada de la tabla de páginas de una dirección virtual, comprobando que esté en el espacio
+static word block_entry(address pagetable, address virtual_address)
+{
+    if ((virtual_address >> instance->page_bits) >= instance->virtual_pages)
     {
-        thread->tlb.pages[i] = page;
-        thread->tlb.frames[i] = frame;
+        fprintf(stderr, RED"Memoria física: Dirección virtual %u fuera del espacio de direcciones"RESET"\n", virtual_address);
+        exit(EXIT_FAILURE);
     }
-    else
+    return instance->kernel_reserved_memory[pagetable + (virtual_address >> instance->page_bits)];
+}
+
+// Palabras que quedan hasta el final de la página de una dirección virtual
+static unsigned page_remaining(address virtual_address)
+{
+    return instance->frame_size - (virtual_address & (instance->frame_size - 1));
+}
+
+// Copiar chunk palabras de una página comprimida desde virtual_address sin sacarla del pool
+static void read_compressed(word entry, address virtual_address, word *buffer, unsigned chunk)
+{
+    word *page = malloc(instance->frame_size * sizeof(word));
+    zpool_read(entry, page);
+    memcpy(buffer, page + (virtual_address & (instance->frame_size - 1)), chunk * sizeof(word));
+    free(page);
+}
+
+// Leer count palabras de un espacio virtual. Cada página se traduce una sola vez con la
+// tabla de páginas y se copia entera; no se toca ninguna TLB, las páginas sin frame se
+// leen como ceros sin asignarlo y las comprimidas, sin sacarlas del pool
+void mmu_read_block(address pagetable, address virtual_address, word *buffer, unsigned count)
+{
+    while (count > 0)
     {
-        for (int j = 0; j < TLB_SIZE - 1; j++)
-        {
-            thread->tlb.pages[j] = thread->tlb.pages[j + 1];
-            thread->tlb.frames[j] = thread->tlb.frames[j + 1];
-        }
-        thread->tlb.pages[TLB_SIZE - 1] = page;
-        thread->tlb.frames[TLB_SIZE - 1] = frame;
+        unsigned chunk = page_remaining(virtual_address);
+        if (chunk > count) chunk = count;
+
+        word entry = block_entry(pagetable, virtual_address);
+        if (entry == PAGE_INVALID)
+            memset(buffer, 0, chunk * sizeof(word));
+        else if (PAGE_IS_COMPRESSED(entry))
+            read_compressed(entry, virtual_address, buffer, chunk);
+        else
+            memcpy(buffer, instance->physical_memory + ((entry & PAGE_FRAME_MASK) << instance->page_bits) + (virtual_address & (instance->frame_size - 1)),
+                   chunk * sizeof(word));
+
+        buffer += chunk;
+        virtual_address += chunk;
+        count -= chunk;
     }
+}
 
-    return (frame << 16) + offset;
+// Escribir count palabras en un espacio virtual, asignando frames a las páginas que no lo tengan.
+// Devuelve -1 si se quedan sin frames a medias; lo ya escrito queda en la tabla de páginas
+int mmu_write_block(address pagetable, address virtual_address, const word *buffer, unsigned count)
+{
+    while (count > 0)
+    {
+        unsigned chunk = page_remaining(virtual_address);
+        if (chunk > count) chunk = count;
+
+        block_entry(pagetable, virtual_address);
+        word entry = map_page(pagetable, virtual_address >> instance->page_bits);
+        if (entry == PAGE_INVALID) return -1;
+        memcpy(instance->physical_memory + ((entry & PAGE_FRAME_MASK) << instance->page_bits) + (virtual_address & (instance->frame_size - 1)), buffer,
+               chunk * sizeof(word));
+
+        buffer += chunk;
+        virtual_address += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
+// Insertar una traducción en una TLB; si está llena se descarta la entrada más antigua
+static void tlb_insert(unsigned *pages, unsigned *frames, int size, unsigned page, unsigned frame)
+{
+    int i;
+    for (i = 0; i < size && pages[i] != PAGE_INVALID; i++);
+
+    if (i == size)
+    {
+        memmove(pages, pages + 1, (size - 1) * sizeof(unsigned));
+        memmove(frames, frames + 1, (size - 1) * sizeof(unsigned));
+        i = size - 1;
+    }
+    pages[i] = page;
+    frames[i] = frame;
+}
+
+// Camino lento de la traducción: recorrer la tabla de páginas y recargar la TLB
+static address mmu_translate_miss(struct HT *thread, address virtual_address)
+{
+    unsigned page = virtual_address >> instance->page_bits;
+    address offset = virtual_address & (instance->frame_size - 1);
+
+    instance->tlb_refills++;
+    if (thread->process != NULL)
+        thread->process->tlb_refills++;
+
+    // Buscar en la tabla de páginas y, si no está, pedir frame
+    word entry = map_page(thread->PTBR, page);
+    if (entry == PAGE_INVALID)
+    {
+        // Sin frames libres: el proceso se termina al acabar su ráfaga y hasta entonces sus
+        // accesos van al frame sumidero, que no entra en la TLB
+        if (thread->process != NULL)
+            thread->process->out_of_memory = 1;
+        return (instance->sink_frame << instance->page_bits) + offset;
+    }
+    unsigned frame = entry & PAGE_FRAME_MASK;
+
+    // Actualizacion de TLB: las páginas grandes ocupan una única entrada de su propia TLB
+    if (entry & PAGE_HUGE)
+        tlb_insert(thread->tlb.huge_pages, thread->tlb.huge_frames, TLB_HUGE_SIZE,
+                   page >> instance->huge_order, frame - (page & (instance->huge_pages - 1)));
+    else
+        tlb_insert(thread->tlb.pages, thread->tlb.frames, TLB_SIZE, page, frame);
+
+    return (frame << instance->page_bits) + offset;
+}
+
+// Traducir una dirección virtual a una dirección física usando la MMU. Un motor con el tamaño
+// de página fijo llama directamente a su única variante
+address mmu_translate(struct HT *thread, address virtual_address)
+{
+#ifdef ENGINE_PAGE_BITS
+    #define CALL_MMU_TRANSLATE(BITS) return mmu_translate_##BITS(thread, virtual_address);
+    PAGE_BITS_VARIANTS(CALL_MMU_TRANSLATE)
+#else
+    return instance->translate(thread, virtual_address);
+#endif
 }
 
 // Leer una palabra de memoria usando la MMU
@@ -137,7 +422,7 @@ word mmu_fetch(struct HT *thread, address virtual_address)
     address physical_address = mmu_translate(thread, virtual_address);
     DEBUG_PRINT(GREEN" Hilo num:"RESET"%p,"CYAN" proceso num:"RESET" %d, Leer: "MAGENTA"Dir_virtual"RESET" %d, "MAGENTA"Dir_física"RESET" %d\n",
                 thread, thread->process->pid, virtual_address, physical_address);
-    return physical_memory[physical_address];
+    return instance->physical_memory[physical_address];
 }
 
 // Escribir una palabra en memoria usando la MMU
@@ -146,26 +431,27 @@ void mmu_store(struct HT *thread, address virtual_address, word data)
     address physical_address = mmu_translate(thread, virtual_address);
     DEBUG_PRINT(GREEN" Hilo num:" RESET " %p, proceso num: %d, Escribir:"MAGENTA" Dir_virtual"RESET" %d, "MAGENTA"Dir_física"RESET" %d\n",
                 thread, thread->process->pid, virtual_address, physical_address);
-    physical_memory[physical_address] = data;
+    instance->physical_memory[physical_address] = data;
 }
 
 // Limpiar la TLB
 void clear_tlb(struct TLB *tlb)
 {
-    memset(tlb->pages, UCHAR_MAX, TLB_SIZE);
-    memset(tlb->frames, UCHAR_MAX, TLB_SIZE);
+    memset(tlb, 0xFF, sizeof(struct TLB));
 }
 
 // Liberar una tabla de páginas
 void release_pagetable(address pagetable)
 {
-    for (int i = 0; i < FRAME_SIZE; i++)
+    for (unsigned i = 0; i < instance->virtual_pages; i++)
     {
-        unsigned char frame = kernel_reserved_memory[pagetable + i];
-        if (frame != UCHAR_MAX)
-            deallocate_frame(frame);
+        word entry = instance->kernel_reserved_memory[pagetable + i];
+        if (PAGE_IS_COMPRESSED(entry))
+            zpool_release(entry);
+        else if (entry != PAGE_INVALID)
+            deallocate_frame(entry & PAGE_FRAME_MASK);
     }
-    deallocate_kernel_frame(pagetable >> 16);
+    deallocate_kernel_frame(pagetable / KERNEL_FRAME_SIZE);
 }
 
 // Volcar el estado de un proceso a un archivo
@@ -181,23 +467,25 @@ void dump_process(struct HT *thread)
         exit(EXIT_FAILURE);
     }
 
+    // Cada segmento se lee de una vez con la tabla de páginas, sin pasar por la TLB del hilo. Se
+    // vuelca como mucho un frame: el texto acaba donde empiezan los datos y los datos, como
+    // tarde, al final del espacio virtual
+    word *segment = malloc(instance->frame_size * sizeof(word));
+    struct MM *mm = &thread->process->mm;
+
     fprintf(file, ".Texto:\n");
-    for (int i = 0; i < FRAME_SIZE; i++)
-    {
-        address addr = thread->process->mm.code + i;
-        word data = mmu_fetch(thread, addr);
-        if (data == 0) break;
-        fprintf(file, "x%.6x: [%.8x]\n", addr, data);
-    }
+    unsigned count = mm->data > mm->code && mm->data - mm->code < instance->frame_size ? mm->data - mm->code : instance->frame_size;
+    mmu_read_block(thread->PTBR, mm->code, segment, count);
+    for (unsigned i = 0; i < count && segment[i] != 0; i++)
+        fprintf(file, "x%.6x: [%.8x]\n", mm->code + i, segment[i]);
 
     fprintf(file, "\n.Datos:\n");
-    for (int i = 0; i < FRAME_SIZE; i++)
-    {
-        address addr = thread->process->mm.data + i;
-        word data = mmu_fetch(thread, addr);
-        if (data == 0) break;
-        fprintf(file, "x%.6x: [%.8x]\n", addr, data);
-    }
+    address end = (address)1 << VIRTUAL_BITS;
+    count = mm->data >= end ? 0 : end - mm->data < instance->frame_size ? end - mm->data : instance->frame_size;
+    mmu_read_block(thread->PTBR, mm->data, segment, count);
+    for (unsigned i = 0; i < count && segment[i] != 0; i++)
+        fprintf(file, "x%.6x: [%.8x]\n", mm->data + i, segment[i]);
 
+    free(segment);
     fclose(file);
 }
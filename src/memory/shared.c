@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "kernel_simulator.h"
+#include "shared.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+
+// Reserva de PCBs: los procesos trabajadores los liberan al ejecutar HALT, así que no
+// pueden salir del heap privado del coordinador
+struct pcb_pool {
+    pthread_mutex_t lock;
+    int free_count;
+    struct PCB *free[PCB_POOL_SIZE];
+    struct PCB pcbs[PCB_POOL_SIZE];
+};
+
+// Reservar memoria a cero y alineada a página. Con procesos trabajadores la región se
+// comparte con ellos al hacer fork; si no, es memoria privada corriente
+void *shared_alloc(size_t bytes)
+{
+    int flags = instance->kernel_machine.workers > 0 ? MAP_SHARED : MAP_PRIVATE;
+    void *memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        perror(RED"Memoria compartida: No se pudo reservar la región"RESET);
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+// Liberar una región obtenida con shared_alloc
+void shared_free(void *memory, size_t bytes)
+{
+    munmap(memory, bytes);
+}
+
+// Inicializar un mutex que pueden usar a la vez el coordinador y los trabajadores
+void initialize_shared_mutex(pthread_mutex_t *mutex)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+// Función para crear la reserva de PCBs
+void initialize_pcb_pool()
+{
+    instance->pcb_pool = shared_alloc(sizeof(struct pcb_pool));
+    initialize_shared_mutex(&instance->pcb_pool->lock);
+    for (int i = 0; i < PCB_POOL_SIZE; i++)
+        instance->pcb_pool->free[i] = &instance->pcb_pool->pcbs[PCB_POOL_SIZE - 1 - i];
+    instance->pcb_pool->free_count = PCB_POOL_SIZE;
+}
+
+// Obtener un PCB libre de la reserva, o NULL si no queda ninguno
+struct PCB *allocate_pcb()
+{
+    pthread_mutex_lock(&instance->pcb_pool->lock);
+    if (instance->pcb_pool->free_count == 0)
+    {
+        pthread_mutex_unlock(&instance->pcb_pool->lock);
+        return NULL;
+    }
+    struct PCB *process = instance->pcb_pool->free[--instance->pcb_pool->free_count];
+    pthread_mutex_unlock(&instance->pcb_pool->lock);
+    return process;
+}
+
+// Devolver un PCB a la reserva
+void free_pcb(struct PCB *process)
+{
+    pthread_mutex_lock(&instance->pcb_pool->lock);
+    instance->pcb_pool->free[instance->pcb_pool->free_count++] = process;
+    pthread_mutex_unlock(&instance->pcb_pool->lock);
+}
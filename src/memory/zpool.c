@@ -0,0 +1,413 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "kernel_simulator.h"
+#include "memory.h"
+#include "shared.h"
+#include "zpool.h"
+#include "jit.h"
+#include "interrupts.h"
+
+//Colores
+#define RESET "\033[0m"
+#define CYAN "\033[36m"
+#define MAGENTA "\033[35m"
+
+// Compresor LZ por palabras: cada secuencia es el número de literales, los literales y una
+// repetición de una ventana anterior (distancia y longitud en palabras). Todo va en varints de
+// 7 bits y los literales en zigzag, así que los enteros pequeños con signo de los segmentos de
+// datos ocupan un byte y las rachas de ceros del resto de la página, una repetición. La última
+// secuencia no tiene repetición: el descompresor para al llenar la página
+
+// Escribir un entero sin signo en varint
+static unsigned char *put_varint(unsigned char *out, unsigned value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = value | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+// Leer un entero sin signo en varint
+static const unsigned char *get_varint(const unsigned char *in, unsigned *value)
+{
+    unsigned result = 0, shift = 0;
+    while (*in & 0x80)
+    {
+        result |= (unsigned)(*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    *value = result | (unsigned)*in++ << shift;
+    return in;
+}
+
+// Escribir count literales en zigzag detrás de su número
+static unsigned char *put_literals(unsigned char *out, const word *literals, unsigned count)
+{
+    out = put_varint(out, count);
+    for (unsigned i = 0; i < count; i++)
+        out = put_varint(out, (literals[i] << 1) ^ (word)((int)literals[i] >> 31));
+    return out;
+}
+
+// Posición en la tabla de repeticiones de un par de palabras
+static unsigned hash_pair(word first, word second)
+{
+    return (first * 2654435761u ^ second * 2246822519u) >> (32 - ZPOOL_HASH_BITS);
+}
+
+// Comprimir una página de count palabras en out. Devuelve los bytes escritos, o 0 si no
+// caben en limit
+static size_t pack_page(const word *page, unsigned count, unsigned char *out, size_t limit)
+{
+    unsigned table[1 << ZPOOL_HASH_BITS]; // Última posición + 1 de cada par, 0 si no hay
+    memset(table, 0, sizeof(table));
+    unsigned char *op = out, *end = out + limit;
+    unsigned anchor = 0, i = 0;
+
+    while (i + ZPOOL_MIN_MATCH <= count)
+    {
+        unsigned h = hash_pair(page[i], page[i + 1]);
+        unsigned candidate = table[h];
+        table[h] = i + 1;
+        if (candidate == 0 || page[candidate - 1] != page[i] || page[candidate] != page[i + 1])
+        {
+            i++;
+            continue;
+        }
+        candidate--;
+
+        unsigned length = ZPOOL_MIN_MATCH;
+        while (i + length < count && page[candidate + length] == page[i + length])
+            length++;
+
+        // Como mucho 5 bytes por literal y otros 15 para los tres varints de la secuencia
+        if ((size_t)(end - op) < 5ul * (i - anchor) + 15) return 0;
+        op = put_literals(op, page + anchor, i - anchor);
+        op = put_varint(op, i - candidate);
+        op = put_varint(op, length - ZPOOL_MIN_MATCH);
+        i += length;
+        anchor = i;
+    }
+
+    if ((size_t)(end - op) < 5ul * (count - anchor) + 5) return 0;
+    op = put_literals(op, page + anchor, count - anchor);
+    return op - out;
+}
+
+// Descomprimir una página de count palabras
+static void unpack_page(const unsigned char *in, word *page, unsigned count)
+{
+    unsigned position = 0;
+    for (;;)
+    {
+        unsigned literals, value;
+        in = get_varint(in, &literals);
+        for (unsigned i = 0; i < literals; i++)
+        {
+            in = get_varint(in, &value);
+            page[position++] = (value >> 1) ^ -(value & 1);
+        }
+        if (position >= count) return;
+
+        unsigned distance, length;
+        in = get_varint(in, &distance);
+        in = get_varint(in, &length);
+        length += ZPOOL_MIN_MATCH;
+
+        // Lo ya copiado repite el patrón con periodo distance, así que una repetición solapada
+        // (una racha) se copia en tramos que doblan su tamaño sin que origen y destino se pisen
+        word *destination = page + position, *source = destination - distance;
+        for (unsigned done = 0; done < length; )
+        {
+            unsigned chunk = done + distance < length - done ? done + distance : length - done;
+            memcpy(destination + done, source, chunk * sizeof(word));
+            done += chunk;
+        }
+        position += length;
+    }
+}
+
+// Crear el pool vacío; antes de crear los procesos trabajadores. Con ZPOOL_MAX_PERCENT de los
+// frames el número de ranura cabe junto a la palabra en los 30 bits de la entrada, porque la
+// memoria física tiene menos de 2^32 palabras
+void initialize_zpool()
+{
+    instance->zpool = shared_alloc(sizeof(struct zpool));
+    initialize_shared_mutex(&instance->zpool->lock);
+    instance->zpool->open_slot = ZPOOL_NONE;
+    instance->zpool->max_slots = instance->frame_count * ZPOOL_MAX_PERCENT / 100;
+    if (instance->zpool->max_slots == 0)
+        instance->zpool->max_slots = 1;
+
+    instance->zpool_frames = shared_alloc(instance->zpool->max_slots * sizeof(unsigned));
+    instance->zpool_live = shared_alloc(instance->zpool->max_slots * sizeof(unsigned));
+    memset(instance->zpool_frames, 0xFF, instance->zpool->max_slots * sizeof(unsigned));
+}
+
+// Liberar el pool
+void free_zpool()
+{
+    shared_free(instance->zpool_live, instance->zpool->max_slots * sizeof(unsigned));
+    shared_free(instance->zpool_frames, instance->zpool->max_slots * sizeof(unsigned));
+    shared_free(instance->zpool, sizeof(struct zpool));
+}
+
+// Palabras del host de una dirección del pool
+static word *pool_words(address pool_address)
+{
+    unsigned slot = pool_address >> instance->page_bits;
+    return instance->physical_memory + ((address)instance->zpool_frames[slot] << instance->page_bits) +
+           (pool_address & (instance->frame_size - 1));
+}
+
+// Devolver el frame de una ranura sin páginas vivas. Se llama con el pool bloqueado
+static void release_slot(unsigned slot)
+{
+    deallocate_frame(instance->zpool_frames[slot]);
+    instance->zpool_frames[slot] = PAGE_INVALID;
+    instance->zpool->slots_used--;
+}
+
+// Reservar words palabras en la ranura abierta, abriendo otra si no caben. Se llama con el
+// pool bloqueado; devuelve la dirección en el pool o PAGE_INVALID si no hay ranura o frame
+static address reserve_words(unsigned words)
+{
+    struct zpool *pool = instance->zpool;
+    if (pool->open_slot != ZPOOL_NONE && pool->fill + words > instance->frame_size)
+    {
+        if (instance->zpool_live[pool->open_slot] == 0)
+            release_slot(pool->open_slot);
+        pool->open_slot = ZPOOL_NONE;
+    }
+
+    if (pool->open_slot == ZPOOL_NONE)
+    {
+        unsigned slot;
+        for (slot = 0; slot < pool->max_slots && instance->zpool_frames[slot] != PAGE_INVALID; slot++);
+        if (slot == pool->max_slots) return PAGE_INVALID;
+        unsigned frame = allocate_frame();
+        if (frame == PAGE_INVALID) return PAGE_INVALID;
+
+        instance->zpool_frames[slot] = frame;
+        instance->zpool_live[slot] = 0;
+        pool->open_slot = slot;
+        pool->fill = 0;
+        if (++pool->slots_used > pool->peak_slots)
+            pool->peak_slots = pool->slots_used;
+    }
+
+    address pool_address = (pool->open_slot << instance->page_bits) + pool->fill;
+    pool->fill += words;
+    instance->zpool_live[pool->open_slot] += words;
+    return pool_address;
+}
+
+// Guardar en el pool una página comprimida en packed. La primera palabra guarda las que ocupa
+static address store_page(const unsigned char *packed, size_t bytes)
+{
+    unsigned words = 1 + (bytes + sizeof(word) - 1) / sizeof(word);
+    struct zpool *pool = instance->zpool;
+
+    pthread_mutex_lock(&pool->lock);
+    address pool_address = reserve_words(words);
+    if (pool_address != PAGE_INVALID)
+    {
+        word *stored = pool_words(pool_address);
+        stored[0] = words;
+        memcpy(stored + 1, packed, bytes);
+        pool->stored_pages++;
+        pool->stored_words += words;
+        pool->compressed++;
+        pool->original_words += instance->frame_size;
+        pool->packed_words += words;
+        pool->frames_reclaimed++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return pool_address;
+}
+
+// Comprimir las páginas residentes de un proceso listo y devolver sus frames. Las páginas
+// grandes se quedan como están. Devuelve los frames devueltos, o -1 si el pool se ha llenado
+static int compress_process(struct PCB *process, unsigned char *scratch, size_t limit)
+{
+    word *pagetable = instance->kernel_reserved_memory + process->mm.pgb;
+    int reclaimed = 0, full = 0;
+
+    for (unsigned page = 0; page < instance->virtual_pages && !full; page++)
+    {
+        word entry = pagetable[page];
+        if (entry == PAGE_INVALID || (entry & (PAGE_HUGE | PAGE_COMPRESSED))) continue;
+        const word *frame = instance->physical_memory + ((address)entry << instance->page_bits);
+
+        // Una página a cero no ocupa sitio en el pool: se vuelve a pedir a cero en el fallo
+        unsigned i;
+        for (i = 0; i < instance->frame_size && frame[i] == 0; i++);
+        if (i == instance->frame_size)
+        {
+            pagetable[page] = PAGE_INVALID;
+            pthread_mutex_lock(&instance->zpool->lock);
+            instance->zpool->zero_pages++;
+            instance->zpool->frames_reclaimed++;
+            pthread_mutex_unlock(&instance->zpool->lock);
+        }
+        else
+        {
+            size_t bytes = pack_page(frame, instance->frame_size, scratch, limit);
+            if (bytes == 0)
+            {
+                pthread_mutex_lock(&instance->zpool->lock);
+                instance->zpool->rejected++;
+                pthread_mutex_unlock(&instance->zpool->lock);
+                continue;
+            }
+            address pool_address = store_page(scratch, bytes);
+            if (pool_address == PAGE_INVALID)
+            {
+                full = 1;
+                continue;
+            }
+            pagetable[page] = PAGE_COMPRESSED | pool_address;
+        }
+        deallocate_frame(entry);
+        reclaimed++;
+    }
+
+    if (reclaimed > 0)
+    {
+        // Las TLBs de los hilos por los que pasó y las ranuras del JIT apuntan a los frames devueltos
+        for (int t = 0; t < MACHINE_THREAD_COUNT; t++)
+            if (instance->kernel_machine.threads[t].tlb_pid == process->pid)
+                instance->kernel_machine.threads[t].tlb_pid = -1;
+        if (process->jit != NULL && process->jit_slots != NULL)
+            memset(process->jit_slots, 0, (process->jit->slot_count + 1) * sizeof(word *));
+        DEBUG_PRINT(CYAN"Zpool:"RESET" Proceso %d comprimido, %d frames devueltos\n", process->pid, reclaimed);
+    }
+    return full ? -1 : reclaimed;
+}
+
+// Comprimir los procesos de la cola de listos que llevan más de --zswap sin ejecutarse hasta
+// devolver frames frames. Los EDF se dejan, para no sumar fallos a su plazo
+static void compress_cold_processes(unsigned frames)
+{
+    long cold = (long)current_epoch() - (long)instance->kernel_machine.zswap_cold_ms * MACHINE_CLOCK_RATE / 1000;
+    size_t limit = (size_t)instance->frame_size * sizeof(word) * ZPOOL_ACCEPT_PERCENT / 100;
+    unsigned char *scratch = malloc(limit);
+    unsigned reclaimed = 0;
+
+    for (struct PCB *p = instance->ready_queue.head; p != NULL && reclaimed < frames; p = p->next)
+    {
+        if (p->edf || p->last_run > cold) continue;
+        int count = compress_process(p, scratch, limit);
+        if (count < 0) break;
+        reclaimed += count;
+    }
+    free(scratch);
+}
+
+// Frames que se dejan libres para los fallos de página de los procesos comprimidos: las páginas
+// de un proceso medio por cada hilo, que es lo que puede asignar una pasada del planificador,
+// y las de uno más para la carga siguiente. Sin --zswap no se reserva nada
+unsigned zpool_reserve()
+{
+    if (instance->kernel_machine.zswap_cold_ms == 0) return 0;
+    unsigned long loaded = instance->next_pid > 0 ? instance->next_pid : 1;
+    unsigned long pages = instance->mapped_words / instance->frame_size;
+    return (MACHINE_THREAD_COUNT + 1) * (pages > loaded ? (pages + loaded - 1) / loaded : 1);
+}
+
+// Si el uso de frames de usuario ha llegado a la marca alta o se come la reserva de los fallos
+// de página, comprimir procesos fríos hasta bajar de la marca baja y dejar la reserva libre.
+// Se llama con scheduler_mutex tomado: ninguno de los procesos listos puede pasar a un hilo
+// mientras tanto
+void zpool_balance()
+{
+    if (instance->kernel_machine.zswap_cold_ms == 0) return;
+    unsigned used = instance->allocator->frames_allocated, reserve = zpool_reserve();
+    unsigned high = (unsigned long)instance->kernel_machine.watermark_high * instance->frame_count / 100;
+    unsigned target = (unsigned long)instance->kernel_machine.watermark_low * instance->frame_count / 100;
+    if (reserve < instance->frame_count && instance->frame_count - reserve < target)
+        target = instance->frame_count - reserve;
+    if ((used >= high || used + reserve > instance->frame_count) && used > target)
+        compress_cold_processes(used - target);
+}
+
+// Quitar una página del pool. Se llama con el pool bloqueado
+static void drop_page(word entry)
+{
+    address pool_address = entry & ~PAGE_COMPRESSED;
+    unsigned slot = pool_address >> instance->page_bits;
+    unsigned words = pool_words(pool_address)[0];
+    struct zpool *pool = instance->zpool;
+
+    pool->stored_pages--;
+    pool->stored_words -= words;
+    instance->zpool_live[slot] -= words;
+    if (instance->zpool_live[slot] > 0) return;
+    if (slot == pool->open_slot)
+        pool->fill = 0; // La ranura abierta vacía se vuelve a llenar desde el principio
+    else
+        release_slot(slot);
+}
+
+// Fallo de página sobre una página comprimida: darle un frame, descomprimirla en él y quitarla
+// del pool. Devuelve la nueva entrada, o PAGE_INVALID si no hay frames y la página se queda
+// comprimida
+word zpool_fault(address pagetable, unsigned page)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    word entry = instance->kernel_reserved_memory[pagetable + page];
+    unsigned frame = allocate_frame();
+    if (frame == PAGE_INVALID) return PAGE_INVALID;
+
+    // La ranura no se libera mientras la página siga viva, así que se lee sin el cerrojo
+    unpack_page((const unsigned char *)(pool_words(entry & ~PAGE_COMPRESSED) + 1),
+                instance->physical_memory + ((address)frame << instance->page_bits), instance->frame_size);
+    instance->kernel_reserved_memory[pagetable + page] = frame;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    unsigned long elapsed = (end.tv_sec - start.tv_sec) * 1000000000ul + end.tv_nsec - start.tv_nsec;
+
+    struct zpool *pool = instance->zpool;
+    pthread_mutex_lock(&pool->lock);
+    drop_page(entry);
+    pool->faults++;
+    pool->fault_ns += elapsed;
+    if (elapsed > pool->max_fault_ns)
+        pool->max_fault_ns = elapsed;
+    pthread_mutex_unlock(&pool->lock);
+    return frame;
+}
+
+// Descomprimir una página del pool en page sin sacarla de él
+void zpool_read(word entry, word *page)
+{
+    unpack_page((const unsigned char *)(pool_words(entry & ~PAGE_COMPRESSED) + 1), page, instance->frame_size);
+}
+
+// Quitar del pool la página de una tabla de páginas que se libera
+void zpool_release(word entry)
+{
+    pthread_mutex_lock(&instance->zpool->lock);
+    drop_page(entry);
+    pthread_mutex_unlock(&instance->zpool->lock);
+}
+
+// Imprime las estadísticas de la memoria comprimida
+void display_zpool_statistics()
+{
+    struct zpool *pool = instance->zpool;
+    if (instance->kernel_machine.zswap_cold_ms == 0) return;
+
+    printf("Memoria comprimida: %lu páginas en %u frames del pool (hasta %u), %.1f:1 de media; %lu páginas a cero, %lu rechazadas\n",
+           pool->stored_pages, pool->slots_used, pool->peak_slots,
+           pool->packed_words ? (double)pool->original_words / pool->packed_words : 0.0, pool->zero_pages, pool->rejected);
+    printf("Fallos de página comprimida: %lu, %.1f us de media y %.1f us como máximo; %lu frames recuperados, %ld ahorrados ahora\n",
+           pool->faults, pool->faults ? pool->fault_ns / 1e3 / pool->faults : 0.0, pool->max_fault_ns / 1e3,
+           pool->frames_reclaimed, (long)pool->stored_pages - pool->slots_used);
+}
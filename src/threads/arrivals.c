@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include "kernel_simulator.h"
+#include "program_loader.h"
+#include "interrupts.h"
+#include "arrivals.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define CYAN "\033[36m"
+
+#define TRACE_LINE_LENGTH 512
+
+// Función para leer una traza: una llegada por línea,
+// "instante programa [prioridad [quantum_ms [plazo_ms [presupuesto_ms]]]]". Un quantum de 0 se
+// sortea y un plazo de 0 deja el proceso sin plazo. Las líneas vacías y las que empiezan por # se ignoran
+static void read_trace(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, RED"Arrivals: Error al abrir la traza %s"RESET"\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    char line[TRACE_LINE_LENGTH], program[TRACE_LINE_LENGTH];
+    unsigned capacity = 64, line_number = 0;
+    instance->trace = malloc(capacity * sizeof(struct arrival));
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line_number++;
+        char *start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == '\r' || *start == '\0') continue;
+
+        struct arrival arrival = {0};
+        int fields = sscanf(start, "%lf %511s %d %d %d %d", &arrival.time, program, &arrival.priority,
+                            &arrival.quantum_ms, &arrival.deadline_ms, &arrival.runtime_ms);
+        if (fields < 2 || arrival.time < 0 || arrival.quantum_ms < 0 || arrival.deadline_ms < 0 || arrival.runtime_ms < 0)
+        {
+            fprintf(stderr, RED"Arrivals: Línea %u de %s no válida"RESET"\n", line_number, path);
+            exit(EXIT_FAILURE);
+        }
+        arrival.path = strdup(program);
+
+        if (instance->trace_count == capacity)
+        {
+            capacity *= 2;
+            instance->trace = realloc(instance->trace, capacity * sizeof(struct arrival));
+        }
+        instance->trace[instance->trace_count++] = arrival;
+    }
+    fclose(f);
+
+    // Ordenación estable por inserción: las trazas suelen venir ya ordenadas y los empates
+    // conservan el orden del fichero
+    for (unsigned i = 1; i < instance->trace_count; i++)
+    {
+        struct arrival arrival = instance->trace[i];
+        unsigned j = i;
+        for (; j > 0 && instance->trace[j - 1].time > arrival.time; j--)
+            instance->trace[j] = instance->trace[j - 1];
+        instance->trace[j] = arrival;
+    }
+    DEBUG_PRINT(CYAN"Arrivals:"RESET" %u llegadas leídas de %s\n", instance->trace_count, path);
+}
+
+// Función para sortear un tiempo entre llegadas de un proceso de Poisson
+static double exponential_gap()
+{
+    return -log(1.0 - erand48(instance->random_state)) / instance->kernel_machine.arrival_rate;
+}
+
+// Función para calcular la siguiente llegada generada. En el modelo on/off las llegadas sólo
+// caen en los periodos activos; como el proceso no tiene memoria, una llegada que cae en un
+// periodo inactivo se vuelve a sortear desde el comienzo del siguiente periodo activo
+static void generate_next()
+{
+    double t = instance->generated_time + exponential_gap();
+    if (instance->kernel_machine.arrival_model == ARRIVALS_ONOFF)
+    {
+        double period = instance->kernel_machine.arrival_on + instance->kernel_machine.arrival_off;
+        while (fmod(t, period) >= instance->kernel_machine.arrival_on)
+            t = (floor(t / period) + 1) * period + exponential_gap();
+    }
+    instance->generated_time = t;
+}
+
+// Función para dar plazo a edf_share % de las llegadas de los generadores (--edf-mix). Sin la
+// opción no se sortea nada, así que las llegadas de Poisson no cambian
+static void draw_deadline(struct arrival *arrival)
+{
+    if (instance->kernel_machine.edf_share == 0) return;
+    if (erand48(instance->random_state) * 100 < instance->kernel_machine.edf_share)
+    {
+        arrival->deadline_ms = instance->kernel_machine.edf_deadline_ms;
+        arrival->runtime_ms = instance->kernel_machine.edf_runtime_ms;
+    }
+}
+
+// Función para obtener el pulso en el que cae la próxima llegada; devuelve 0 si no quedan
+static int upcoming_pulse(unsigned long *pulse)
+{
+    double t;
+    if (instance->kernel_machine.arrival_model == ARRIVALS_TRACE)
+    {
+        if (instance->trace_next == instance->trace_count) return 0;
+        t = instance->trace[instance->trace_next].time;
+    }
+    else
+        t = instance->generated_time;
+
+    *pulse = (unsigned long)(t * instance->kernel_machine.clock_rate);
+    return 1;
+}
+
+// Función para añadir una llegada a la cola del cargador
+static void append_pending(struct arrival *arrival)
+{
+    arrival->next = NULL;
+    if (instance->pending_tail == NULL)
+        instance->pending_head = arrival;
+    else
+        instance->pending_tail->next = arrival;
+    instance->pending_tail = arrival;
+}
+
+// Función para pasar la próxima llegada a la cola del cargador
+static void queue_upcoming()
+{
+    struct arrival *arrival = malloc(sizeof(struct arrival));
+    if (instance->kernel_machine.arrival_model == ARRIVALS_TRACE)
+        *arrival = instance->trace[instance->trace_next++]; // La traza cede la ruta al cargador
+    else
+    {
+        memset(arrival, 0, sizeof(struct arrival));
+        arrival->time = instance->generated_time;
+        draw_deadline(arrival);
+        generate_next();
+    }
+    append_pending(arrival);
+}
+
+// Encolar una llegada del generador de frecuencia fija. Se llama con loader_mutex tomado
+void queue_fixed_arrival()
+{
+    struct arrival *arrival = calloc(1, sizeof(struct arrival));
+    arrival->time = (double)current_epoch() / instance->kernel_machine.clock_rate;
+    draw_deadline(arrival);
+    append_pending(arrival);
+}
+
+// Función para preparar la fuente de llegadas elegida con --arrivals
+void initialize_arrivals()
+{
+    if (instance->kernel_machine.arrival_model == ARRIVALS_TRACE)
+        read_trace(instance->kernel_machine.arrival_trace);
+    else
+    {
+        instance->generated_time = 0.0;
+        generate_next();
+    }
+
+    unsigned long pulse;
+    if (upcoming_pulse(&pulse))
+        atomic_store(&instance->arrival_deadline, pulse);
+}
+
+// Función del temporizador: reclama las llegadas vencidas en el pulso epoch. Sólo la primera
+// llamada tras vencer devuelve 1; el manejador vuelve a armar la siguiente
+int claim_arrivals(unsigned long epoch)
+{
+    unsigned long deadline = atomic_load(&instance->arrival_deadline);
+    return deadline <= epoch && atomic_compare_exchange_strong(&instance->arrival_deadline, &deadline, ULONG_MAX);
+}
+
+// Devolver una reclamación cuya interrupción se ha perdido; se reintenta en el siguiente pulso
+void release_arrivals(unsigned long epoch)
+{
+    atomic_store(&instance->arrival_deadline, epoch);
+}
+
+// Manejador de IRQ_ARRIVALS: entrega al cargador todas las llegadas vencidas y arma la siguiente
+void fire_arrivals()
+{
+    unsigned long epoch = current_epoch(), pulse;
+    int remaining;
+
+    pthread_mutex_lock(&instance->loader_mutex);
+    while ((remaining = upcoming_pulse(&pulse)) && pulse <= epoch)
+        queue_upcoming();
+    pthread_cond_signal(&instance->loader_run_signal);
+    pthread_mutex_unlock(&instance->loader_mutex);
+
+    atomic_store(&instance->arrival_deadline, remaining ? pulse : ULONG_MAX);
+}
+
+// Sacar la siguiente llegada pendiente, o NULL si no hay. Se llama con loader_mutex tomado;
+// la llegada y su ruta pasan a ser del que llama
+struct arrival *next_arrival()
+{
+    struct arrival *head = instance->pending_head;
+    if (head == NULL) return NULL;
+
+    instance->pending_head = head->next;
+    if (instance->pending_head == NULL)
+        instance->pending_tail = NULL;
+    return head;
+}
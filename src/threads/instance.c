@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "kernel_simulator.h"
+#include "system_clock.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "jit.h"
+#include "power.h"
+#include "zpool.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define MAGENTA "\033[35m"
+
+__thread struct instance *instance = NULL; // Instancia de la máquina a la que sirve el hilo
+
+// Hilo del pool: las instancias que tiene asignadas, fuera de las que está ejecutando
+struct pool_worker
+{
+    pthread_mutex_t lock;
+    struct instance **instances;
+    int count;
+    int index;
+    _Atomic int busy; // Está dando un pulso; sólo entonces se le roban instancias
+};
+
+static struct pool_worker *pool = NULL;
+static int pool_size = 0;
+static _Atomic int instances_running = 0;
+
+// Argumentos de create_instance_thread: el hilo nuevo hereda la instancia de quien lo crea
+struct instance_start
+{
+    struct instance *instance;
+    void *(*routine)();
+};
+
+// Instante del host en nanosegundos
+static unsigned long long now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// Función para reservar una instancia con el estado inicial que antes daban los
+// inicializadores de las variables globales
+struct instance *create_instance(int index)
+{
+    struct instance *created = calloc(1, sizeof(struct instance));
+    if (created == NULL)
+    {
+        perror(RED"Error: No se pudo asignar memoria para la instancia"RESET);
+        exit(EXIT_FAILURE);
+    }
+    created->index = index;
+
+    pthread_mutex_init(&created->timer_init_mutex, NULL);
+    pthread_cond_init(&created->timer_init_cond, NULL);
+    pthread_mutex_init(&created->timer_mutex, NULL);
+    pthread_mutex_init(&created->loader_init_mutex, NULL);
+    pthread_cond_init(&created->loader_init_cond, NULL);
+    pthread_mutex_init(&created->loader_mutex, NULL);
+    pthread_cond_init(&created->loader_run_signal, NULL);
+    pthread_mutex_init(&created->scheduler_init_mutex, NULL);
+    pthread_cond_init(&created->scheduler_init_cond, NULL);
+    pthread_mutex_init(&created->scheduler_mutex, NULL);
+    pthread_cond_init(&created->scheduler_run_signal, NULL);
+    pthread_mutex_init(&created->pulse_mutex, NULL);
+    pthread_mutex_init(&created->reclaim_mutex, NULL);
+    pthread_cond_init(&created->reclaim_signal, NULL);
+    pthread_mutex_init(&created->deadline_mutex, NULL);
+
+    created->timers = calloc(MAX_TIMERS, sizeof(struct timer));
+    created->image_cache = calloc(JIT_MAX_IMAGES, sizeof(struct jit_image *));
+    if (created->timers == NULL || created->image_cache == NULL)
+    {
+        perror(RED"Error: No se pudo asignar memoria para la instancia"RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    created->random_state[0] = 0x330e;
+    created->random_state[1] = 0xabcd;
+    created->random_state[2] = 0x1234;
+    created->arrival_deadline = ULONG_MAX;
+    created->irq_event = -1;
+    created->max_lateness = LONG_MIN;
+    return created;
+}
+
+static void *start_instance_thread(void *argument)
+{
+    struct instance_start start = *(struct instance_start *)argument;
+    free(argument);
+    instance = start.instance;
+    return start.routine();
+}
+
+// Función para crear un hilo de la instancia actual
+void create_instance_thread(pthread_t *tid, void *(*routine)())
+{
+    struct instance_start *start = malloc(sizeof(struct instance_start));
+    start->instance = instance;
+    start->routine = routine;
+    if (pthread_create(tid, NULL, start_instance_thread, start) != 0)
+    {
+        fprintf(stderr, RED"Error: No se pudo crear un hilo de la instancia %d"RESET"\n", instance->index);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Función para sacar de la lista del hilo (worker) la instancia a la que antes le toca un
+// pulso, si ya le toca. Si no, deja en wait lo que falta para la primera
+static struct instance *take_due(struct pool_worker *worker, unsigned long long now, unsigned long long *wait)
+{
+    pthread_mutex_lock(&worker->lock);
+    int earliest = -1;
+    for (int i = 0; i < worker->count; i++)
+        if (earliest < 0 || worker->instances[i]->next_pulse_ns < worker->instances[earliest]->next_pulse_ns)
+            earliest = i;
+
+    struct instance *due = NULL;
+    if (earliest >= 0)
+    {
+        if (worker->instances[earliest]->next_pulse_ns <= now)
+        {
+            due = worker->instances[earliest];
+            worker->instances[earliest] = worker->instances[--worker->count];
+        }
+        else if (worker->instances[earliest]->next_pulse_ns - now < *wait)
+            *wait = worker->instances[earliest]->next_pulse_ns - now;
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return due;
+}
+
+// Hilo del pool: da el pulso de la instancia propia a la que le toque antes y, si ninguna
+// tiene pulso pendiente, roba una a la que ya le toque de otro hilo que esté ocupado con otra.
+// La instancia robada se queda en la lista del ladrón
+static void *run_pool_worker(void *argument)
+{
+    struct pool_worker *self = argument;
+
+    while (atomic_load(&instances_running) > 0)
+    {
+        unsigned long long now = now_ns(), wait = POOL_IDLE_NS;
+        struct instance *due = take_due(self, now, &wait);
+        for (int v = 1; due == NULL && v < pool_size; v++)
+        {
+            struct pool_worker *victim = &pool[(self->index + v) % pool_size];
+            if (!atomic_load(&victim->busy)) continue;
+            due = take_due(victim, now, &wait);
+            if (due != NULL)
+                due->steals++;
+        }
+        if (due == NULL)
+        {
+            struct timespec idle = {0, (long)wait};
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        atomic_store(&self->busy, 1);
+        instance = due;
+        clock_pulse();
+        if (!due->kernel_machine.unpaced)
+            due->next_pulse_ns += 1000000000ull / due->kernel_machine.clock_rate;
+        atomic_store(&self->busy, 0);
+
+        if (due->kernel_machine.pulse_limit > 0 && current_epoch() >= due->kernel_machine.pulse_limit)
+        {
+            display_instance_summary();
+            atomic_fetch_sub(&instances_running, 1);
+            continue;
+        }
+
+        pthread_mutex_lock(&self->lock);
+        self->instances[self->count++] = due;
+        pthread_mutex_unlock(&self->lock);
+    }
+    return NULL;
+}
+
+// Función para ejecutar los pulsos de count instancias ya arrancadas en pool_threads hilos
+// del host. Vuelve cuando todas han llegado a su límite de pulsos
+void run_instances(struct instance **instances, int count, int pool_threads)
+{
+    if (pool_threads > count)
+        pool_threads = count;
+    pool_size = pool_threads;
+    pool = calloc(pool_size, sizeof(struct pool_worker));
+    atomic_store(&instances_running, count);
+
+    unsigned long long start = now_ns();
+    for (int w = 0; w < pool_size; w++)
+    {
+        pthread_mutex_init(&pool[w].lock, NULL);
+        pool[w].instances = malloc(count * sizeof(struct instance *));
+        pool[w].index = w;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        struct pool_worker *worker = &pool[i % pool_size];
+        instances[i]->started_ns = instances[i]->next_pulse_ns = start;
+        worker->instances[worker->count++] = instances[i];
+    }
+
+    DEBUG_PRINT(MAGENTA"Kernel:"RESET" %d instancias en %d hilos del host\n", count, pool_size);
+    pthread_t *tids = malloc(pool_size * sizeof(pthread_t));
+    for (int w = 0; w < pool_size; w++)
+        pthread_create(&tids[w], NULL, run_pool_worker, &pool[w]);
+    for (int w = 0; w < pool_size; w++)
+        pthread_join(tids[w], NULL);
+
+    unsigned long steals = 0;
+    for (int i = 0; i < count; i++)
+        steals += instances[i]->steals;
+    printf("Pool: %d instancias en %d hilos, %.3f s, %lu robos\n", count, pool_size, (now_ns() - start) / 1e9, steals);
+    free(tids);
+}
+
+// Imprime el resumen de la instancia actual al llegar a su límite de pulsos
+void display_instance_summary()
+{
+    unsigned long migrations = instance->migrations[0] + instance->migrations[1] + instance->migrations[2];
+    double seconds = instance->started_ns ? (now_ns() - instance->started_ns) / 1e9 : 0.0;
+    printf("Instancia %d: %lu pulsos en %.3f s, %lu instrucciones retiradas, %lu procesos admitidos, "
+           "%lu migraciones, %lu recargas de TLB, %lu robos, %.4f J\n",
+           instance->index, current_epoch(), seconds, instance->instructions_retired, instance->arrivals_admitted,
+           migrations, instance->tlb_refills, instance->steals, machine_energy());
+    display_zpool_statistics();
+}
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include "kernel_simulator.h"
+#include "shared.h"
+#include "interrupts.h"
+#include "profiler.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define YELLOW "\033[33m"
+
+// Pulsos del reloj. Vive en memoria compartida porque los procesos trabajadores leen el
+// epoch al encolar peticiones de E/S. El temporizador y el reclamador duermen en un futex
+// sobre tick_word
+struct tick_source {
+    _Atomic unsigned long epoch;
+    _Atomic unsigned tick_word;   // Cambia en cada pulso; 32 bits, como pide el futex
+    _Atomic int sleepers;         // Sólo se llama al futex si hay alguien dormido
+};
+
+// Cola de eventos acotada con varios productores y consumidores, sin cerrojos: cada hueco
+// lleva un número de secuencia que dice si lo puede ocupar el productor de esta vuelta o si
+// ya lo puede vaciar el consumidor
+struct irq_slot {
+    _Atomic unsigned long sequence;
+    int vector;
+};
+
+// Función para preparar el controlador; antes de crear los procesos trabajadores
+void initialize_interrupts()
+{
+    instance->ticks = shared_alloc(sizeof(struct tick_source));
+    instance->irq_queue = malloc(IRQ_QUEUE_SIZE * sizeof(struct irq_slot));
+    instance->irq_raised = calloc(IRQ_VECTORS, sizeof(_Atomic unsigned long));
+    instance->irq_handled = calloc(IRQ_VECTORS, sizeof(_Atomic unsigned long));
+    instance->irq_lost = calloc(IRQ_VECTORS, sizeof(_Atomic unsigned long));
+    instance->irq_handlers = calloc(IRQ_VECTORS, sizeof(void (*)()));
+    for (unsigned long i = 0; i < IRQ_QUEUE_SIZE; i++)
+        atomic_init(&instance->irq_queue[i].sequence, i);
+}
+
+// Asociar un manejador a un vector
+void register_irq_handler(enum irq_vector vector, void handler())
+{
+    instance->irq_handlers[vector] = handler;
+}
+
+// Encolar una interrupción. No bloquea nunca: con la cola llena el evento se pierde y se
+// cuenta. Devuelve 0 si se ha perdido
+int raise_irq(enum irq_vector vector)
+{
+    unsigned long position = atomic_load_explicit(&instance->enqueue_position, memory_order_relaxed);
+    while (1)
+    {
+        struct irq_slot *slot = &instance->irq_queue[position & (IRQ_QUEUE_SIZE - 1)];
+        unsigned long sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        long difference = (long)(sequence - position);
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&instance->enqueue_position, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                slot->vector = vector;
+                atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            atomic_fetch_add_explicit(&instance->irq_lost[vector], 1, memory_order_relaxed);
+            return 0;
+        }
+        else
+            position = atomic_load_explicit(&instance->enqueue_position, memory_order_relaxed);
+    }
+
+    atomic_fetch_add_explicit(&instance->irq_raised[vector], 1, memory_order_relaxed);
+    uint64_t one = 1;
+    if (write(instance->irq_event, &one, sizeof(one)) != sizeof(one))
+        perror(RED"Interrupts: No se pudo avisar a los manejadores"RESET);
+    return 1;
+}
+
+// Sacar el evento más antiguo, o -1 si su productor aún no ha terminado de publicarlo
+static int take_irq()
+{
+    unsigned long position = atomic_load_explicit(&instance->dequeue_position, memory_order_relaxed);
+    while (1)
+    {
+        struct irq_slot *slot = &instance->irq_queue[position & (IRQ_QUEUE_SIZE - 1)];
+        unsigned long sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        long difference = (long)(sequence - (position + 1));
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&instance->dequeue_position, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                int vector = slot->vector;
+                atomic_store_explicit(&slot->sequence, position + IRQ_QUEUE_SIZE, memory_order_release);
+                return vector;
+            }
+        }
+        else if (difference < 0)
+            return -1;
+        else
+            position = atomic_load_explicit(&instance->dequeue_position, memory_order_relaxed);
+    }
+}
+
+// Hilo manejador: cada unidad del eventfd corresponde a un evento. Si el evento de cabeza está
+// a medio publicar se espera a su productor, que ya ha reservado el hueco
+static void *run_irq_handler()
+{
+    uint64_t count;
+    profile_thread("irq");
+    while (1)
+    {
+        if (read(instance->irq_event, &count, sizeof(count)) != sizeof(count)) continue;
+
+        int vector;
+        while ((vector = take_irq()) < 0)
+            sched_yield();
+        if (instance->irq_handlers[vector] != NULL)
+            instance->irq_handlers[vector]();
+        atomic_fetch_add_explicit(&instance->irq_handled[vector], 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+// Función para crear el eventfd y lanzar los hilos manejadores
+void start_interrupts()
+{
+    instance->irq_event = eventfd(0, EFD_SEMAPHORE);
+    if (instance->irq_event < 0)
+    {
+        perror(RED"Interrupts: No se pudo crear el eventfd"RESET);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < instance->kernel_machine.irq_handlers; i++)
+    {
+        pthread_t tid;
+        create_instance_thread(&tid, run_irq_handler);
+        pthread_detach(tid);
+    }
+}
+
+// Publicar un pulso del reloj. Sólo hay llamada al sistema si hay algún hilo dormido
+void publish_tick()
+{
+    atomic_fetch_add(&instance->ticks->epoch, 1);
+    atomic_fetch_add(&instance->ticks->tick_word, 1);
+    if (atomic_load(&instance->ticks->sleepers) > 0)
+        syscall(SYS_futex, &instance->ticks->tick_word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// Pulsos publicados desde el arranque
+unsigned long current_epoch()
+{
+    return atomic_load(&instance->ticks->epoch);
+}
+
+// Esperar a que el epoch pase de seen y devolverlo. Si el que espera va retrasado vuelve en
+// seguida con todos los pulsos pendientes, así que no se pierde ninguno
+unsigned long wait_for_tick(unsigned long seen)
+{
+    while (1)
+    {
+        unsigned word = atomic_load(&instance->ticks->tick_word);
+        unsigned long epoch = atomic_load(&instance->ticks->epoch);
+        if (epoch != seen) return epoch;
+
+        atomic_fetch_add(&instance->ticks->sleepers, 1);
+        if (atomic_load(&instance->ticks->epoch) == seen)
+            syscall(SYS_futex, &instance->ticks->tick_word, FUTEX_WAIT_PRIVATE, word, NULL, NULL, 0);
+        atomic_fetch_sub(&instance->ticks->sleepers, 1);
+    }
+}
+
+#ifdef DEBUG
+static const char *irq_names[IRQ_VECTORS] = {"sched", "gen", "arrivals", "io", "completion", "ckpt", "dump"};
+
+// Función para imprimir los contadores de los vectores
+void display_irq_statistics()
+{
+    printf("Interrupciones:");
+    for (int v = 0; v < IRQ_VECTORS; v++)
+    {
+        unsigned long raised = atomic_load(&instance->irq_raised[v]), handled = atomic_load(&instance->irq_handled[v]);
+        if (raised == 0 && atomic_load(&instance->irq_lost[v]) == 0) continue;
+        printf(" %s %lu (%lu pendientes, %lu perdidas);", irq_names[v], raised, raised - handled, atomic_load(&instance->irq_lost[v]));
+    }
+    printf("\n");
+}
+#endif
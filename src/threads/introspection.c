@@ -0,0 +1,339 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "kernel_simulator.h"
+#include "introspection.h"
+#include "interrupts.h"
+#include "io.h"
+#include "profiler.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define BLUE "\033[34m"
+
+#define RATE_WINDOW_NS 250000000ull // Ventana mínima para medir los pulsos por segundo
+
+// Hilo simulado tal y como lo ha visto la última pasada del planificador
+struct thread_view {
+    int pid;            // -1 si el hilo está libre
+    int quantum_cycles;
+    address pc;
+};
+
+struct process_view {
+    int pid;
+    enum state state;
+    int thread;         // Posición del hilo en el arena, -1 si espera en la cola de listos
+    int priority;
+    int quantum_ms;
+    address pc;
+    unsigned migrations;
+    unsigned tlb_refills;
+};
+
+// Instantánea de la máquina. La escribe el planificador al final de cada pasada y la leen
+// los clientes sin cerrojos: si el número de secuencia ha cambiado mientras se copiaba, se
+// vuelve a copiar. Ni el reloj ni el planificador esperan nunca a un cliente
+struct snapshot {
+    unsigned long epoch;
+    double tick_rate;                   // Pulsos por segundo del host
+    unsigned long instructions_retired;
+    unsigned long arrivals_admitted;
+    unsigned long arrivals_shed;
+    unsigned busy_threads;
+    unsigned ready_count;
+    unsigned blocked_count;
+    unsigned held_count;
+    unsigned frames_allocated;
+    unsigned frame_high_water;
+    unsigned process_count;             // Procesos de processes; los de la cola pueden no caber
+    struct process_view processes[INTROSPECTION_MAX_PROCESSES];
+    struct thread_view threads[];       // Uno por hilo del arena
+};
+
+struct introspection {
+    _Atomic unsigned sequence;     // Impar mientras el planificador escribe la instantánea
+    struct snapshot *snapshot;
+    size_t snapshot_size;
+    unsigned long rate_epoch;      // Inicio de la ventana de medida del ritmo
+    unsigned long long rate_ns;
+    int listen_fd;
+};
+
+// Conexión de un cliente con su orden a medio leer
+struct client {
+    int fd;
+    size_t length;
+    char line[INTROSPECTION_LINE];
+};
+
+// Instante del host en nanosegundos
+static unsigned long long now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// Función para publicar la instantánea. Se llama con scheduler_mutex tomado, así que sólo hay
+// un escritor; los contadores de otros hilos se leen sin sus cerrojos
+void publish_introspection()
+{
+    struct introspection *view = instance->introspection;
+    if (view == NULL) return;
+    struct snapshot *snapshot = view->snapshot;
+    unsigned long epoch = current_epoch();
+    unsigned long long now = now_ns();
+
+    atomic_fetch_add_explicit(&view->sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    snapshot->epoch = epoch;
+    if (now - view->rate_ns >= RATE_WINDOW_NS)
+    {
+        if (view->rate_ns != 0)
+            snapshot->tick_rate = (epoch - view->rate_epoch) * 1e9 / (now - view->rate_ns);
+        view->rate_epoch = epoch;
+        view->rate_ns = now;
+    }
+    snapshot->instructions_retired = __atomic_load_n(&instance->instructions_retired, __ATOMIC_RELAXED);
+    snapshot->arrivals_admitted = __atomic_load_n(&instance->arrivals_admitted, __ATOMIC_RELAXED);
+    snapshot->arrivals_shed = __atomic_load_n(&instance->arrivals_shed, __ATOMIC_RELAXED);
+    snapshot->held_count = __atomic_load_n(&instance->held_count, __ATOMIC_RELAXED);
+    snapshot->frames_allocated = __atomic_load_n(&instance->allocator->frames_allocated, __ATOMIC_RELAXED);
+    snapshot->frame_high_water = __atomic_load_n(&instance->allocator->frame_high_water, __ATOMIC_RELAXED);
+    snapshot->blocked_count = 0;
+    for (int d = 0; d < instance->io->device_count; d++)
+        snapshot->blocked_count += __atomic_load_n(&instance->io->devices[d].queue_length, __ATOMIC_RELAXED);
+
+    // Primero los procesos en ejecución y después la cola de listos en orden
+    snapshot->busy_threads = snapshot->process_count = 0;
+    for (int t = 0; t < instance->kernel_machine.thread_count; t++)
+    {
+        struct HT *thread = &instance->kernel_machine.threads[t];
+        struct PCB *process = thread->process;
+        snapshot->threads[t].pid = process != NULL ? process->pid : -1;
+        snapshot->threads[t].quantum_cycles = thread->quantum_cycles;
+        snapshot->threads[t].pc = thread->pc;
+        if (process == NULL) continue;
+
+        snapshot->busy_threads++;
+        if (snapshot->process_count < INTROSPECTION_MAX_PROCESSES)
+        {
+            struct process_view *entry = &snapshot->processes[snapshot->process_count++];
+            entry->pid = process->pid;
+            entry->state = process->state;
+            entry->thread = t;
+            entry->priority = process->priority;
+            entry->quantum_ms = process->quantum_ms;
+            entry->pc = thread->pc;
+            entry->migrations = process->migrations;
+            entry->tlb_refills = process->tlb_refills;
+        }
+    }
+    snapshot->ready_count = 0;
+    for (struct PCB *process = instance->ready_queue.head; process != NULL; process = process->next)
+    {
+        snapshot->ready_count++;
+        if (snapshot->process_count == INTROSPECTION_MAX_PROCESSES) continue;
+
+        struct process_view *entry = &snapshot->processes[snapshot->process_count++];
+        entry->pid = process->pid;
+        entry->state = process->state;
+        entry->thread = -1;
+        entry->priority = process->priority;
+        entry->quantum_ms = process->quantum_ms;
+        entry->pc = process->pc;
+        entry->migrations = process->migrations;
+        entry->tlb_refills = process->tlb_refills;
+    }
+
+    atomic_store_explicit(&view->sequence, atomic_load_explicit(&view->sequence, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+// Copiar la última instantánea completa en copy
+static void read_snapshot(struct introspection *view, struct snapshot *copy)
+{
+    while (1)
+    {
+        unsigned before = atomic_load_explicit(&view->sequence, memory_order_acquire);
+        if (before & 1)
+        {
+            sched_yield();
+            continue;
+        }
+        memcpy(copy, view->snapshot, view->snapshot_size);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&view->sequence, memory_order_relaxed) == before)
+            return;
+    }
+}
+
+// Escribir en out la respuesta a una orden. Todas las respuestas acaban con una línea vacía
+static void answer(FILE *out, const char *command, struct snapshot *snapshot)
+{
+    static const char *state_names[] = {"nuevo", "listo", "ejecucion", "bloqueado"};
+
+    if (strcmp(command, "summary") == 0)
+    {
+        fprintf(out, "pulso %lu\n", snapshot->epoch);
+        fprintf(out, "ritmo %.1f\n", snapshot->tick_rate);
+        fprintf(out, "instrucciones %lu\n", snapshot->instructions_retired);
+        fprintf(out, "hilos %u %d\n", snapshot->busy_threads, instance->kernel_machine.thread_count);
+        fprintf(out, "listos %u\n", snapshot->ready_count);
+        fprintf(out, "bloqueados %u\n", snapshot->blocked_count);
+        fprintf(out, "retenidos %u\n", snapshot->held_count);
+        fprintf(out, "admitidos %lu\n", snapshot->arrivals_admitted);
+        fprintf(out, "descartados %lu\n", snapshot->arrivals_shed);
+        fprintf(out, "frames %u %u %u\n", snapshot->frames_allocated, snapshot->frame_high_water, instance->frame_count);
+    }
+    else if (strcmp(command, "threads") == 0)
+    {
+        for (int t = 0; t < instance->kernel_machine.thread_count; t++)
+        {
+            struct HT *thread = &instance->kernel_machine.threads[t];
+            struct thread_view *entry = &snapshot->threads[t];
+            fprintf(out, "%d %d %d %d %d %u\n", thread->cpu, thread->core, thread->id,
+                    entry->pid, entry->quantum_cycles, entry->pc);
+        }
+    }
+    else if (strcmp(command, "processes") == 0)
+    {
+        for (unsigned p = 0; p < snapshot->process_count; p++)
+        {
+            struct process_view *entry = &snapshot->processes[p];
+            fprintf(out, "%d %s %d %d %d %u %u %u\n", entry->pid, state_names[entry->state], entry->thread,
+                    entry->priority, entry->quantum_ms, entry->pc, entry->migrations, entry->tlb_refills);
+        }
+    }
+    else
+    {
+        fprintf(out, "error orden desconocida: %s\n", command);
+        fprintf(out, "ordenes: summary threads processes\n");
+    }
+    fprintf(out, "\n");
+}
+
+// Función para leer lo que ha mandado un cliente y contestar a sus órdenes completas, una
+// por línea. Devuelve 0 si hay que cerrar la conexión
+static int serve_client(struct introspection *view, struct client *client, struct snapshot *copy)
+{
+    ssize_t received = recv(client->fd, client->line + client->length, sizeof(client->line) - 1 - client->length, 0);
+    if (received <= 0) return 0;
+    client->length += received;
+    client->line[client->length] = '\0';
+
+    char *newline;
+    while ((newline = strchr(client->line, '\n')) != NULL)
+    {
+        *newline = '\0';
+        if (newline > client->line && newline[-1] == '\r')
+            newline[-1] = '\0';
+
+        char *text;
+        size_t size;
+        FILE *out = open_memstream(&text, &size);
+        read_snapshot(view, copy);
+        answer(out, client->line, copy);
+        fclose(out);
+        ssize_t sent = send(client->fd, text, size, MSG_NOSIGNAL);
+        free(text);
+        if (sent != (ssize_t)size) return 0;
+
+        client->length -= newline + 1 - client->line;
+        memmove(client->line, newline + 1, client->length + 1);
+    }
+    return client->length < sizeof(client->line) - 1; // Una orden demasiado larga cierra la conexión
+}
+
+// Hilo del servidor: atiende a la vez hasta INTROSPECTION_MAX_CLIENTS conexiones
+static void *run_introspection()
+{
+    struct introspection *view = instance->introspection;
+    struct snapshot *copy = malloc(view->snapshot_size);
+    struct client clients[INTROSPECTION_MAX_CLIENTS];
+    struct pollfd fds[INTROSPECTION_MAX_CLIENTS + 1];
+    int count = 0;
+
+    profile_thread("introspection");
+    while (1)
+    {
+        fds[0].fd = view->listen_fd;
+        fds[0].events = POLLIN;
+        for (int c = 0; c < count; c++)
+        {
+            fds[c + 1].fd = clients[c].fd;
+            fds[c + 1].events = POLLIN;
+        }
+        if (poll(fds, count + 1, -1) < 0) continue;
+
+        // De atrás hacia delante: el último cliente ocupa el hueco de uno que se cierra
+        for (int c = count - 1; c >= 0; c--)
+            if (fds[c + 1].revents != 0 && !serve_client(view, &clients[c], copy))
+            {
+                close(clients[c].fd);
+                clients[c] = clients[--count];
+            }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(view->listen_fd, NULL, NULL);
+            if (fd < 0) continue;
+            if (count == INTROSPECTION_MAX_CLIENTS)
+            {
+                close(fd);
+                continue;
+            }
+            clients[count].fd = fd;
+            clients[count].length = 0;
+            count++;
+        }
+    }
+    return NULL;
+}
+
+// Función para abrir el socket de --socket y lanzar el servidor. Con --instances todas las
+// instancias escuchan en la ruta seguida de su número, que es su línea en el fichero
+void start_introspection()
+{
+    if (instance->kernel_machine.socket_path == NULL) return;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    int length = instance->kernel_machine.instances_path != NULL ?
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s.%d", instance->kernel_machine.socket_path, instance->index) :
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", instance->kernel_machine.socket_path);
+    if (length >= (int)sizeof(address.sun_path))
+    {
+        fprintf(stderr, RED"Error: La ruta del socket es demasiado larga: %s"RESET"\n", instance->kernel_machine.socket_path);
+        exit(EXIT_FAILURE);
+    }
+
+    struct introspection *view = calloc(1, sizeof(struct introspection));
+    view->snapshot_size = sizeof(struct snapshot) + instance->kernel_machine.thread_count * sizeof(struct thread_view);
+    view->snapshot = calloc(1, view->snapshot_size);
+    view->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(address.sun_path); // El socket de una ejecución anterior
+    if (view->listen_fd < 0 || bind(view->listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(view->listen_fd, INTROSPECTION_MAX_CLIENTS) < 0)
+    {
+        perror(RED"Error: No se pudo abrir el socket de introspección"RESET);
+        exit(EXIT_FAILURE);
+    }
+    instance->introspection = view;
+    DEBUG_PRINT(BLUE"Introspección:"RESET" Escuchando en %s\n", address.sun_path);
+
+    pthread_t tid;
+    create_instance_thread(&tid, run_introspection);
+    pthread_detach(tid);
+}
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include "kernel_simulator.h"
+#include "scheduler.h"
+#include "shared.h"
+#include "interrupts.h"
+#include "io.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define BLUE "\033[34m"
+
+// Pulsos que tarda en atenderse una petición, como mínimo uno
+static unsigned long service_pulses(struct io_device *device, unsigned bytes)
+{
+    double seconds = device->config.latency_us / 1e6 + bytes / (device->config.bandwidth_mbps * 1e6);
+    unsigned long pulses = (unsigned long)ceil(seconds * instance->kernel_machine.clock_rate);
+    return pulses > 0 ? pulses : 1;
+}
+
+// Función para crear los dispositivos configurados con --device; sin ninguno, un disco y una red
+void initialize_io()
+{
+    instance->io = shared_alloc(sizeof(struct io_subsystem));
+    initialize_shared_mutex(&instance->io->lock);
+    instance->io->next_completion = ULONG_MAX;
+
+    if (instance->kernel_machine.io_device_count == 0)
+    {
+        struct io_device_config disk = {"disk", 5000.0, 200.0};
+        struct io_device_config nic = {"nic", 50.0, 1250.0};
+        instance->kernel_machine.io_devices[0] = disk;
+        instance->kernel_machine.io_devices[1] = nic;
+        instance->kernel_machine.io_device_count = 2;
+    }
+    instance->io->device_count = instance->kernel_machine.io_device_count;
+    for (int d = 0; d < instance->io->device_count; d++)
+    {
+        instance->io->devices[d].config = instance->kernel_machine.io_devices[d];
+        DEBUG_PRINT(BLUE"E/S:"RESET" Dispositivo %d (%s): %.0f us de latencia, %.0f MB/s\n", d,
+                    instance->io->devices[d].config.name, instance->io->devices[d].config.latency_us, instance->io->devices[d].config.bandwidth_mbps);
+    }
+}
+
+// Función para adelantar el próximo fin de petición que vigila el temporizador
+static void lower_next_completion(unsigned long pulse)
+{
+    unsigned long current = __atomic_load_n(&instance->io->next_completion, __ATOMIC_SEQ_CST);
+    while (pulse < current &&
+           !__atomic_compare_exchange_n(&instance->io->next_completion, &current, pulse, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+}
+
+// Encolar la petición de un proceso que se acaba de bloquear. Los números de dispositivo que
+// no existen se reparten entre los que hay
+void io_submit(struct PCB *process)
+{
+    pthread_mutex_lock(&instance->io->lock);
+    process->io_device %= instance->io->device_count;
+    process->state = BLOCKED;
+    process->next = NULL;
+
+    struct io_device *device = &instance->io->devices[process->io_device];
+    if (device->head == NULL)
+    {
+        unsigned long service = service_pulses(device, process->io_bytes);
+        device->head = process;
+        device->done_pulse = current_epoch() + service;
+        device->busy_pulses += service;
+        lower_next_completion(device->done_pulse);
+    }
+    else
+        device->tail->next = process;
+    device->tail = process;
+
+    device->requests++;
+    device->bytes += process->io_bytes;
+    if (++device->queue_length > device->max_queue_length)
+        device->max_queue_length = device->queue_length;
+    pthread_mutex_unlock(&instance->io->lock);
+}
+
+// Función del temporizador: reclama el fin de petición vencido en el pulso epoch. Sólo la
+// primera llamada tras vencer devuelve 1; el manejador vuelve a armar el siguiente
+int claim_io_completion(unsigned long epoch)
+{
+    unsigned long deadline = __atomic_load_n(&instance->io->next_completion, __ATOMIC_SEQ_CST);
+    return deadline <= epoch &&
+           __atomic_compare_exchange_n(&instance->io->next_completion, &deadline, ULONG_MAX, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+// Devolver una reclamación cuya interrupción se ha perdido; se reintenta en el siguiente pulso
+void release_io_completion(unsigned long epoch)
+{
+    lower_next_completion(epoch);
+}
+
+// Manejador de IRQ_IO: retira las peticiones terminadas y devuelve sus procesos a la cola de
+// listos. Cada petición empieza cuando acaba la anterior, aunque el manejador llegue tarde
+void io_complete()
+{
+    struct PCB *completed = NULL, **last = &completed;
+    unsigned long epoch = current_epoch(), next = ULONG_MAX;
+
+    pthread_mutex_lock(&instance->io->lock);
+    for (int d = 0; d < instance->io->device_count; d++)
+    {
+        struct io_device *device = &instance->io->devices[d];
+        while (device->head != NULL && epoch >= device->done_pulse)
+        {
+            struct PCB *process = device->head;
+            device->head = process->next;
+            if (device->head == NULL)
+                device->tail = NULL;
+            else
+            {
+                unsigned long service = service_pulses(device, device->head->io_bytes);
+                device->done_pulse += service;
+                device->busy_pulses += service;
+            }
+            device->queue_length--;
+
+            process->next = NULL;
+            *last = process;
+            last = &process->next;
+        }
+        if (device->head != NULL && device->done_pulse < next)
+            next = device->done_pulse;
+    }
+    lower_next_completion(next);
+    pthread_mutex_unlock(&instance->io->lock);
+
+    if (completed == NULL) return;
+
+    // El planificador se toma fuera del cerrojo de la E/S: los hilos que encolan peticiones
+    // no tienen que esperar a una pasada del planificador
+    pthread_mutex_lock(&instance->scheduler_mutex);
+    while (completed != NULL)
+    {
+        struct PCB *process = completed;
+        completed = process->next;
+        wake_process(process);
+    }
+    pthread_mutex_unlock(&instance->scheduler_mutex);
+}
+
+#ifdef DEBUG
+// Función para imprimir el uso de los dispositivos
+void display_io_statistics()
+{
+    unsigned long epoch = current_epoch();
+    pthread_mutex_lock(&instance->io->lock);
+    for (int d = 0; d < instance->io->device_count; d++)
+    {
+        struct io_device *device = &instance->io->devices[d];
+        if (device->requests == 0) continue;
+        printf("E/S %s: %lu peticiones, %lu KB, ocupado %.1f%%, cola %u (máx. %u)\n", device->config.name,
+               device->requests, device->bytes >> 10, epoch ? 100.0 * device->busy_pulses / epoch : 0.0,
+               device->queue_length, device->max_queue_length);
+    }
+    pthread_mutex_unlock(&instance->io->lock);
+}
+#endif
@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include "kernel_simulator.h"
+#include "jit.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define CYAN "\033[36m"
+
+// Búfer de emisión de código máquina
+struct emitter
+{
+    unsigned char *code;
+    size_t size;
+    size_t capacity;
+};
+
+static void emit8(struct emitter *e, unsigned char byte)
+{
+    if (e->size == e->capacity)
+    {
+        e->capacity *= 2;
+        e->code = realloc(e->code, e->capacity);
+    }
+    e->code[e->size++] = byte;
+}
+
+static void emit32(struct emitter *e, unsigned value)
+{
+    for (int i = 0; i < 4; i++)
+        emit8(e, (value >> (8 * i)) & 0xFF);
+}
+
+static void emit64(struct emitter *e, unsigned long value)
+{
+    for (int i = 0; i < 8; i++)
+        emit8(e, (value >> (8 * i)) & 0xFF);
+}
+
+// Salida del bloque: guardar el presupuesto restante en el contexto y devolver el pc
+static void emit_exit(struct emitter *e, address pc)
+{
+    emit8(e, 0x89); emit8(e, 0x91); emit32(e, offsetof(struct jit_context, remaining)); // mov [rcx+remaining], edx
+    emit8(e, 0xB8); emit32(e, pc);                                                     // mov eax, pc
+    emit8(e, 0xC3);                                                                    // ret
+}
+
+// Dejar en rax el puntero del host a la página de la ranura slot; si la ranura está vacía se
+// llama a jit_translate_miss, que pasa por la MMU y la TLB del hilo y rellena la ranura
+static void emit_page_base(struct emitter *e, unsigned slot, address virtual_address)
+{
+    emit8(e, 0x48); emit8(e, 0x8B); emit8(e, 0x86); emit32(e, slot * sizeof(word *)); // mov rax, [rsi+slot*8]
+    emit8(e, 0x48); emit8(e, 0x85); emit8(e, 0xC0);                                   // test rax, rax
+    emit8(e, 0x75); emit8(e, 41);                                                     // jnz acierto
+
+    emit8(e, 0x57); emit8(e, 0x56); emit8(e, 0x52); emit8(e, 0x51);   // push rdi, rsi, rdx, rcx
+    emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xEC); emit8(e, 0x08);   // sub rsp, 8 (pila alineada a 16)
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xCF);                   // mov rdi, rcx
+    emit8(e, 0xBE); emit32(e, slot);                                  // mov esi, slot
+    emit8(e, 0xBA); emit32(e, virtual_address);                       // mov edx, dirección virtual
+    emit8(e, 0x48); emit8(e, 0xB8); emit64(e, (unsigned long)jit_translate_miss); // mov rax, jit_translate_miss
+    emit8(e, 0xFF); emit8(e, 0xD0);                                   // call rax
+    emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xC4); emit8(e, 0x08);   // add rsp, 8
+    emit8(e, 0x59); emit8(e, 0x5A); emit8(e, 0x5E); emit8(e, 0x5F);   // pop rcx, rdx, rsi, rdi
+}
+
+// Traducir el segmento .text a x86-64. Cada instrucción es un punto de entrada con el mismo
+// convenio que jit_entry: rdi registros del hilo, rsi ranuras de páginas, edx presupuesto de
+// instrucciones y rcx el contexto. Devuelve NULL si la imagen no se puede compilar
+static struct jit_image *jit_compile(const word *text, unsigned text_words)
+{
+#if defined(__x86_64__)
+    struct jit_image *image = calloc(1, sizeof(struct jit_image));
+    image->text = malloc(text_words * sizeof(word));
+    memcpy(image->text, text, text_words * sizeof(word));
+    image->text_words = text_words;
+    image->entry = malloc(text_words * sizeof(unsigned));
+
+    // Una ranura por cada página distinta a la que acceden las cargas y los almacenamientos
+    int *page_slot = malloc(instance->virtual_pages * sizeof(int));
+    memset(page_slot, 0xFF, instance->virtual_pages * sizeof(int));
+
+    struct emitter e = {malloc(4096), 0, 4096};
+    unsigned stride = instance->kernel_machine.lanes * sizeof(int);
+
+    // Saltos hacia delante: su desplazamiento se completa cuando se conocen todas las entradas
+    unsigned *patch_at = malloc(text_words * sizeof(unsigned));
+    address *patch_target = malloc(text_words * sizeof(address));
+    unsigned patch_count = 0;
+
+    for (address pc = 0; pc < text_words; pc++)
+    {
+        word instr = text[pc];
+        address addr = INSTR_ADDR(instr);
+        image->entry[pc] = e.size;
+
+        // Las instrucciones que no se traducen, y los almacenamientos sobre el propio código,
+        // devuelven el control al intérprete sin gastar presupuesto. LDR y STR calculan la
+        // dirección en ejecución y también se quedan en el intérprete
+        int op = INSTR_OP(instr);
+        int memory = op == LOAD_OP || op == STORE_OP;
+        int native = memory || op == ADD_OP || op == SUB_OP || op == LI_OP || op == ADDI_OP ||
+                     op == BEQ_OP || op == BNE_OP || op == BLT_OP || op == JMP_OP;
+        if (!native || (op == STORE_OP && addr < text_words) || (memory && (addr >> instance->page_bits) >= instance->virtual_pages))
+        {
+            if (op == STORE_OP && addr < text_words)
+            {
+                free(e.code);
+                free(page_slot);
+                free(patch_at);
+                free(patch_target);
+                free(image->entry);
+                image->entry = NULL; // Código automodificable: se queda en el intérprete
+                return image;
+            }
+            emit_exit(&e, pc);
+            continue;
+        }
+
+        // Comprobar el presupuesto: si se ha agotado, salir con el pc de esta instrucción.
+        // Los saltos caen en esta comprobación, así que un bucle no se queda con el hilo
+        emit8(&e, 0x85); emit8(&e, 0xD2);             // test edx, edx
+        emit8(&e, 0x75); emit8(&e, 12);               // jnz sigue
+        emit_exit(&e, pc);
+        emit8(&e, 0xFF); emit8(&e, 0xCA);             // dec edx
+
+        unsigned r1 = INSTR_R1(instr) * stride;
+        unsigned r2 = INSTR_R2(instr) * stride;
+        if (op == ADD_OP || op == SUB_OP)
+        {
+            emit8(&e, 0x8B); emit8(&e, 0x87); emit32(&e, r2);                       // mov eax, [rdi+r2]
+            emit8(&e, op == ADD_OP ? 0x03 : 0x2B); emit8(&e, 0x87);
+            emit32(&e, INSTR_R3(instr) * stride);                                    // add/sub eax, [rdi+r3]
+            emit8(&e, 0x89); emit8(&e, 0x87); emit32(&e, r1);                       // mov [rdi+r1], eax
+            continue;
+        }
+        if (op == LI_OP)
+        {
+            emit8(&e, 0xC7); emit8(&e, 0x87); emit32(&e, r1); emit32(&e, INSTR_SIMM24(instr)); // mov dword [rdi+r1], imm
+            continue;
+        }
+        if (op == ADDI_OP)
+        {
+            emit8(&e, 0x8B); emit8(&e, 0x87); emit32(&e, r2);                       // mov eax, [rdi+r2]
+            emit8(&e, 0x05); emit32(&e, INSTR_SIMM16(instr));                       // add eax, imm
+            emit8(&e, 0x89); emit8(&e, 0x87); emit32(&e, r1);                       // mov [rdi+r1], eax
+            continue;
+        }
+        if (op == BEQ_OP || op == BNE_OP || op == BLT_OP || op == JMP_OP)
+        {
+            address target = op == JMP_OP ? addr : INSTR_TARGET(instr);
+            unsigned char condition = op == BEQ_OP ? 0x84 : op == BNE_OP ? 0x85 : 0x8C; // je, jne, jl
+            if (op != JMP_OP)
+            {
+                emit8(&e, 0x8B); emit8(&e, 0x87); emit32(&e, r1);                   // mov eax, [rdi+r1]
+                emit8(&e, 0x3B); emit8(&e, 0x87); emit32(&e, r2);                   // cmp eax, [rdi+r2]
+            }
+            if (target >= text_words)
+            {
+                // Destino fuera del código traducido: salir con él si se toma el salto
+                if (op != JMP_OP)
+                {
+                    emit8(&e, (condition - 0x10) ^ 1); emit8(&e, 12);                 // jcc contrario, sigue
+                }
+                emit_exit(&e, target);
+                continue;
+            }
+            if (op == JMP_OP)
+                emit8(&e, 0xE9);                                                     // jmp rel32
+            else
+            {
+                emit8(&e, 0x0F); emit8(&e, condition);                               // jcc rel32
+            }
+            patch_at[patch_count] = e.size;
+            patch_target[patch_count++] = target;
+            emit32(&e, 0);
+            continue;
+        }
+
+        unsigned page = addr >> instance->page_bits;
+        if (page_slot[page] < 0)
+            page_slot[page] = image->slot_count++;
+        emit_page_base(&e, page_slot[page], addr);
+
+        unsigned offset = (addr & (instance->frame_size - 1)) * sizeof(word);
+        if (op == LOAD_OP)
+        {
+            emit8(&e, 0x8B); emit8(&e, 0x80); emit32(&e, offset);                  // mov eax, [rax+offset]
+            emit8(&e, 0x89); emit8(&e, 0x87); emit32(&e, r1);                      // mov [rdi+r1], eax
+        }
+        else
+        {
+            emit8(&e, 0x44); emit8(&e, 0x8B); emit8(&e, 0x87); emit32(&e, r1);    // mov r8d, [rdi+r1]
+            emit8(&e, 0x44); emit8(&e, 0x89); emit8(&e, 0x80); emit32(&e, offset); // mov [rax+offset], r8d
+        }
+    }
+    emit_exit(&e, text_words); // Fin del segmento sin HALT
+    free(page_slot);
+
+    // Los saltos entran por la comprobación de presupuesto de su destino
+    for (unsigned i = 0; i < patch_count; i++)
+    {
+        int displacement = (int)image->entry[patch_target[i]] - (int)(patch_at[i] + 4);
+        memcpy(e.code + patch_at[i], &displacement, sizeof(displacement));
+    }
+    free(patch_at);
+    free(patch_target);
+
+    // Copiar el código a memoria ejecutable; nunca es escribible y ejecutable a la vez
+    image->code_size = e.size;
+    image->code = mmap(NULL, e.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image->code == MAP_FAILED)
+    {
+        fprintf(stderr, RED"JIT: No se pudo reservar memoria para el código"RESET"\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(image->code, e.code, e.size);
+    mprotect(image->code, e.size, PROT_READ | PROT_EXEC);
+    free(e.code);
+
+    instance->jit_images++;
+    DEBUG_PRINT(CYAN"JIT:"RESET" Imagen de %u instrucciones compilada en %zu bytes\n", text_words, e.size);
+    return image;
+#else
+    return NULL;
+#endif
+}
+
+// Buscar una imagen en la caché por su segmento .text y compilarla si no está. Las imágenes
+// no se liberan nunca: con la caché llena el programa se queda en el intérprete
+struct jit_image *jit_lookup(const word *text, unsigned text_words)
+{
+    for (unsigned i = 0; i < instance->image_cache_count; i++)
+    {
+        struct jit_image *image = instance->image_cache[i];
+        if (image->text_words == text_words && memcmp(image->text, text, text_words * sizeof(word)) == 0)
+            return image->entry != NULL ? image : NULL;
+    }
+
+    if (instance->image_cache_count == JIT_MAX_IMAGES) return NULL;
+    struct jit_image *image = jit_compile(text, text_words);
+    if (image == NULL) return NULL;
+    instance->image_cache[instance->image_cache_count++] = image;
+    return image->entry != NULL ? image : NULL;
+}
+
+// Fallo en una ranura de páginas: traducir con la MMU del hilo y guardar la base de la página
+word *jit_translate_miss(struct jit_context *context, unsigned slot, address virtual_address)
+{
+    address physical_address = mmu_translate(context->thread, virtual_address);
+    word *base = instance->physical_memory + physical_address - (virtual_address & (instance->frame_size - 1));
+    context->thread->process->jit_slots[slot] = base;
+    return base;
+}
+
+// Ejecutar en código nativo como mucho budget instrucciones desde el pc del hilo. Se para al
+// agotar el presupuesto o al llegar a una instrucción que debe ejecutar el intérprete
+int jit_execute(struct HT *thread, int budget)
+{
+    struct jit_image *image = thread->process->jit;
+    if (thread->pc >= image->text_words) return 0;
+
+    struct jit_context context = {thread, budget};
+    jit_entry entry = (jit_entry)(image->code + image->entry[thread->pc]);
+    thread->pc = entry(&HT_REGISTER(thread, 0), thread->process->jit_slots, budget, &context);
+
+    int executed = budget - context.remaining;
+    instance->jit_instructions += executed;
+    return executed;
+}
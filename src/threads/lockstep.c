@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "kernel_simulator.h"
+#include "system_clock.h"
+#include "lockstep.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LOCKSTEP_X86
+#endif
+
+#define LOCKSTEP_WIDTH 8  // Carriles por bloque: un registro AVX2 de enteros de 32 bits
+#define NOP_INSTR 0xE0000000 // Código de operación sin usar para rellenar el último bloque
+
+// El estado del pulso en curso va en estructura de arrays en la instancia: un carril por cada
+// hilo que emite. Los núcleos de decodificación y ejecución se eligen según el procesador del
+// host y el tamaño de la memoria de la instancia
+
+// Función para decodificar los carriles uno a uno
+static void decode_scalar(int blocks)
+{
+    for (int i = 0; i < blocks * LOCKSTEP_WIDTH; i++)
+    {
+        instance->lane_op[i] = INSTR_OP(instance->lane_instr[i]);
+        instance->lane_r1[i] = INSTR_R1(instance->lane_instr[i]);
+        instance->lane_r2[i] = INSTR_R2(instance->lane_instr[i]);
+        instance->lane_r3[i] = INSTR_R3(instance->lane_instr[i]);
+        instance->lane_addr[i] = INSTR_ADDR(instance->lane_instr[i]);
+    }
+}
+
+// Función para sumar y restar en los carriles con ADD y SUB, uno a uno
+static void add_scalar(int blocks)
+{
+    int *regs = instance->kernel_machine.registers;
+    int stride = MACHINE_LANES;
+    for (int i = 0; i < blocks * LOCKSTEP_WIDTH; i++)
+    {
+        if (instance->lane_op[i] == ADD_OP)
+            regs[instance->lane_r1[i] * stride + instance->lane_column[i]] =
+                regs[instance->lane_r2[i] * stride + instance->lane_column[i]] + regs[instance->lane_r3[i] * stride + instance->lane_column[i]];
+        else if (instance->lane_op[i] == SUB_OP)
+            regs[instance->lane_r1[i] * stride + instance->lane_column[i]] =
+                regs[instance->lane_r2[i] * stride + instance->lane_column[i]] - regs[instance->lane_r3[i] * stride + instance->lane_column[i]];
+    }
+}
+
+// Función para leer de memoria las cargas ya traducidas, una a una
+static void load_scalar(int blocks)
+{
+    int *regs = instance->kernel_machine.registers;
+    int stride = MACHINE_LANES;
+    for (int i = 0; i < blocks * LOCKSTEP_WIDTH; i++)
+        if (instance->lane_op[i] == LOAD_OP)
+            regs[instance->lane_r1[i] * stride + instance->lane_column[i]] = instance->physical_memory[instance->lane_physical[i]];
+}
+
+#ifdef LOCKSTEP_X86
+// Decodificación de cuatro carriles por instrucción con SSE2
+static void decode_sse2(int blocks)
+{
+    const __m128i mask4 = _mm_set1_epi32(0xF);
+    const __m128i mask24 = _mm_set1_epi32(0xFFFFFF);
+    for (int i = 0; i < blocks * LOCKSTEP_WIDTH; i += 4)
+    {
+        __m128i instr = _mm_load_si128((__m128i *)(instance->lane_instr + i));
+        _mm_store_si128((__m128i *)(instance->lane_op + i), _mm_and_si128(_mm_srli_epi32(instr, 28), mask4));
+        _mm_store_si128((__m128i *)(instance->lane_r1 + i), _mm_and_si128(_mm_srli_epi32(instr, 24), mask4));
+        _mm_store_si128((__m128i *)(instance->lane_r2 + i), _mm_and_si128(_mm_srli_epi32(instr, 20), mask4));
+        _mm_store_si128((__m128i *)(instance->lane_r3 + i), _mm_and_si128(_mm_srli_epi32(instr, 16), mask4));
+        _mm_store_si128((__m128i *)(instance->lane_addr + i), _mm_srli_epi32(_mm_and_si128(instr, mask24), 2));
+    }
+}
+
+// Decodificación de ocho carriles por instrucción con AVX2
+__attribute__((target("avx2")))
+static void decode_avx2(int blocks)
+{
+    const __m256i mask4 = _mm256_set1_epi32(0xF);
+    const __m256i mask24 = _mm256_set1_epi32(0xFFFFFF);
+    for (int i = 0; i < blocks * LOCKSTEP_WIDTH; i += 8)
+    {
+        __m256i instr = _mm256_load_si256((__m256i *)(instance->lane_instr + i));
+        _mm256_store_si256((__m256i *)(instance->lane_op + i), _mm256_and_si256(_mm256_srli_epi32(instr, 28), mask4));
+        _mm256_store_si256((__m256i *)(instance->lane_r1 + i), _mm256_and_si256(_mm256_srli_epi32(instr, 24), mask4));
+        _mm256_store_si256((__m256i *)(instance->lane_r2 + i), _mm256_and_si256(_mm256_srli_epi32(instr, 20), mask4));
+        _mm256_store_si256((__m256i *)(instance->lane_r3 + i), _mm256_and_si256(_mm256_srli_epi32(instr, 16), mask4));
+        _mm256_store_si256((__m256i *)(instance->lane_addr + i), _mm256_srli_epi32(_mm256_and_si256(instr, mask24), 2));
+    }
+}
+
+// Suma y resta enmascaradas con AVX2: los operandos se recogen del banco de registros con
+// gathers y sólo se escribe el resultado de los carriles cuya instrucción es ADD o SUB
+__attribute__((target("avx2")))
+static void add_avx2(int blocks)
+{
+    int *regs = instance->kernel_machine.registers;
+    const __m256i add_op = _mm256_set1_epi32(ADD_OP);
+    const __m256i sub_op = _mm256_set1_epi32(SUB_OP);
+    const __m256i stride = _mm256_set1_epi32(MACHINE_LANES);
+    int sums[8] __attribute__((aligned(32)));
+
+    for (int i = 0; i < blocks * LOCKSTEP_WIDTH; i += 8)
+    {
+        __m256i op = _mm256_load_si256((__m256i *)(instance->lane_op + i));
+        __m256i is_sub = _mm256_cmpeq_epi32(op, sub_op);
+        __m256i is_add = _mm256_or_si256(_mm256_cmpeq_epi32(op, add_op), is_sub);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(is_add));
+        if (mask == 0) continue;
+
+        __m256i column = _mm256_load_si256((__m256i *)(instance->lane_column + i));
+        __m256i index2 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_load_si256((__m256i *)(instance->lane_r2 + i)), stride), column);
+        __m256i index3 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_load_si256((__m256i *)(instance->lane_r3 + i)), stride), column);
+        __m256i a = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), regs, index2, is_add, 4);
+        __m256i b = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), regs, index3, is_add, 4);
+        _mm256_store_si256((__m256i *)sums, _mm256_blendv_epi8(_mm256_add_epi32(a, b), _mm256_sub_epi32(a, b), is_sub));
+
+        // AVX2 no tiene scatter: el destino se escribe carril a carril
+        for (int j = 0; j < 8; j++)
+            if (mask & (1 << j))
+                regs[instance->lane_r1[i + j] * MACHINE_LANES + instance->lane_column[i + j]] = sums[j];
+    }
+}
+
+// Cargas con gather sobre la memoria física a partir de las direcciones ya traducidas
+__attribute__((target("avx2")))
+static void load_avx2(int blocks)
+{
+    int *regs = instance->kernel_machine.registers;
+    const __m256i load_op = _mm256_set1_epi32(LOAD_OP);
+    int values[8] __attribute__((aligned(32)));
+
+    for (int i = 0; i < blocks * LOCKSTEP_WIDTH; i += 8)
+    {
+        __m256i is_load = _mm256_cmpeq_epi32(_mm256_load_si256((__m256i *)(instance->lane_op + i)), load_op);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(is_load));
+        if (mask == 0) continue;
+
+        __m256i index = _mm256_load_si256((__m256i *)(instance->lane_physical + i));
+        __m256i data = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (int *)instance->physical_memory, index, is_load, 4);
+        _mm256_store_si256((__m256i *)values, data);
+
+        for (int j = 0; j < 8; j++)
+            if (mask & (1 << j))
+                regs[instance->lane_r1[i + j] * MACHINE_LANES + instance->lane_column[i + j]] = values[j];
+    }
+}
+#endif
+
+// Función para reservar los arrays de carriles y elegir los núcleos del host
+static void initialize_lockstep()
+{
+    size_t lanes = MACHINE_LANES;
+    instance->lane_thread = malloc(lanes * sizeof(struct HT *));
+    instance->lane_instr = aligned_alloc(32, lanes * sizeof(word));
+    instance->lane_op = aligned_alloc(32, lanes * sizeof(int));
+    instance->lane_r1 = aligned_alloc(32, lanes * sizeof(int));
+    instance->lane_r2 = aligned_alloc(32, lanes * sizeof(int));
+    instance->lane_r3 = aligned_alloc(32, lanes * sizeof(int));
+    instance->lane_addr = aligned_alloc(32, lanes * sizeof(address));
+    instance->lane_column = aligned_alloc(32, lanes * sizeof(int));
+    instance->lane_physical = aligned_alloc(32, lanes * sizeof(address));
+
+    instance->decode_kernel = decode_scalar;
+    instance->add_kernel = add_scalar;
+    instance->load_kernel = load_scalar;
+#ifdef LOCKSTEP_X86
+    instance->decode_kernel = decode_sse2;
+    if (__builtin_cpu_supports("avx2"))
+    {
+        instance->decode_kernel = decode_avx2;
+        instance->add_kernel = add_avx2;
+        // Los índices del gather son de 32 bits con signo
+        if (((unsigned long)instance->frame_count << instance->page_bits) <= 0x7FFFFFFF)
+            instance->load_kernel = load_avx2;
+    }
+#endif
+}
+
+// Función para apuntar la instrucción de un hilo en el pulso en curso
+void lockstep_add(struct HT *thread)
+{
+    if (instance->lane_thread == NULL)
+        initialize_lockstep();
+
+    instance->lane_thread[instance->lane_count] = thread;
+    instance->lane_column[instance->lane_count] = thread->lane;
+    instance->lane_instr[instance->lane_count] = mmu_fetch(thread, thread->pc++);
+    instance->lane_count++;
+}
+
+// Función para ejecutar a la vez las instrucciones apuntadas en el pulso
+void lockstep_run()
+{
+    int n = instance->lane_count;
+    if (n == 0) return;
+    instance->lane_count = 0;
+
+    // Rellenar el último bloque con carriles que no ejecutan nada
+    int blocks = (n + LOCKSTEP_WIDTH - 1) / LOCKSTEP_WIDTH;
+    for (int i = n; i < blocks * LOCKSTEP_WIDTH; i++)
+    {
+        instance->lane_instr[i] = NOP_INSTR;
+        instance->lane_column[i] = 0;
+    }
+
+    instance->decode_kernel(blocks);
+
+    // Las traducciones pueden asignar frames, así que se hacen en orden y de una en una
+    for (int i = 0; i < blocks * LOCKSTEP_WIDTH; i++)
+        instance->lane_physical[i] = (i < n && instance->lane_op[i] == LOAD_OP) ? mmu_translate(instance->lane_thread[i], instance->lane_addr[i]) : 0;
+
+    instance->add_kernel(blocks);
+    instance->load_kernel(blocks);
+
+    // Los carriles divergentes (STORE, saltos, HALT, ...) siguen por el camino escalar
+    for (int i = 0; i < n; i++)
+    {
+        if (instance->lane_op[i] == ADD_OP || instance->lane_op[i] == SUB_OP || instance->lane_op[i] == LOAD_OP)
+        {
+            instance->lockstep_vector_lanes++;
+            continue;
+        }
+        instance->lockstep_scalar_lanes++;
+        execute_word(instance->lane_thread[i], instance->lane_instr[i]);
+    }
+}
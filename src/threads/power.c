@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "kernel_simulator.h"
+#include "power.h"
+#include "shared.h"
+#include "interrupts.h"
+
+static const unsigned pstates[POWER_PSTATES] = POWER_PSTATE_LIST;
+
+// Núcleo del hilo en la tabla de núcleos
+static int core_of(struct HT *thread)
+{
+    return thread->lane / MACHINE_THREADS_PER_CORE;
+}
+
+// Frecuencia inicial y tras cada despertar: la máxima salvo con powersave
+static unsigned wake_frequency()
+{
+    return instance->kernel_machine.governor == GOVERNOR_POWERSAVE ? pstates[POWER_PSTATES - 1] : pstates[0];
+}
+
+// Función para crear el estado de energía de los núcleos; antes de crear los procesos
+// trabajadores. Todos empiezan despiertos y los que no tengan trabajo se aparcan solos
+void initialize_power()
+{
+    int cores = MACHINE_CORE_COUNT;
+    instance->core_power = shared_alloc(cores * sizeof(struct core_power));
+    instance->awake_cores = shared_alloc(((cores + 63) / 64) * sizeof(unsigned long));
+    for (int c = 0; c < cores; c++)
+    {
+        instance->core_power[c].frequency = wake_frequency();
+        instance->awake_cores[c / 64] |= 1ul << (c % 64);
+    }
+}
+
+// Elegir la frecuencia del núcleo para la siguiente ventana
+static void govern(struct core_power *power, unsigned long epoch)
+{
+    unsigned long elapsed = epoch - power->window_start;
+    if (elapsed < POWER_GOVERNOR_PULSES) return;
+
+    if (instance->kernel_machine.governor == GOVERNOR_SCHEDUTIL)
+    {
+        double target = 125.0 * power->window_busy / elapsed;
+        power->frequency = pstates[0];
+        for (int p = 0; p < POWER_PSTATES && pstates[p] >= target; p++)
+            power->frequency = pstates[p];
+    }
+    power->window_start = epoch;
+    power->window_busy = 0;
+}
+
+// Función para contar un pulso del núcleo c, que está despierto, con busy hilos ocupados.
+// Sin hilos ocupados el núcleo se aparca y deja de visitarse hasta que el planificador le da
+// trabajo. Devuelve 1 si el núcleo ejecuta el pulso a su frecuencia actual
+int power_pulse(int c, struct cpu_core *core, int busy, unsigned long epoch)
+{
+    struct core_power *power = &instance->core_power[c];
+    double seconds = 1.0 / MACHINE_CLOCK_RATE;
+    double ratio = power->frequency / 100.0;
+
+    power->awake_pulses++;
+    govern(power, epoch);
+
+    if (busy == 0)
+    {
+        power->energy += POWER_STATIC_W * seconds;
+
+        // Aparcar y comprobar otra vez: si el planificador ha asignado un proceso entre medias,
+        // o ve el bit borrado y lo vuelve a poner, o aquí se ve su proceso
+        unsigned long bit = 1ul << (c % 64);
+        atomic_fetch_and(&instance->awake_cores[c / 64], ~bit);
+        for (int k = 0; k < MACHINE_THREADS_PER_CORE; k++)
+            if (core->threads[k].process != NULL)
+            {
+                atomic_fetch_or(&instance->awake_cores[c / 64], bit);
+                break;
+            }
+        return 0;
+    }
+
+    // La energía del pulso se reparte entre los procesos que ocupan el núcleo
+    double energy = (POWER_STATIC_W + POWER_ACTIVE_W * ratio * ratio * ratio) * seconds;
+    power->energy += energy;
+    for (int k = 0; k < MACHINE_THREADS_PER_CORE; k++)
+        if (core->threads[k].process != NULL)
+            core->threads[k].process->energy += energy / busy;
+
+    power->busy_pulses++;
+    power->window_busy++;
+    power->frequency_sum += power->frequency;
+    power->credit += power->frequency;
+    if (power->credit < 100)
+    {
+        power->throttled_pulses++;
+        return 0;
+    }
+    power->credit -= 100;
+    return 1;
+}
+
+// Función del planificador: despertar el núcleo del hilo al que acaba de asignar un proceso
+void wake_core(struct HT *thread)
+{
+    int c = core_of(thread);
+    unsigned long bit = 1ul << (c % 64);
+    if (atomic_fetch_or(&instance->awake_cores[c / 64], bit) & bit) return;
+
+    // El núcleo no se está visitando, así que su estado se puede tocar desde aquí
+    struct core_power *power = &instance->core_power[c];
+    power->wakeups++;
+    power->frequency = wake_frequency();
+    power->credit = 0;
+    power->window_start = current_epoch(); // La carga se mide desde el despertar
+    power->window_busy = 0;
+}
+
+// Función del reloj: anotar la energía del proceso del hilo, que acaba de terminar
+void power_completion(struct HT *thread)
+{
+    struct core_power *power = &instance->core_power[core_of(thread)];
+    power->completed++;
+    power->completed_energy += thread->process->energy;
+}
+
+// Julios consumidos por todos los núcleos hasta el pulso actual
+double machine_energy()
+{
+    unsigned long epoch = current_epoch();
+    double seconds = 1.0 / MACHINE_CLOCK_RATE, energy = 0.0;
+    for (int c = 0; c < MACHINE_CORE_COUNT; c++)
+    {
+        struct core_power *power = &instance->core_power[c];
+        unsigned long parked = epoch > power->awake_pulses ? epoch - power->awake_pulses : 0;
+        energy += power->energy + power->wakeups * POWER_WAKE_J + parked * POWER_PARKED_W * seconds;
+    }
+    return energy;
+}
+
+// Función para imprimir la energía de la máquina y el rendimiento por vatio
+void display_power_statistics()
+{
+    static const char *governor_names[] = {"performance", "schedutil", "powersave"};
+    unsigned long epoch = current_epoch(), awake = 0, busy = 0, throttled = 0, frequency = 0, wakeups = 0, completed = 0;
+    double completed_energy = 0.0, energy = machine_energy();
+    double seconds = (double)epoch / MACHINE_CLOCK_RATE;
+
+    for (int c = 0; c < MACHINE_CORE_COUNT; c++)
+    {
+        struct core_power *power = &instance->core_power[c];
+        awake += power->awake_pulses;
+        busy += power->busy_pulses;
+        throttled += power->throttled_pulses;
+        frequency += power->frequency_sum;
+        wakeups += power->wakeups;
+        completed += power->completed;
+        completed_energy += power->completed_energy;
+    }
+    if (epoch == 0) return;
+
+    unsigned long core_pulses = epoch * MACHINE_CORE_COUNT;
+    printf("Energía (%s): %.4f J en %.3f s simulados, %.2f W de media; %.0f instrucciones por julio\n",
+           governor_names[instance->kernel_machine.governor], energy, seconds, energy / seconds,
+           energy > 0 ? instance->instructions_retired / energy : 0.0);
+    printf("Núcleos: %.1f%% del tiempo aparcados, %lu despertares, frecuencia media %.0f%%, %lu pulsos frenados\n",
+           core_pulses > awake ? 100.0 * (core_pulses - awake) / core_pulses : 0.0, wakeups,
+           busy ? (double)frequency / busy : 0.0, throttled);
+    if (completed > 0)
+        printf("Procesos terminados: %lu, %.6f J por proceso\n", completed, completed_energy / completed);
+}
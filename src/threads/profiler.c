@@ -0,0 +1,584 @@
+#define _GNU_SOURCE // dladdr
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <elf.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <stdatomic.h>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "kernel_simulator.h"
+#include "profiler.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define GREEN "\033[32m"
+
+void mmu_read_block(address pagetable, address virtual_address, word *buffer, unsigned count);
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+// Muestras de los hilos simulados: cuántas veces se ha visto cada instrucción de cada imagen.
+// Sólo las toca el hilo del reloj, entre dos pulsos
+struct profile_entry
+{
+    int image;
+    address pc;
+    unsigned opcode;
+    unsigned long samples; // 0 marca un hueco libre
+};
+
+static struct profile_entry *table = NULL;
+static unsigned table_used = 0;
+static unsigned long pulse_countdown = 0;
+static unsigned long thread_samples = 0;  // Hilos muestreados con proceso
+static unsigned long idle_samples = 0;    // Hilos muestreados sin proceso
+static unsigned long dropped_samples = 0; // No cabían en la tabla
+static unsigned long opcode_samples[16];
+
+// Imágenes cargadas: el índice se guarda en el PCB
+static char *image_names[PROFILE_MAX_IMAGES];
+static _Atomic int image_count = 0;
+
+// Contadores hardware que se piden a perf_event_open
+enum host_counter { HOST_CYCLES, HOST_INSTRUCTIONS, HOST_CACHE_MISSES, HOST_BRANCH_MISSES, HOST_COUNTERS };
+static const unsigned long long host_events[HOST_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// Pila del host capturada por SIGPROF
+struct host_stack
+{
+    int depth;
+    void *frames[PROFILE_DEPTH];
+};
+
+// Hilo del simulador, o proceso trabajador, que se perfila
+struct profiled_thread
+{
+    char name[24];
+    pid_t tid;
+    clockid_t cpu_clock;
+    int counters[HOST_COUNTERS]; // -1 si el host no deja abrir el contador
+    struct host_stack *stacks;   // NULL para los procesos trabajadores: sólo contadores
+    _Atomic unsigned stack_count;
+    unsigned long stacks_lost;
+    _Atomic int ready;
+};
+
+static struct profiled_thread profiled[PROFILE_MAX_THREADS];
+static _Atomic int profiled_count = 0;
+static __thread struct profiled_thread *current_profiled = NULL;
+
+static volatile sig_atomic_t report_pending = 0;
+static volatile sig_atomic_t exit_pending = 0;
+
+// Funciones del ejecutable, leídas de su propia tabla de símbolos para nombrar también las static
+struct host_symbol
+{
+    unsigned long start;
+    unsigned long end;
+    const char *name;
+    unsigned long self_samples;
+};
+
+static struct host_symbol *symbols = NULL;
+static unsigned symbol_count = 0;
+static unsigned long outside_samples = 0; // Muestras propias en bibliotecas del host
+
+// Manejador de SIGPROF: guarda la pila del hilo interrumpido. Cada hilo escribe sólo en su
+// búfer y publica la muestra al final, así que el informe puede leerlo sin cerrojos
+static void profile_signal(int signal)
+{
+    (void)signal;
+    struct profiled_thread *p = current_profiled;
+    if (p == NULL) return;
+
+    int saved_errno = errno;
+    unsigned n = atomic_load_explicit(&p->stack_count, memory_order_relaxed);
+    if (n == PROFILE_HOST_SAMPLES)
+        p->stacks_lost++;
+    else
+    {
+        p->stacks[n].depth = backtrace(p->stacks[n].frames, PROFILE_DEPTH);
+        atomic_store_explicit(&p->stack_count, n + 1, memory_order_release);
+    }
+    errno = saved_errno;
+}
+
+// Manejador de SIGUSR2, SIGINT y SIGTERM: el informe lo escribe el reloj entre dos pulsos
+static void report_signal(int signal)
+{
+    report_pending = 1;
+    if (signal != SIGUSR2)
+        exit_pending = 1;
+}
+
+// Función para abrir los contadores hardware de un hilo o proceso (0 para el que llama)
+static void open_counters(struct profiled_thread *p, pid_t pid)
+{
+    for (int c = 0; c < HOST_COUNTERS; c++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = host_events[c];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        p->counters[c] = syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+}
+
+// Función para reservar una entrada de la tabla de hilos perfilados
+static struct profiled_thread *claim_profiled(const char *name, pid_t tid)
+{
+    int slot = atomic_fetch_add(&profiled_count, 1);
+    if (slot >= PROFILE_MAX_THREADS)
+    {
+        fprintf(stderr, RED"Profiler: Sin espacio para perfilar %s"RESET"\n", name);
+        return NULL;
+    }
+    struct profiled_thread *p = &profiled[slot];
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    p->tid = tid;
+    return p;
+}
+
+// Perfilar el hilo que llama: contadores hardware y muestras de su pila cada
+// PROFILE_HOST_PERIOD_NS de tiempo de CPU. Se llama al entrar en el bucle de cada subsistema
+void profile_thread(const char *name)
+{
+    if (instance->kernel_machine.profile_period == 0) return;
+    struct profiled_thread *p = claim_profiled(name, syscall(SYS_gettid));
+    if (p == NULL) return;
+
+    open_counters(p, 0);
+    pthread_getcpuclockid(pthread_self(), &p->cpu_clock);
+    p->stacks = malloc(PROFILE_HOST_SAMPLES * sizeof(struct host_stack));
+    void *warmup[1];
+    backtrace(warmup, 1); // La primera llamada carga libgcc; que no ocurra dentro del manejador
+    current_profiled = p;
+    atomic_store(&p->ready, 1);
+
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = p->tid;
+    timer_t timer;
+    struct itimerspec period = {{0, PROFILE_HOST_PERIOD_NS}, {0, PROFILE_HOST_PERIOD_NS}};
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) != 0 || timer_settime(timer, 0, &period, NULL) != 0)
+        fprintf(stderr, RED"Profiler: No se pueden muestrear las pilas de %s"RESET"\n", name);
+}
+
+// Perfilar un proceso trabajador desde el coordinador: sólo sus contadores y su tiempo de CPU
+void profile_process(const char *name, pid_t pid)
+{
+    if (instance->kernel_machine.profile_period == 0) return;
+    struct profiled_thread *p = claim_profiled(name, pid);
+    if (p == NULL) return;
+
+    open_counters(p, pid);
+    if (clock_getcpuclockid(pid, &p->cpu_clock) != 0)
+        p->cpu_clock = -1;
+    atomic_store(&p->ready, 1);
+}
+
+// Índice de una imagen para el PCB; las imágenes se identifican por su ruta. -1 sin perfilar
+int profile_image(const char *path)
+{
+    if (instance->kernel_machine.profile_period == 0) return -1;
+
+    int count = atomic_load(&image_count);
+    for (int i = 0; i < count; i++)
+        if (strcmp(image_names[i], path) == 0)
+            return i;
+    if (count == PROFILE_MAX_IMAGES) return -1;
+
+    image_names[count] = strdup(path);
+    atomic_store(&image_count, count + 1); // Sólo el cargador añade imágenes
+    return count;
+}
+
+// Función para anotar una muestra de un hilo simulado
+static void record_sample(int image, address pc, unsigned opcode)
+{
+    unsigned mask = PROFILE_TABLE_SIZE - 1;
+    unsigned slot = ((unsigned)image * 31 + pc) * 2654435761u & mask;
+    while (table[slot].samples != 0 && (table[slot].image != image || table[slot].pc != pc))
+        slot = (slot + 1) & mask;
+
+    if (table[slot].samples == 0)
+    {
+        if (table_used >= PROFILE_TABLE_SIZE / 4 * 3)
+        {
+            dropped_samples++;
+            return;
+        }
+        table_used++;
+        table[slot].image = image;
+        table[slot].pc = pc;
+        table[slot].opcode = opcode;
+    }
+    table[slot].samples++;
+    opcode_samples[opcode]++;
+    thread_samples++;
+}
+
+// Muestrear los hilos simulados cada profile_period pulsos. Lo llama el reloj al acabar un pulso,
+// cuando los trabajadores ya han parado; la instrucción se lee sin pasar por la TLB
+void profile_tick()
+{
+    if (instance->kernel_machine.profile_period == 0 || ++pulse_countdown < instance->kernel_machine.profile_period) return;
+    pulse_countdown = 0;
+
+    for (int t = 0; t < instance->kernel_machine.thread_count; t++)
+    {
+        struct HT *thread = &instance->kernel_machine.threads[t];
+        struct PCB *process = thread->process;
+        if (process == NULL)
+        {
+            idle_samples++;
+            continue;
+        }
+        word instr;
+        mmu_read_block(process->mm.pgb, thread->pc, &instr, 1);
+        record_sample(process->image, thread->pc, INSTR_OP(instr));
+    }
+}
+
+// Función para ordenar los símbolos por dirección
+static int compare_symbols(const void *a, const void *b)
+{
+    const struct host_symbol *x = a, *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+// Función para leer las funciones de la tabla de símbolos del propio ejecutable. En un
+// ejecutable PIE se desplazan a donde se ha cargado
+static void load_symbols()
+{
+    int fd = open("/proc/self/exe", O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) return;
+    char *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) return;
+
+    Elf64_Ehdr *header = (Elf64_Ehdr *)image;
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0) return;
+    unsigned long bias = header->e_type == ET_DYN ? getauxval(AT_PHDR) - header->e_phoff : 0;
+
+    Elf64_Shdr *sections = (Elf64_Shdr *)(image + header->e_shoff);
+    for (int s = 0; s < header->e_shnum; s++)
+    {
+        if (sections[s].sh_type != SHT_SYMTAB) continue;
+        Elf64_Sym *entries = (Elf64_Sym *)(image + sections[s].sh_offset);
+        const char *names = image + sections[sections[s].sh_link].sh_offset;
+        unsigned count = sections[s].sh_size / sizeof(Elf64_Sym);
+
+        symbols = calloc(count, sizeof(struct host_symbol));
+        for (unsigned i = 0; i < count; i++)
+        {
+            if (ELF64_ST_TYPE(entries[i].st_info) != STT_FUNC || entries[i].st_value == 0 || entries[i].st_size == 0)
+                continue;
+            symbols[symbol_count].start = bias + entries[i].st_value;
+            symbols[symbol_count].end = bias + entries[i].st_value + entries[i].st_size;
+            symbols[symbol_count].name = names + entries[i].st_name; // La proyección no se libera
+            symbol_count++;
+        }
+    }
+    qsort(symbols, symbol_count, sizeof(struct host_symbol), compare_symbols);
+}
+
+// Función para encontrar la función del ejecutable que contiene una dirección
+static struct host_symbol *find_symbol(unsigned long addr)
+{
+    unsigned low = 0, high = symbol_count;
+    while (low < high)
+    {
+        unsigned middle = (low + high) / 2;
+        if (symbols[middle].end <= addr)
+            low = middle + 1;
+        else if (symbols[middle].start > addr)
+            high = middle;
+        else
+            return &symbols[middle];
+    }
+    return NULL;
+}
+
+// Nombre de un marco de pila: la función del simulador o, fuera de él, la de la biblioteca
+static const char *frame_name(void *frame, int innermost)
+{
+    unsigned long addr = (unsigned long)frame - (innermost ? 0 : 1); // Las direcciones de retorno apuntan tras la llamada
+    struct host_symbol *symbol = find_symbol(addr);
+    if (symbol != NULL) return symbol->name;
+
+    Dl_info info;
+    if (!dladdr((void *)addr, &info)) return "[host]";
+    if (info.dli_sname != NULL) return info.dli_sname;
+    const char *library = strrchr(info.dli_fname, '/'); // Función interna de una biblioteca: su nombre
+    return library != NULL ? library + 1 : info.dli_fname;
+}
+
+// Función para ordenar las pilas plegadas y poder contarlas
+static int compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Función para ordenar las entradas del histograma por imagen y de más a menos muestras
+static int compare_entries(const void *a, const void *b)
+{
+    const struct profile_entry *x = a, *y = b;
+    if (x->image != y->image) return x->image - y->image;
+    return (x->samples < y->samples) - (x->samples > y->samples);
+}
+
+// Función para ordenar los símbolos de más a menos muestras propias
+static int compare_self(const void *a, const void *b)
+{
+    const struct host_symbol *x = *(struct host_symbol *const *)a, *y = *(struct host_symbol *const *)b;
+    return (x->self_samples < y->self_samples) - (x->self_samples > y->self_samples);
+}
+
+static const char *opcode_name(unsigned opcode)
+{
+    static char other[16];
+    switch (opcode)
+    {
+    case LOAD_OP: return "LOAD";
+    case STORE_OP: return "STORE";
+    case ADD_OP: return "ADD";
+    case SUB_OP: return "SUB";
+    case LI_OP: return "LI";
+    case ADDI_OP: return "ADDI";
+    case BEQ_OP: return "BEQ";
+    case BNE_OP: return "BNE";
+    case BLT_OP: return "BLT";
+    case JMP_OP: return "JMP";
+    case LDR_OP: return "LDR";
+    case STR_OP: return "STR";
+    case IO_OP: return "IO";
+    case HALT_OP: return "HALT";
+    default:
+        snprintf(other, sizeof(other), "OP%u", opcode);
+        return other;
+    }
+}
+
+static const char *image_name(int image)
+{
+    return image >= 0 ? image_names[image] : "[restaurado]";
+}
+
+// Función para escribir las pilas plegadas de los hilos del host y contar las muestras propias
+// de cada función. Devuelve las muestras escritas
+static unsigned long write_host_stacks(FILE *folded)
+{
+    unsigned long total = 0;
+    int count = atomic_load(&profiled_count);
+    if (count > PROFILE_MAX_THREADS) count = PROFILE_MAX_THREADS;
+
+    for (int t = 0; t < count; t++)
+    {
+        struct profiled_thread *p = &profiled[t];
+        if (!atomic_load(&p->ready) || p->stacks == NULL) continue;
+
+        unsigned n = atomic_load_explicit(&p->stack_count, memory_order_acquire);
+        char **lines = malloc(n * sizeof(char *));
+        for (unsigned i = 0; i < n; i++)
+        {
+            struct host_stack *stack = &p->stacks[i];
+            char line[4096];
+            int length = snprintf(line, sizeof(line), "host;%s", p->name);
+            // Los dos primeros marcos son el manejador y el trampolín de la señal
+            for (int f = stack->depth - 1; f >= 2 && length < (int)sizeof(line); f--)
+                length += snprintf(line + length, sizeof(line) - length, ";%s", frame_name(stack->frames[f], f == 2));
+            lines[i] = strdup(line);
+
+            struct host_symbol *self = stack->depth > 2 ? find_symbol((unsigned long)stack->frames[2]) : NULL;
+            if (self != NULL)
+                self->self_samples++;
+            else
+                outside_samples++;
+        }
+
+        qsort(lines, n, sizeof(char *), compare_strings);
+        for (unsigned i = 0; i < n;)
+        {
+            unsigned j = i;
+            while (j < n && strcmp(lines[j], lines[i]) == 0) j++;
+            fprintf(folded, "%s %u\n", lines[i], j - i);
+            i = j;
+        }
+        for (unsigned i = 0; i < n; i++) free(lines[i]);
+        free(lines);
+        total += n;
+    }
+    return total;
+}
+
+// Función para escribir los contadores y el tiempo de CPU de cada hilo del host
+static void write_host_counters(FILE *report)
+{
+    int count = atomic_load(&profiled_count);
+    if (count > PROFILE_MAX_THREADS) count = PROFILE_MAX_THREADS;
+
+    fprintf(report, "\nHost: tiempo de CPU y contadores hardware por hilo\n");
+    fprintf(report, "  %-14s %10s %8s %14s %14s %6s %12s %12s\n", "hilo", "CPU ms", "pilas",
+            "ciclos", "instrucciones", "IPC", "fallos cache", "fallos salto");
+    for (int t = 0; t < count; t++)
+    {
+        struct profiled_thread *p = &profiled[t];
+        if (!atomic_load(&p->ready)) continue;
+
+        struct timespec cpu = {0, 0};
+        if (p->cpu_clock != (clockid_t)-1)
+            clock_gettime(p->cpu_clock, &cpu);
+        fprintf(report, "  %-14s %10.1f %8u", p->name, cpu.tv_sec * 1e3 + cpu.tv_nsec / 1e6, atomic_load(&p->stack_count));
+
+        unsigned long long values[HOST_COUNTERS];
+        int available = 1;
+        for (int c = 0; c < HOST_COUNTERS; c++)
+            if (p->counters[c] < 0 || read(p->counters[c], &values[c], sizeof(values[c])) != sizeof(values[c]))
+                available = 0;
+        if (available)
+            fprintf(report, " %14llu %14llu %6.2f %12llu %12llu\n", values[HOST_CYCLES], values[HOST_INSTRUCTIONS],
+                    values[HOST_CYCLES] ? (double)values[HOST_INSTRUCTIONS] / values[HOST_CYCLES] : 0.0,
+                    values[HOST_CACHE_MISSES], values[HOST_BRANCH_MISSES]);
+        else
+            fprintf(report, "  contadores no disponibles en este host\n");
+        if (p->stacks_lost > 0)
+            fprintf(report, "  %-14s %lu pilas perdidas con el búfer lleno\n", "", p->stacks_lost);
+    }
+}
+
+// Función para escribir el informe: PREFIJO.folded, pilas plegadas para flamegraph.pl de los
+// hilos simulados (sim;imagen;opcode;pc) y del host (host;hilo;funciones), y PREFIJO.txt
+static void write_report()
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s.folded", instance->kernel_machine.profile_prefix);
+    FILE *folded = fopen(path, "w");
+    snprintf(path, sizeof(path), "%s.txt", instance->kernel_machine.profile_prefix);
+    FILE *report = fopen(path, "w");
+    if (folded == NULL || report == NULL)
+    {
+        fprintf(stderr, RED"Profiler: Error al abrir los ficheros de %s"RESET"\n", instance->kernel_machine.profile_prefix);
+        if (folded != NULL) fclose(folded);
+        if (report != NULL) fclose(report);
+        return;
+    }
+
+    // Hilos simulados
+    struct profile_entry *entries = malloc(table_used * sizeof(struct profile_entry));
+    unsigned n = 0;
+    for (unsigned i = 0; i < PROFILE_TABLE_SIZE; i++)
+        if (table[i].samples != 0)
+            entries[n++] = table[i];
+    qsort(entries, n, sizeof(struct profile_entry), compare_entries);
+
+    if (idle_samples > 0)
+        fprintf(folded, "sim;[ocioso] %lu\n", idle_samples);
+    for (unsigned i = 0; i < n; i++)
+        fprintf(folded, "sim;%s;%s;0x%06x %lu\n", image_name(entries[i].image), opcode_name(entries[i].opcode),
+                entries[i].pc * 4, entries[i].samples);
+
+    unsigned long total = thread_samples + idle_samples;
+    fprintf(report, "Muestras de hilos simulados: %lu cada %u pulsos, %lu ociosas (%.1f%%), %lu descartadas\n",
+            total, instance->kernel_machine.profile_period, idle_samples, total ? 100.0 * idle_samples / total : 0.0, dropped_samples);
+    fprintf(report, "\nInstrucciones por código de operación\n");
+    for (unsigned op = 0; op < 16; op++)
+        if (opcode_samples[op] > 0)
+            fprintf(report, "  %-6s %10lu %6.1f%%\n", opcode_name(op), opcode_samples[op], 100.0 * opcode_samples[op] / thread_samples);
+
+    for (unsigned i = 0; i < n;)
+    {
+        unsigned j = i;
+        unsigned long image_samples = 0;
+        for (; j < n && entries[j].image == entries[i].image; j++)
+            image_samples += entries[j].samples;
+
+        fprintf(report, "\nImagen %s: %lu muestras (%.1f%%)\n", image_name(entries[i].image), image_samples,
+                100.0 * image_samples / thread_samples);
+        for (unsigned k = i; k < j && k < i + PROFILE_TOP; k++)
+            fprintf(report, "  0x%06x %-6s %10lu %6.1f%%\n", entries[k].pc * 4, opcode_name(entries[k].opcode),
+                    entries[k].samples, 100.0 * entries[k].samples / image_samples);
+        i = j;
+    }
+    free(entries);
+
+    // Hilos del host
+    for (unsigned s = 0; s < symbol_count; s++)
+        symbols[s].self_samples = 0;
+    outside_samples = 0;
+    unsigned long host_samples = write_host_stacks(folded);
+    write_host_counters(report);
+
+    if (host_samples > 0)
+    {
+        struct host_symbol **hot = malloc(symbol_count * sizeof(struct host_symbol *));
+        for (unsigned s = 0; s < symbol_count; s++)
+            hot[s] = &symbols[s];
+        qsort(hot, symbol_count, sizeof(struct host_symbol *), compare_self);
+
+        fprintf(report, "\nFunciones del host con más muestras propias (%lu pilas, una cada %d us de CPU)\n",
+                host_samples, PROFILE_HOST_PERIOD_NS / 1000);
+        for (unsigned s = 0; s < symbol_count && s < PROFILE_TOP && hot[s]->self_samples > 0; s++)
+            fprintf(report, "  %-28s %8lu %6.1f%%\n", hot[s]->name, hot[s]->self_samples, 100.0 * hot[s]->self_samples / host_samples);
+        if (outside_samples > 0)
+            fprintf(report, "  %-28s %8lu %6.1f%%\n", "[bibliotecas]", outside_samples, 100.0 * outside_samples / host_samples);
+        free(hot);
+    }
+
+    fclose(folded);
+    fclose(report);
+    DEBUG_PRINT(GREEN"Profiler:"RESET" Perfil escrito en %s.folded y %s.txt\n", instance->kernel_machine.profile_prefix, instance->kernel_machine.profile_prefix);
+}
+
+// Escribir el informe pedido con SIGUSR2, o al terminar con SIGINT o SIGTERM. Lo llama el
+// reloj entre dos pulsos, único escritor del histograma de los hilos simulados
+void profile_if_requested()
+{
+    if (!report_pending) return;
+    report_pending = 0;
+    write_report();
+    if (exit_pending)
+        exit(EXIT_SUCCESS);
+}
+
+// Función para preparar el perfilador. Se llama tras crear los procesos trabajadores, que
+// no heredan así los manejadores de señales
+void start_profiler()
+{
+    if (instance->kernel_machine.profile_period == 0) return;
+
+    table = calloc(PROFILE_TABLE_SIZE, sizeof(struct profile_entry));
+    load_symbols();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    action.sa_handler = profile_signal;
+    sigaction(SIGPROF, &action, NULL);
+    action.sa_handler = report_signal;
+    sigaction(SIGUSR2, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
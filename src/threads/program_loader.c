@@ -3,8 +3,15 @@
 #include <string.h>
 #include <dirent.h>
 #include <limits.h>
+#include <time.h>
 #include "kernel_simulator.h"
 #include "program_loader.h"
+#include "jit.h"
+#include "shared.h"
+#include "arrivals.h"
+#include "profiler.h"
+#include "interrupts.h"
+#include "zpool.h"
 
 #define LOAD_FACTOR 1.05
 //Colores
@@ -17,71 +24,68 @@
 #define CYAN "\033[36m"
 #define WHITE "\033[37m"
 
-unsigned next_pid = 0; // Siguiente PID a asignar
-
 // Función para señalizar el inicio del cargador
 static void signal_loader_start()
 {
-    pthread_mutex_lock(&loader_init_mutex);
-    loader_init_flag = 1;
-    pthread_cond_signal(&loader_init_cond);
-    pthread_mutex_unlock(&loader_init_mutex);
+    pthread_mutex_lock(&instance->loader_init_mutex);
+    instance->loader_init_flag = 1;
+    pthread_cond_signal(&instance->loader_init_cond);
+    pthread_mutex_unlock(&instance->loader_init_mutex);
 }
 
-// Función para cargar un proceso desde un archivo
-static void load_program(char* filepath)
+// Imagen de un programa leída del fichero, antes de copiarla a memoria
+struct program_image
 {
-    unsigned text_address, data_address, current_address, data;
-    address addr;
+    unsigned text_address; // Direcciones de bytes, como en el fichero
+    unsigned data_address;
+    word *text;
+    unsigned text_words;
+    word *data;
+    unsigned data_words;
+};
 
-    // Crear e inicializar el PCB (Process Control Block)
-    struct PCB *pcb = malloc(sizeof(struct PCB));
-    pcb->pid = 1 + next_pid++;
-    pcb->state = NEW;
-    pcb->quantum_ms = 10 + rand() % 90;
-    pcb->mm.code = 0; // Página 0
-    pcb->mm.data = 1 << 24; // Página 1
-    pcb->pc = 0;
+// Imágenes ya leídas, compartidas por todas las instancias del proceso
+struct cached_program
+{
+    char *path;
+    struct program_image image;
+    struct cached_program *next;
+};
 
-    // Crear la tabla de páginas del proceso en el espacio del Kernel
-    address pagetable = allocate_kernel_frame() << 16;
-    memset(physical_memory + pagetable, UCHAR_MAX, FRAME_SIZE * sizeof(word));
-    pcb->mm.pgb = pagetable;
+static struct cached_program *program_cache = NULL;
+static pthread_mutex_t program_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-    // Cargar el ejecutable desde un fichero de texto
-    FILE *f = fopen(filepath, "r");
-    if (f == NULL)
-    {
-        printf(RED"Error al abrir el archivo %s"RESET"\n", filepath);
-        exit(1);
-    }
+// Función para leer un programa en el formato de texto de prometheus
+static void read_text_image(FILE *f, char *filepath, struct program_image *image)
+{
+    unsigned data;
 
-    // Copiar en memoria física ambos segmentos de código y de datos
-    if (fscanf(f, " .text %x", &text_address) != 1)
+    if (fscanf(f, " .text %x", &image->text_address) != 1)
     {
         printf(RED"Error al leer .text de %s"RESET"\n", filepath);
         exit(1);
     }
-    if (fscanf(f, " .data %x", &data_address) != 1)
+    if (fscanf(f, " .data %x", &image->data_address) != 1)
     {
         printf(RED"Error al leer .data de %s"RESET"\n", filepath);
         exit(1);
     }
-    unsigned char text_frame = allocate_frame();
-    unsigned char data_frame = allocate_frame();
-    kernel_reserved_memory[pagetable + 0] = text_frame;
-    kernel_reserved_memory[pagetable + 1] = data_frame;
-    addr = text_frame << 16;
-    for (current_address = 0; current_address < data_address; current_address += 4)
+
+    image->text_words = (image->data_address - image->text_address) / 4;
+    image->text = malloc((image->text_words + 1) * sizeof(word));
+    for (unsigned i = 0; i < image->text_words; i++)
     {
-        if (fscanf(f, " %x", &data) != 1)
+        if (fscanf(f, " %x", &image->text[i]) != 1)
         {
             printf(RED"Error en el formato del fichero %s"RESET"\n", filepath);
             exit(1);
         }
-        physical_memory[addr++] = data;
     }
-    addr = data_frame << 16;
+
+    // El segmento de datos no tiene tamaño en la cabecera: se lee hasta el final
+    unsigned data_capacity = 64;
+    image->data_words = 0;
+    image->data = malloc(data_capacity * sizeof(word));
     for (int result = fscanf(f, " %x", &data); result != EOF; result = fscanf(f, "%x", &data))
     {
         if (result != 1)
@@ -89,30 +93,299 @@ static void load_program(char* filepath)
             printf(RED"Error en el formato del fichero %s"RESET"\n", filepath);
             exit(1);
         }
-        physical_memory[addr++] = data;
+        if (image->data_words == data_capacity)
+        {
+            data_capacity *= 2;
+            image->data = realloc(image->data, data_capacity * sizeof(word));
+        }
+        image->data[image->data_words++] = data;
+    }
+}
+
+// Función para leer un programa en el formato binario de prometheus: cabecera y segmentos
+static void read_binary_image(FILE *f, char *filepath, struct program_image *image)
+{
+    struct program_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1)
+    {
+        printf(RED"Error al leer la cabecera de %s"RESET"\n", filepath);
+        exit(1);
+    }
+    image->text_address = header.text_address;
+    image->data_address = header.data_address;
+    image->text_words = header.text_words;
+    image->data_words = header.data_words;
+    image->text = malloc((image->text_words + 1) * sizeof(word));
+    image->data = malloc((image->data_words + 1) * sizeof(word));
+    if (fread(image->text, sizeof(word), image->text_words, f) != image->text_words ||
+        fread(image->data, sizeof(word), image->data_words, f) != image->data_words)
+    {
+        printf(RED"Error en el formato del fichero %s"RESET"\n", filepath);
+        exit(1);
     }
+}
 
+// Función para leer un programa en cualquiera de los dos formatos
+static void read_image(char *filepath, struct program_image *image)
+{
+    FILE *f = fopen(filepath, "rb");
+    if (f == NULL)
+    {
+        printf(RED"Error al abrir el archivo %s"RESET"\n", filepath);
+        exit(1);
+    }
+
+    char magic[sizeof(PROGRAM_MAGIC) - 1];
+    if (fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, PROGRAM_MAGIC, sizeof(magic)) == 0)
+    {
+        rewind(f);
+        read_binary_image(f, filepath, image);
+    }
+    else
+    {
+        rewind(f);
+        read_text_image(f, filepath, image);
+    }
+    fclose(f);
+}
+
+// Función para obtener la imagen de un programa. Cada fichero se lee una sola vez por proceso
+// del host y todas las instancias comparten la imagen, que nadie modifica después
+static const struct program_image *cached_image(char *filepath)
+{
+    pthread_mutex_lock(&program_cache_mutex);
+    struct cached_program *entry = program_cache;
+    while (entry != NULL && strcmp(entry->path, filepath) != 0)
+        entry = entry->next;
+
+    if (entry == NULL)
+    {
+        entry = malloc(sizeof(struct cached_program));
+        entry->path = strdup(filepath);
+        read_image(filepath, &entry->image);
+        entry->next = program_cache;
+        program_cache = entry;
+    }
+    pthread_mutex_unlock(&program_cache_mutex);
+    return &entry->image;
+}
+
+// Función para cargar un proceso desde un archivo con los parámetros de su llegada. Sin quantum
+// pedido se sortea. Devuelve 0 si no hay PCB, tabla de páginas o frames para la imagen; entonces
+// no queda nada asignado y la carga se puede reintentar
+static int load_program(char* filepath, struct arrival *arrival)
+{
+    // Cargar el ejecutable: los segmentos se leen enteros antes de copiarlos, así se sabe
+    // si el de datos merece páginas grandes
+    const struct program_image *image = cached_image(filepath);
+
+    // Crear e inicializar el PCB (Process Control Block)
+    struct PCB *pcb = allocate_pcb();
+    if (pcb == NULL)
+        return 0;
+    pcb->pid = 0; // Se numera al admitirlo
+    pcb->state = NEW;
+    pcb->quantum_ms = arrival->quantum_ms > 0 ? arrival->quantum_ms : 10 + rand() % 90;
+    pcb->priority = arrival->priority;
+    pcb->mm.code = 0;
+    pcb->pc = 0;
+    memset(pcb->registers, 0, sizeof(pcb->registers));
+    pcb->last_cpu = -1; // Todavía no se ha ejecutado en ningún hilo
+    pcb->last_core = -1;
+    pcb->last_thread = -1;
+    pcb->migrations = 0;
+    pcb->tlb_refills = 0;
+    pcb->energy = 0.0;
+
+    // El plazo cuenta desde la llegada, aunque la carga se haya retenido. Sin presupuesto
+    // pedido puede ocupar un hilo todo el plazo
+    int runtime_ms = arrival->runtime_ms > 0 && arrival->runtime_ms < arrival->deadline_ms ? arrival->runtime_ms : arrival->deadline_ms;
+    pcb->deadline_ms = arrival->deadline_ms;
+    pcb->release = (long)(arrival->time * MACHINE_CLOCK_RATE);
+    pcb->deadline = pcb->release + (long)arrival->deadline_ms * MACHINE_CLOCK_RATE / 1000;
+    pcb->edf = 0; // Lo decide el test de admisión del planificador
+    pcb->budget_cycles = runtime_ms * (MACHINE_CLOCK_RATE / 1000);
+    pcb->density = arrival->deadline_ms > 0 ? (unsigned)(1000000ull * runtime_ms / arrival->deadline_ms) : 0;
+    pcb->last_run = current_epoch();
+    pcb->jit = NULL;
+    pcb->jit_slots = NULL;
+    pcb->out_of_memory = 0;
+    pcb->io_device = 0;
+    pcb->io_bytes = 0;
+    pcb->image = profile_image(filepath);
+
+    // Crear la tabla de páginas del proceso en el espacio del Kernel
+    address pagetable = create_pagetable();
+    pcb->mm.pgb = pagetable;
+
+    // Las direcciones del fichero son de bytes y la memoria se direcciona por palabras
+    pcb->mm.data = image->data_address / 4;
+    int loaded = pagetable != PAGE_INVALID &&
+                 mmu_write_block(pagetable, image->text_address / 4, image->text, image->text_words) == 0; // Una traducción por página
+    if (loaded && instance->huge_pages > 1 && image->data_words > instance->frame_size)
+        map_huge_range(pagetable, pcb->mm.data, pcb->mm.data + image->data_words);
+    loaded = loaded && mmu_write_block(pagetable, pcb->mm.data, image->data, image->data_words) == 0;
+    if (!loaded)
+    {
+        if (pagetable != PAGE_INVALID)
+            release_pagetable(pagetable);
+        free_pcb(pcb);
+        return 0;
+    }
+
+    // Con el JIT activo el código se traduce una vez por imagen y lo comparten sus procesos
+    if (instance->kernel_machine.jit && image->text_address == 0)
+    {
+        pcb->jit = jit_lookup(image->text, image->text_words);
+        if (pcb->jit != NULL)
+            pcb->jit_slots = calloc(pcb->jit->slot_count + 1, sizeof(word *));
+    }
+
+    // Fragmentación interna: palabras de frames asignados que no ocupa la imagen
+    instance->image_words += image->text_words + image->data_words;
+    instance->mapped_words += (unsigned long)mapped_pages(pagetable) * instance->frame_size;
+
+    pcb->pid = 1 + instance->next_pid++;
     DEBUG_PRINT(CYAN"Loader:"RESET" Se ha cargado el fichero %s con el num.pid %d\n", filepath, pcb->pid);
     
-    pthread_mutex_lock(&scheduler_mutex);
+    pthread_mutex_lock(&instance->scheduler_mutex);
     add_new_task(pcb); // Añadir el nuevo proceso al planificador
-    pthread_mutex_unlock(&scheduler_mutex);
+    pthread_mutex_unlock(&instance->scheduler_mutex);
+    return 1;
+}
+
+// Función para decidir si se admite otro proceso. Las marcas de memoria tienen histéresis:
+// al llegar a la alta se retienen las cargas hasta que el uso baja de la baja. Con --zswap,
+// antes se comprimen los procesos fríos para intentar bajar de la baja, y nunca se carga en
+// la reserva de frames de los fallos de página de los procesos comprimidos
+static int admission_open()
+{
+    if (instance->kernel_machine.zswap_cold_ms > 0)
+    {
+        pthread_mutex_lock(&instance->scheduler_mutex);
+        zpool_balance();
+        pthread_mutex_unlock(&instance->scheduler_mutex);
+        if (instance->allocator->frames_allocated + zpool_reserve() > instance->frame_count) return 0;
+    }
+
+    unsigned long used = (unsigned long)instance->allocator->frames_allocated * 100;
+    if (used >= (unsigned long)instance->kernel_machine.watermark_high * instance->frame_count)
+        instance->memory_pressure = 1;
+    else if (used <= (unsigned long)instance->kernel_machine.watermark_low * instance->frame_count)
+        instance->memory_pressure = 0;
+    if (instance->memory_pressure) return 0;
+
+    if (instance->kernel_machine.max_ready > 0)
+    {
+        pthread_mutex_lock(&instance->scheduler_mutex);
+        unsigned ready = ready_count(instance->kernel_machine.max_ready);
+        pthread_mutex_unlock(&instance->scheduler_mutex);
+        if (ready >= instance->kernel_machine.max_ready) return 0;
+    }
+    return 1;
+}
+
+// Función para cargar una llegada; las del generador son el siguiente programa de prometheus
+static int load_arrival(struct arrival *arrival)
+{
+    if (arrival->path != NULL)
+    {
+        DEBUG_PRINT(CYAN"Loader:"RESET" Llegada de %s en t=%.3fs\n", arrival->path, arrival->time);
+        return load_program(arrival->path, arrival);
+    }
+
+    char filepath[255];
+    sprintf(filepath, "prometheus/prog%.3u.elf", instance->program_index);
+    DEBUG_PRINT(CYAN"Loader:"RESET" Se a cargando %s\n", filepath);
+    if (!load_program(filepath, arrival)) return 0; // Cargar el programa especificado
+    instance->program_index = (instance->program_index + 1) % 50; // Ciclar entre programas
+    return 1;
+}
+
+// Función para retener una llegada detrás de las que ya esperan, o descartarla si la cola de
+// retenidas está llena
+static void hold_arrival(struct arrival *arrival)
+{
+    if (instance->kernel_machine.max_pending > 0 && instance->held_count >= instance->kernel_machine.max_pending)
+    {
+        instance->arrivals_shed++;
+        DEBUG_PRINT(CYAN"Loader:"RESET" Llegada descartada, hay %u cargas retenidas\n", instance->held_count);
+        free(arrival->path);
+        free(arrival);
+        return;
+    }
+
+    arrival->next = NULL;
+    if (instance->held_tail == NULL)
+        instance->held_head = arrival;
+    else
+        instance->held_tail->next = arrival;
+    instance->held_tail = arrival;
+    instance->held_count++;
+}
+
+// Función para admitir en orden las cargas retenidas mientras haya capacidad
+static void admit_held()
+{
+    while (instance->held_head != NULL)
+    {
+        struct arrival *arrival = instance->held_head;
+        if (!admission_open() || !load_arrival(arrival))
+        {
+            // La primera sin sitio se queda en cabeza; las demás esperan detrás de ella
+            for (struct arrival *a = arrival; a != NULL; a = a->next)
+                if (!a->deferred)
+                {
+                    a->deferred = 1;
+                    instance->arrivals_deferred++;
+                }
+            DEBUG_PRINT(CYAN"Loader:"RESET" %u cargas retenidas por falta de capacidad\n", instance->held_count);
+            return;
+        }
+
+        instance->held_head = arrival->next;
+        if (instance->held_head == NULL)
+            instance->held_tail = NULL;
+        instance->held_count--;
+        instance->arrivals_admitted++;
+        free(arrival->path);
+        free(arrival);
+    }
+}
+
+// Función para esperar trabajo. Con cargas retenidas se reintenta, además de cuando termina un
+// proceso, en cada pasada del planificador, que es cuando se vacía la cola de listos
+static void wait_for_work()
+{
+    if (instance->held_head == NULL)
+    {
+        pthread_cond_wait(&instance->loader_run_signal, &instance->loader_mutex);
+        return;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += 1000000000l / instance->kernel_machine.scheduler_rate;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000l;
+    deadline.tv_nsec %= 1000000000l;
+    pthread_cond_timedwait(&instance->loader_run_signal, &instance->loader_mutex, &deadline);
 }
 
 // Función principal del cargador
 void *run_loader()
 {
     srand(time(NULL));
-    pthread_mutex_lock(&loader_mutex);
+    pthread_mutex_lock(&instance->loader_mutex);
     signal_loader_start(); // Señalar que el cargador ha comenzado
-    int program_index = 0;
+    profile_thread("loader");
     while (1)
     {
-        pthread_cond_wait(&loader_run_signal, &loader_mutex);
-        char filepath[255];
-        sprintf(filepath, "prometheus/prog%.3d.elf", program_index);
-        DEBUG_PRINT(CYAN"Loader:"RESET" Se a cargando %s\n", filepath);
-        load_program(filepath); // Cargar el programa especificado
-        program_index = (program_index + 1) % 50; // Ciclar entre programas
+        wait_for_work();
+
+        // Las llegadas nuevas, del generador o de la traza, pasan detrás de las retenidas
+        struct arrival *arrival;
+        while ((arrival = next_arrival()) != NULL)
+            hold_arrival(arrival);
+        admit_held();
     }
 }
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include "kernel_simulator.h"
+#include "reclaimer.h"
+#include "shared.h"
+#include "memory.h"
+#include "interrupts.h"
+#include "profiler.h"
+#include "scheduler.h"
+
+//Colores
+#define RESET "\033[0m"
+#define RED "\033[31m"
+#define CYAN "\033[36m"
+
+// Función para crear la cola de procesos retirados; antes de crear los procesos trabajadores
+void initialize_reclaimer()
+{
+    instance->reclaim_queue = shared_alloc(sizeof(struct reclaim_queue));
+    initialize_shared_mutex(&instance->reclaim_queue->lock);
+}
+
+// Retirar un proceso terminado. Su hilo ya no lo apunta; el PCB, la tabla de páginas y los
+// frames se devuelven en el reclamador, fuera del pulso, cuando nadie puede verlos ya
+void retire_process(struct PCB *process)
+{
+    struct reclaim_queue *queue = instance->reclaim_queue;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == RECLAIM_QUEUE_SIZE)
+    {
+        fprintf(stderr, RED"Error: La cola del reclamador está llena (%d procesos)"RESET"\n", RECLAIM_QUEUE_SIZE);
+        exit(EXIT_FAILURE);
+    }
+    struct retired_process *entry = &queue->entries[queue->count++];
+    entry->process = process;
+    entry->pagetable = process->mm.pgb;
+    entry->epoch = current_epoch();
+    if (queue->count > queue->max_count)
+        queue->max_count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Devolver la memoria de los procesos retirados antes del pulso before. Se llama con
+// reclaim_mutex tomado. La cola sólo se bloquea para sacar las entradas: liberar una tabla de
+// páginas recorre todas sus entradas y el reloj no puede esperar a eso para retirar otro
+// proceso. Devuelve los procesos que quedan retirados
+static unsigned reclaim_retired(unsigned long before)
+{
+    struct reclaim_queue *queue = instance->reclaim_queue;
+    struct retired_process ready[RECLAIM_QUEUE_SIZE];
+    unsigned count = 0, kept = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    for (unsigned i = 0; i < queue->count; i++)
+    {
+        if (queue->entries[i].epoch < before)
+            ready[count++] = queue->entries[i];
+        else
+            queue->entries[kept++] = queue->entries[i];
+    }
+    queue->count = kept;
+    pthread_mutex_unlock(&queue->lock);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        DEBUG_PRINT(CYAN"Reclaimer:"RESET" Memoria del proceso %d devuelta\n", ready[i].process->pid);
+        account_deadline(ready[i].process, ready[i].epoch);
+        release_pagetable(ready[i].pagetable);
+        free(ready[i].process->jit_slots);
+        free_pcb(ready[i].process);
+    }
+    __atomic_add_fetch(&queue->reclaimed, count, __ATOMIC_RELAXED);
+    return kept;
+}
+
+// Despertar al reclamador: algún hilo se ha quedado libre en el último pulso
+void notify_reclaimer()
+{
+    pthread_mutex_lock(&instance->reclaim_mutex);
+    instance->reclaim_requested = 1;
+    pthread_cond_signal(&instance->reclaim_signal);
+    pthread_mutex_unlock(&instance->reclaim_mutex);
+}
+
+// Devolver ya todo lo retirado. Para el checkpoint: se llama con la máquina parada y
+// scheduler_mutex tomado, así que nadie puede tener referencias a los procesos retirados
+void drain_reclaimer()
+{
+    pthread_mutex_lock(&instance->reclaim_mutex);
+    reclaim_retired(ULONG_MAX);
+    pthread_mutex_unlock(&instance->reclaim_mutex);
+}
+
+// Hilo reclamador. Un proceso retirado en el pulso E ya no lo ve el reloj ni los trabajadores
+// cuando el epoch pasa de E, y el planificador, la introspección y la depuración sólo leen los
+// hilos con scheduler_mutex tomado: tomarlo y soltarlo después de ver el epoch espera a la
+// pasada que pudiera haber empezado antes. Lo retirado en el pulso en curso espera al siguiente
+static void *run_reclaimer()
+{
+    profile_thread("reclaimer");
+    while (1)
+    {
+        pthread_mutex_lock(&instance->reclaim_mutex);
+        while (!instance->reclaim_requested)
+            pthread_cond_wait(&instance->reclaim_signal, &instance->reclaim_mutex);
+        instance->reclaim_requested = 0;
+        pthread_mutex_unlock(&instance->reclaim_mutex);
+
+        unsigned pending = 1;
+        while (pending > 0)
+        {
+            unsigned long epoch = current_epoch();
+            pthread_mutex_lock(&instance->scheduler_mutex);
+            pthread_mutex_unlock(&instance->scheduler_mutex);
+
+            pthread_mutex_lock(&instance->reclaim_mutex);
+            pending = reclaim_retired(epoch);
+            pthread_mutex_unlock(&instance->reclaim_mutex);
+
+            notify_loader(); // Puede haber cargas retenidas esperando a esta memoria o a un PCB
+            if (pending > 0)
+                wait_for_tick(epoch);
+        }
+    }
+    return NULL;
+}
+
+// Función para lanzar el hilo reclamador
+void start_reclaimer()
+{
+    pthread_t tid;
+    create_instance_thread(&tid, run_reclaimer);
+    pthread_detach(tid);
+}
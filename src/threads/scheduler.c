@@ -1,15 +1,20 @@
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include "kernel_simulator.h"
 #include "scheduler.h"
+#include "profiler.h"
+#include "introspection.h"
+#include "power.h"
+#include "interrupts.h"
+#include "zpool.h"
 
 //Colores
 #define RESET "\033[0m"
 #define CYAN "\033[36m"
 
 
-struct process_queue ready_queue = {NULL, NULL}; // Cola de procesos listos
-
 #ifdef DEBUG
 // Función para imprimir la cola de procesos en modo depuración
 static void print_queue(struct process_queue queue)
@@ -36,6 +41,55 @@ static void enqueue_process(struct PCB *process, struct process_queue *queue)
     queue->tail = process;
 }
 
+// Función para añadir un proceso a la cola de listos según su clase: los EDF van delante, por
+// plazo y detrás de los que vencen a la vez, y los de mejor esfuerzo al final. Un proceso EDF
+// que ha agotado su presupuesto sale de la clase y libera su reserva
+static void enqueue_ready(struct PCB *process)
+{
+    if (process->edf && process->budget_cycles <= 0)
+    {
+        DEBUG_PRINT(CYAN"Scheduler:"RESET" Proceso %d agota su presupuesto EDF\n", process->pid);
+        atomic_fetch_sub(&instance->edf_density, process->density);
+        process->density = 0;
+        process->edf = 0;
+        instance->edf_overruns++;
+    }
+    if (!process->edf)
+    {
+        enqueue_process(process, &instance->ready_queue);
+        return;
+    }
+
+    struct PCB **link = &instance->ready_queue.head;
+    while (*link != NULL && (*link)->edf && (*link)->deadline <= process->deadline)
+        link = &(*link)->next;
+    process->next = *link;
+    *link = process;
+    if (process->next == NULL)
+        instance->ready_queue.tail = process;
+}
+
+// Test de admisión de la clase EDF: la densidad de los procesos EDF vivos no puede pasar del
+// EDF_DENSITY_LIMIT % de los hilos de la máquina. El que no cabe se ejecuta como mejor esfuerzo
+// pero sus plazos se siguen contando
+static void admit_deadline(struct PCB *process)
+{
+    if (process->deadline_ms <= 0) return;
+
+    unsigned long limit = (unsigned long)MACHINE_THREAD_COUNT * EDF_DENSITY_LIMIT * 10000;
+    unsigned long density = atomic_load(&instance->edf_density);
+    if (density + process->density > limit)
+    {
+        DEBUG_PRINT(CYAN"Scheduler:"RESET" Proceso %d no pasa el test de admisión EDF\n", process->pid);
+        process->density = 0;
+        instance->edf_rejected++;
+        return;
+    }
+    atomic_fetch_add(&instance->edf_density, process->density);
+    process->edf = 1;
+    instance->edf_admitted++;
+}
+
 // Función para remover un proceso de la cola
 static struct PCB *dequeue_process(struct process_queue *queue)
 {
@@ -52,6 +106,16 @@ static struct PCB *dequeue_process(struct process_queue *queue)
     return process;
 }
 
+// Distancia topológica entre el último hilo del proceso y otro hilo:
+// 0 mismo hilo, 1 mismo núcleo, 2 misma CPU, 3 otra CPU o proceso nuevo
+static int topology_distance(struct PCB *process, struct HT *thread)
+{
+    if (process->last_cpu != thread->cpu) return 3;
+    if (process->last_core != thread->core) return 2;
+    if (process->last_thread != thread->id) return 1;
+    return 0;
+}
+
 // Función para expulsar un proceso del hilo
 static void expel_process(struct HT *thread)
 {
@@ -59,12 +123,16 @@ static void expel_process(struct HT *thread)
 
     // Guardar el contexto del proceso
     process->pc = thread->pc;
-    memcpy(process->registers, thread->registers, sizeof(thread->registers));
+    for (int r = 0; r < REGISTERS_COUNT; r++)
+        process->registers[r] = HT_REGISTER(thread, r);
 
-    clear_tlb(&thread->tlb);
+    // La TLB se conserva: si el proceso vuelve a este hilo la encontrará caliente
+    if (process->edf)
+        process->budget_cycles = thread->quantum_cycles;
+    process->last_run = current_epoch();
     thread->process = NULL;
     process->state = READY;
-    enqueue_process(process, &ready_queue);
+    enqueue_ready(process);
 }
 
 // Función para despachar un proceso a un hilo
@@ -73,88 +141,285 @@ static void assign_process(struct PCB *process, struct HT *thread)
     if (thread->process != NULL)
         expel_process(thread);
 
+    // Contabilizar la migración si el proceso se ejecutó antes en otro hilo
+    int distance = topology_distance(process, thread);
+    if (process->last_cpu != -1 && distance > 0)
+    {
+        instance->migrations[distance - 1]++;
+        process->migrations++;
+    }
+    process->last_cpu = thread->cpu;
+    process->last_core = thread->core;
+    process->last_thread = thread->id;
+
+    // La TLB sólo sirve si pertenece al mismo proceso
+    if (thread->tlb_pid != process->pid)
+    {
+        clear_tlb(&thread->tlb);
+        thread->tlb_pid = process->pid;
+    }
+
     // Restaurar el contexto del proceso
     thread->pc = process->pc;
     thread->PTBR = process->mm.pgb;
-    memcpy(thread->registers, process->registers, sizeof(thread->registers));
+    for (int r = 0; r < REGISTERS_COUNT; r++)
+        HT_REGISTER(thread, r) = process->registers[r];
 
-    thread->quantum_cycles = process->quantum_ms * (kernel_machine.clock_rate / 1000);
+    // Un proceso EDF sigue mientras le quede presupuesto; no lo expulsa el turno rotatorio
+    if (process->edf)
+        thread->quantum_cycles = process->budget_cycles;
+    else
+        thread->quantum_cycles = process->quantum_ms * (MACHINE_CLOCK_RATE / 1000);
     thread->process = process;
     process->state = RUNNING;
+    wake_core(thread); // Después de ocupar el hilo: el núcleo lo ve al volver a comprobar antes de aparcarse
 }
 
-// Función para planificar los procesos
-static void manage_schedule()
+// Función para contar los hilos ocupados de un núcleo
+static int busy_threads(struct cpu_core *core)
+{
+    int busy = 0;
+    for (int k = 0; k < MACHINE_THREADS_PER_CORE; k++)
+        if (core->threads[k].process != NULL)
+            busy++;
+    return busy;
+}
+
+// Función para elegir el hilo de un proceso con afinidad blanda. Por orden de preferencia:
+// su último hilo si está libre o con el quantum agotado, el hilo libre más cercano en la
+// topología y, por último, el hilo con el quantum agotado más cercano. Con la política
+// spread los hilos libres de núcleos ociosos van antes que los de núcleos ya ocupados
+static struct HT *select_thread(struct PCB *process)
 {
-    // Asignar procesos a hilos vacíos
-    for (int i = 0; i < kernel_machine.num_CPUs; i++)
-    for (int j = 0; j < kernel_machine.cores_per_CPU; j++)
-    for (int k = 0; k < kernel_machine.threads_per_core; k++)
+    struct HT *best = NULL;
+    int best_score = INT_MAX;
+
+    for (int c = 0; c < MACHINE_CORE_COUNT; c++)
     {
-        if (ready_queue.head == NULL) return;
-        struct HT *thread = &kernel_machine.CPUs[i].cores[j].threads[k];
+        struct cpu_core *core = &instance->kernel_machine.cores[c];
+        int core_busy = (instance->kernel_machine.placement == PLACEMENT_SPREAD) && busy_threads(core) > 0;
 
-        if (thread->process == NULL)
+        for (int k = 0; k < MACHINE_THREADS_PER_CORE; k++)
         {
-            struct PCB *process = dequeue_process(&ready_queue);
-            assign_process(process, thread);
+            struct HT *thread = &core->threads[k];
+            int distance = topology_distance(process, thread);
+            int tier;
+
+            if (thread->process == NULL)
+                tier = (distance == 0) ? 0 : (core_busy ? 3 : 2);
+            else if (thread->quantum_cycles <= 0)
+                tier = (distance == 0) ? 1 : 4;
+            else
+                continue;
+
+            // Dentro de cada nivel se prefiere el hilo más cercano al último del proceso
+            int score = tier * 4 + distance;
+            if (score < best_score)
+            {
+                best_score = score;
+                best = thread;
+            }
         }
     }
+    return best;
+}
+
+// Función para elegir el hilo que cede un proceso EDF cuando no queda ninguno libre ni con el
+// quantum agotado: el más cercano de los que ejecutan procesos de mejor esfuerzo o, si todos
+// son EDF, el del plazo más lejano si vence después que el del proceso
+static struct HT *preemption_victim(struct PCB *process)
+{
+    struct HT *best = NULL;
+    int best_distance = INT_MAX;
+    long latest = process->deadline;
 
-    // Reasignar procesos cuyos quantum han expirado
-    for (int i = 0; i < kernel_machine.num_CPUs; i++)
-    for (int j = 0; j < kernel_machine.cores_per_CPU; j++)
-    for (int k = 0; k < kernel_machine.threads_per_core; k++)
+    for (int t = 0; t < MACHINE_THREAD_COUNT; t++)
     {
-        if (ready_queue.head == NULL) return;
-        struct HT *thread = &kernel_machine.CPUs[i].cores[j].threads[k];
+        struct HT *thread = &instance->kernel_machine.threads[t];
+        struct PCB *running = thread->process;
+        if (running == NULL) continue;
+
+        if (!running->edf)
+        {
+            int distance = topology_distance(process, thread);
+            if (best == NULL || best->process->edf || distance < best_distance)
+            {
+                best = thread;
+                best_distance = distance;
+            }
+        }
+        else if ((best == NULL || best->process->edf) && running->deadline > latest)
+        {
+            best = thread;
+            latest = running->deadline;
+        }
+    }
+    return best;
+}
+
+// Función para planificar los procesos. Reparte entre dos pulsos, con pulse_mutex tomado, para
+// no cambiar el proceso, la TLB o los registros de un hilo mientras el reloj lo ejecuta
+static void manage_schedule()
+{
+    // Como mucho tantas asignaciones por pasada como hilos tiene la máquina
+    int assignments = MACHINE_THREAD_COUNT;
 
-        if (thread->quantum_cycles <= 0)
+    pthread_mutex_lock(&instance->pulse_mutex);
+    while (instance->ready_queue.head != NULL && assignments-- > 0)
+    {
+        struct HT *thread = select_thread(instance->ready_queue.head);
+        if (thread == NULL && instance->ready_queue.head->edf)
         {
-            struct PCB *process = dequeue_process(&ready_queue);
-            assign_process(process, thread);
-        }   
+            thread = preemption_victim(instance->ready_queue.head);
+            if (thread != NULL)
+                instance->edf_preemptions++;
+        }
+        if (thread == NULL) break; // Todos los hilos ocupados con quantum restante
+
+        struct PCB *process = dequeue_process(&instance->ready_queue);
+        assign_process(process, thread);
     }
+    pthread_mutex_unlock(&instance->pulse_mutex);
+    zpool_balance(); // Con --zswap, reponer la reserva de frames de los fallos de página
 }
 
 // Función para señalizar el inicio del Scheduler
 static void signal_scheduler_start()
 {
-    pthread_mutex_lock(&scheduler_init_mutex);
-    scheduler_init_flag = 1;
-    pthread_cond_signal(&scheduler_init_cond);
-    pthread_mutex_unlock(&scheduler_init_mutex);
+    pthread_mutex_lock(&instance->scheduler_init_mutex);
+    instance->scheduler_init_flag = 1;
+    pthread_cond_signal(&instance->scheduler_init_cond);
+    pthread_mutex_unlock(&instance->scheduler_init_mutex);
 }
 
 // Función principal del Scheduler
 void *run_scheduler(void* core_number)
 {
-    pthread_mutex_lock(&scheduler_mutex);
+    pthread_mutex_lock(&instance->scheduler_mutex);
     signal_scheduler_start();
+    profile_thread("scheduler");
     while (1)
     {
-        pthread_cond_wait(&scheduler_run_signal, &scheduler_mutex);
+        pthread_cond_wait(&instance->scheduler_run_signal, &instance->scheduler_mutex);
         #ifdef DEBUG
         printf("\n");
-        print_queue(ready_queue);
+        print_queue(instance->ready_queue);
         display_threads_status();
         printf("\n" CYAN"Scheduler:"RESET" Calculadondo reparto\n");
         #endif
         manage_schedule();
+        publish_introspection(); // Los clientes de --socket leen la instantánea sin este cerrojo
         #ifdef DEBUG
         printf("\n");
-        print_queue(ready_queue);
+        print_queue(instance->ready_queue);
         display_threads_status();
+        display_statistics();
         printf("\n");
         #endif
     }
 }
 
+// Método para devolver a la cola de listos un proceso que ha terminado su E/S. Se llama con
+// scheduler_mutex tomado
+void wake_process(struct PCB *process)
+{
+    DEBUG_PRINT(CYAN"Scheduler:"RESET" Proceso %d vuelve de E/S\n", process->pid);
+    process->state = READY;
+    enqueue_ready(process);
+    manage_schedule();
+}
+
+// Contar los procesos de la cola de listos, sin pasar de limit. Se llama con scheduler_mutex tomado
+unsigned ready_count(unsigned limit)
+{
+    unsigned count = 0;
+    for (struct PCB *p = instance->ready_queue.head; p != NULL && count < limit; p = p->next)
+        count++;
+    return count;
+}
+
 // Método para que use el generador de procesos al crear un nuevo proceso
 void add_new_task(struct PCB *process)
 {   
     DEBUG_PRINT(CYAN"Scheduler:"RESET" Proceso %d añadido a la cola\n", process->pid);
     process->state = READY;
-    enqueue_process(process, &ready_queue);
+    admit_deadline(process);
+    enqueue_ready(process);
     manage_schedule();
 }
+
+// Cubeta del histograma de tiempos de respuesta: exacta por debajo de 8 pulsos y después
+// 8 cubetas por cada potencia de 2
+static int response_bucket(unsigned long pulses)
+{
+    if (pulses < 8) return pulses;
+    int msb = 63 - __builtin_clzl(pulses);
+    return (msb - 2) * 8 + ((pulses >> (msb - 3)) & 7);
+}
+
+// Primer valor de la cubeta b
+static unsigned long bucket_floor(int b)
+{
+    if (b < 8) return b;
+    return (unsigned long)(8 + b % 8) << (b / 8 - 1);
+}
+
+// Función del reclamador: anotar el plazo de un proceso terminado en el pulso epoch y liberar
+// su reserva EDF. Un proceso terminado por falta de memoria no cumple su plazo
+void account_deadline(struct PCB *process, unsigned long epoch)
+{
+    if (process->deadline_ms <= 0) return;
+    if (process->density > 0)
+        atomic_fetch_sub(&instance->edf_density, process->density);
+
+    long lateness = (long)epoch - process->deadline;
+    long response = (long)epoch - process->release;
+    pthread_mutex_lock(&instance->deadline_mutex);
+    if (lateness > 0 || process->out_of_memory)
+    {
+        instance->deadline_missed++;
+        if (lateness > 0)
+            instance->tardiness += lateness;
+    }
+    else
+        instance->deadline_met++;
+    if (lateness > instance->max_lateness)
+        instance->max_lateness = lateness;
+    instance->response_buckets[response_bucket(response > 0 ? response : 0)]++;
+    pthread_mutex_unlock(&instance->deadline_mutex);
+}
+
+// Percentil p del tiempo de respuesta en ms, con la resolución del histograma
+static double response_percentile(unsigned long total, double p)
+{
+    unsigned long rank = (unsigned long)(p * total / 100.0), seen = 0;
+    for (int b = 0; b < DEADLINE_BUCKETS; b++)
+    {
+        seen += instance->response_buckets[b];
+        if (seen > rank)
+            return bucket_floor(b) * 1000.0 / MACHINE_CLOCK_RATE;
+    }
+    return 0.0;
+}
+
+// Función para imprimir los plazos cumplidos y la cola del tiempo de respuesta de los procesos con plazo
+void display_deadline_statistics()
+{
+    pthread_mutex_lock(&instance->deadline_mutex);
+    unsigned long total = instance->deadline_met + instance->deadline_missed;
+    if (total > 0)
+    {
+        double ms = 1000.0 / MACHINE_CLOCK_RATE;
+        printf("EDF: %lu admitidos, %lu rechazados por el test, %lu degradados por agotar el presupuesto, %lu expulsiones\n",
+               instance->edf_admitted, instance->edf_rejected, instance->edf_overruns, instance->edf_preemptions);
+        printf("Plazos: %lu de %lu cumplidos (%.1f%% incumplidos), retraso medio de los incumplidos %.2f ms, "
+               "peor terminación %+.2f ms respecto al plazo\n",
+               instance->deadline_met, total, 100.0 * instance->deadline_missed / total,
+               instance->deadline_missed ? instance->tardiness * ms / instance->deadline_missed : 0.0,
+               instance->max_lateness * ms);
+        printf("Respuesta con plazo: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, p99.9 %.2f ms\n",
+               response_percentile(total, 50), response_percentile(total, 95),
+               response_percentile(total, 99), response_percentile(total, 99.9));
+    }
+    pthread_mutex_unlock(&instance->deadline_mutex);
+}
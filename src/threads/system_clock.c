@@ -1,81 +1,409 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/prctl.h>
 #include "kernel_simulator.h"
 #include "system_clock.h"
-
-// Definición de los códigos de operación
-#define LOAD_OP 0
-#define STORE_OP 1
-#define ADD_OP 2
-#define HALT_OP 15
+#include "checkpoint.h"
+#include "lockstep.h"
+#include "jit.h"
+#include "shared.h"
+#include "dumper.h"
+#include "io.h"
+#include "interrupts.h"
+#include "profiler.h"
+#include "reclaimer.h"
+#include "power.h"
 
 //Colores
 #define RESET "\033[0m"
+#define RED "\033[31m"
 #define CYAN "\033[36m"
 
-int process_completed = 0; // Indicador de si un proceso ha terminado
 
-// Función para ejecutar una instrucción del hilo (thread)
-static void execute_instruction(struct HT *thread)
+
+// Función que decide si un hilo con hermanos ocupados emite en este ciclo.
+// Cada ciclo acumula smt_rate de crédito y emitir una instrucción cuesta 100
+static int smt_issue(struct HT *thread)
+{
+    thread->smt_credit += instance->kernel_machine.smt_rate;
+    if (thread->smt_credit < 100)
+        return 0;
+    thread->smt_credit -= 100;
+    return 1;
+}
+
+// Función para terminar el proceso del hilo. Su memoria la devuelve el reclamador fuera del
+// pulso; al acabar el pulso se avisa al planificador, al cargador y al reclamador
+static void terminate_process(struct HT *thread)
+{
+    instance->process_completed = 1;
+    power_completion(thread);
+    struct PCB *process = thread->process;
+    thread->process = NULL;
+    retire_process(process);
+}
+
+// Función para bloquear el proceso del hilo en una petición de E/S. El hilo queda libre y al
+// acabar el pulso se avisa al planificador para que lo ocupe con otro proceso
+static void block_process(struct HT *thread, int device, unsigned bytes)
+{
+    struct PCB *process = thread->process;
+
+    // Guardar el contexto del proceso; el pc ya apunta a la instrucción siguiente
+    process->pc = thread->pc;
+    for (int r = 0; r < REGISTERS_COUNT; r++)
+        process->registers[r] = HT_REGISTER(thread, r);
+    process->io_device = device;
+    process->io_bytes = bytes;
+    if (process->edf)
+        process->budget_cycles = thread->quantum_cycles; // El presupuesto EDF no se recarga al volver
+    process->last_run = current_epoch();
+
+    thread->process = NULL;
+    instance->process_completed = 1;
+    io_submit(process);
+}
+
+// Función para terminar el proceso del hilo si se ha quedado sin frames
+static void reap_out_of_memory(struct HT *thread)
+{
+    if (thread->process == NULL || !thread->process->out_of_memory) return;
+    fprintf(stderr, RED"Clock: Proceso %d terminado por falta de memoria"RESET"\n", thread->process->pid);
+    instance->oom_kills++;
+    terminate_process(thread);
+}
+
+// Función para calcular la dirección de palabra de LDR y STR a partir de la dirección de bytes
+// del registro base. Un acceso fuera del espacio de direcciones termina el proceso, como una
+// violación de segmento; devuelve 0 en ese caso
+static int indexed_address(struct HT *thread, word instr, address *addr)
+{
+    *addr = (unsigned)(HT_REGISTER(thread, INSTR_R2(instr)) + INSTR_SIMM16(instr)) / 4;
+    if ((*addr >> instance->page_bits) < instance->virtual_pages) return 1;
+
+    DEBUG_PRINT(RED"Clock: Proceso %d terminado por acceder a la dirección %u, fuera de su espacio"RESET"\n",
+                thread->process->pid, *addr * 4);
+    terminate_process(thread);
+    return 0;
+}
+
+// Función para ejecutar una instrucción ya leída de memoria en el hilo (thread)
+void execute_word(struct HT *thread, word instr)
 {
-    word instr = mmu_fetch(thread, thread->pc++); // Obtener la instrucción de la memoria
-    unsigned char op_code = (instr >> 28) & 0xF; // Obtener el código de operación
     int reg1, reg2, reg3;
     address addr;
 
     // Decodificación y ejecución de la instrucción
-    switch (op_code)
+    switch (INSTR_OP(instr))
     {
     case LOAD_OP: // Operación de carga
-        reg1 = (instr >> 24) & 0xF;
-        addr = (instr & 0xFFFFFF) / 4;
-        thread->registers[reg1] = mmu_fetch(thread, addr); // Cargar el valor de la memoria en el registro
+        reg1 = INSTR_R1(instr);
+        addr = INSTR_ADDR(instr);
+        HT_REGISTER(thread, reg1) = mmu_fetch(thread, addr); // Cargar el valor de la memoria en el registro
         break;
     case STORE_OP: // Operación de almacenamiento
-        reg1 = (instr >> 24) & 0xF;
-        addr = (instr & 0xFFFFFF) / 4;
-        mmu_store(thread, addr, thread->registers[reg1]); // Almacenar el valor del registro en la memoria
+        // La dirección va en la instrucción: jit_compile ya deja sin imagen nativa el código
+        // con un STORE sobre .text, así que aquí no puede haber una imagen que invalidar
+        reg1 = INSTR_R1(instr);
+        addr = INSTR_ADDR(instr);
+        mmu_store(thread, addr, HT_REGISTER(thread, reg1)); // Almacenar el valor del registro en la memoria
         break;
     case ADD_OP: // Operación de suma
-        reg1 = (instr >> 24) & 0xF;
-        reg2 = (instr >> 24) & 0xF;
-        reg3 = (instr >> 24) & 0xF;
-        thread->registers[reg1] = thread->registers[reg2] + thread->registers[reg3]; // Sumar los valores de dos registros y guardar el resultado en un tercer registro
+        reg1 = INSTR_R1(instr);
+        reg2 = INSTR_R2(instr);
+        reg3 = INSTR_R3(instr);
+        HT_REGISTER(thread, reg1) = HT_REGISTER(thread, reg2) + HT_REGISTER(thread, reg3); // Sumar los valores de dos registros y guardar el resultado en un tercer registro
+        break;
+    case SUB_OP: // Operación de resta
+        HT_REGISTER(thread, INSTR_R1(instr)) = HT_REGISTER(thread, INSTR_R2(instr)) - HT_REGISTER(thread, INSTR_R3(instr));
+        break;
+    case LI_OP: // Carga de un inmediato
+        HT_REGISTER(thread, INSTR_R1(instr)) = INSTR_SIMM24(instr);
+        break;
+    case ADDI_OP: // Suma de un inmediato
+        HT_REGISTER(thread, INSTR_R1(instr)) = HT_REGISTER(thread, INSTR_R2(instr)) + INSTR_SIMM16(instr);
+        break;
+    case BEQ_OP: // Saltos: sólo cambian el pc, la siguiente lectura pasa por la TLB como cualquier otra
+        if (HT_REGISTER(thread, INSTR_R1(instr)) == HT_REGISTER(thread, INSTR_R2(instr)))
+            thread->pc = INSTR_TARGET(instr);
+        break;
+    case BNE_OP:
+        if (HT_REGISTER(thread, INSTR_R1(instr)) != HT_REGISTER(thread, INSTR_R2(instr)))
+            thread->pc = INSTR_TARGET(instr);
+        break;
+    case BLT_OP:
+        if (HT_REGISTER(thread, INSTR_R1(instr)) < HT_REGISTER(thread, INSTR_R2(instr)))
+            thread->pc = INSTR_TARGET(instr);
+        break;
+    case JMP_OP:
+        thread->pc = INSTR_ADDR(instr);
+        break;
+    case LDR_OP: // Carga con la dirección en un registro
+        if (indexed_address(thread, instr, &addr))
+            HT_REGISTER(thread, INSTR_R1(instr)) = mmu_fetch(thread, addr);
+        break;
+    case STR_OP: // Almacenamiento con la dirección en un registro
+        if (!indexed_address(thread, instr, &addr)) break;
+        // Escribir sobre el propio código deja obsoleta la imagen nativa: el proceso se interpreta
+        // y sus ranuras de páginas se liberan con ella
+        if (thread->process->jit != NULL && addr < thread->process->jit->text_words)
+        {
+            thread->process->jit = NULL;
+            free(thread->process->jit_slots);
+            thread->process->jit_slots = NULL;
+        }
+        mmu_store(thread, addr, HT_REGISTER(thread, INSTR_R1(instr)));
+        break;
+    case IO_OP: // Operación de entrada/salida: el proceso espera al dispositivo sin ocupar el hilo
+        reg1 = INSTR_R1(instr);
+        DEBUG_PRINT(CYAN"Clock:"RESET" Proceso %d bloqueado en E/S (dispositivo %d, %u bytes)\n",
+                    thread->process->pid, reg1, INSTR_IMM(instr));
+        block_process(thread, reg1, INSTR_IMM(instr));
         break;
     case HALT_OP: // Operación de terminación
-        process_completed = 1;
-        DEBUG_PRINT(CYAN"Clock:"RESET" Proceso %d finalizado\n", thread->process->pid);
-        free(thread->process); // Liberar la memoria del proceso
-        thread->process = NULL;
-        release_pagetable(thread->PTBR); // Liberar la tabla de páginas del proceso
+        DEBUG_PRINT(CYAN"Clock:"RESET" Proceso %d finalizado (%u migraciones, %u recargas de TLB)\n",
+                    thread->process->pid, thread->process->migrations, thread->process->tlb_refills);
+        terminate_process(thread);
         break;
     }
 }
 
+// Función para ejecutar una instrucción del hilo (thread)
+static void execute_instruction(struct HT *thread)
+{
+    word instr = mmu_fetch(thread, thread->pc++); // Obtener la instrucción de la memoria
+    execute_word(thread, instr);
+}
+
+// Función para ejecutar hasta budget instrucciones del hilo (thread). El código nativo avanza
+// mientras puede y el intérprete ejecuta la instrucción en la que se para. Devuelve las
+// instrucciones retiradas
+static int execute_burst(struct HT *thread, int budget)
+{
+    int executed = 0;
+    while (executed < budget && thread->process != NULL && !thread->process->out_of_memory)
+    {
+        if (thread->process->jit != NULL)
+        {
+            executed += jit_execute(thread, budget - executed);
+            if (executed == budget) break;
+        }
+        execute_instruction(thread);
+        executed++;
+    }
+    return executed;
+}
+
+// Función para ejecutar un pulso en el núcleo c, que está despierto
+static void execute_core(int c, unsigned long epoch)
+{
+    struct cpu_core *core = &instance->kernel_machine.cores[c];
+
+    // Contar los hilos ocupados del núcleo para el modelo de contención SMT
+    int busy = 0;
+    for (int k = 0; k < MACHINE_THREADS_PER_CORE; k++)
+        if (core->threads[k].process != NULL)
+            busy++;
+
+    // Sin trabajo el núcleo se aparca; a frecuencia reducida hay pulsos que no ejecuta
+    if (!power_pulse(c, core, busy, epoch))
+    {
+        for (int k = 0; k < MACHINE_THREADS_PER_CORE; k++)
+            if (core->threads[k].process != NULL)
+                core->threads[k].quantum_cycles--;
+        return;
+    }
+
+    for (int k = 0; k < MACHINE_THREADS_PER_CORE; k++)
+    {
+        struct HT *thread = &core->threads[k];
+        if (thread->process == NULL) continue;
+
+        // Con el núcleo compartido el hilo sólo emite a ritmo reducido
+        if (busy > 1 && !smt_issue(thread))
+        {
+            instance->smt_stall_cycles++;
+            thread->quantum_cycles--;
+            continue;
+        }
+
+        // Ejecutar la instrucción del hilo (thread) actual; en modo lockstep
+        // sólo se apunta y se ejecuta al final del pulso junto con el resto
+        #ifdef DEBUG
+        printf(CYAN"Clock:"RESET" Ejecucion de la instrucción num. %d del proceso num. %d\n", thread->pc, thread->process->pid);
+        #endif
+        if (instance->kernel_machine.lockstep)
+        {
+            lockstep_add(thread);
+            instance->instructions_retired++;
+            thread->quantum_cycles--;
+            continue;
+        }
+
+        // Una ráfaga no pasa del final del quantum para que la expulsión siga a tiempo
+        int budget = instance->kernel_machine.burst;
+        if (thread->quantum_cycles > 0 && thread->quantum_cycles < budget)
+            budget = thread->quantum_cycles;
+        int executed = execute_burst(thread, budget);
+        instance->instructions_retired += executed;
+        thread->quantum_cycles -= executed;
+        reap_out_of_memory(thread);
+    }
+}
+
+// Función para ejecutar un pulso en los núcleos despiertos de [first, last). Los aparcados
+// no tienen hilos ocupados y no se visitan
+static void execute_cores(int first, int last)
+{
+    unsigned long epoch = current_epoch();
+    for (int word = first / 64; word * 64 < last; word++)
+    {
+        unsigned long awake = atomic_load(&instance->awake_cores[word]);
+        while (awake != 0)
+        {
+            int c = word * 64 + __builtin_ctzl(awake);
+            awake &= awake - 1;
+            if (c >= first && c < last)
+                execute_core(c, epoch);
+        }
+    }
+
+    if (instance->kernel_machine.lockstep)
+    {
+        lockstep_run();
+        for (int c = first; c < last; c++)
+            for (int k = 0; k < MACHINE_THREADS_PER_CORE; k++)
+                reap_out_of_memory(&instance->kernel_machine.cores[c].threads[k]);
+    }
+}
+
+// Función que ejecuta un proceso trabajador: cada pulso del coordinador ejecuta los núcleos
+// de sus CPUs sobre la memoria compartida y publica sus contadores
+static void run_worker(int w)
+{
+    int first_cpu = w * MACHINE_CPUS / instance->kernel_machine.workers;
+    int last_cpu = (w + 1) * MACHINE_CPUS / instance->kernel_machine.workers;
+    struct worker_stats *stats = &instance->shared_control->stats[w];
+
+    prctl(PR_SET_PDEATHSIG, SIGKILL); // Terminar con el coordinador
+    setvbuf(stdout, NULL, _IOLBF, 0);  // No perder la traza pendiente al terminar así
+    while (1)
+    {
+        pthread_barrier_wait(&instance->shared_control->pulse_start);
+        instance->process_completed = 0;
+        execute_cores(first_cpu * MACHINE_CORES_PER_CPU, last_cpu * MACHINE_CORES_PER_CPU);
+        stats->instructions_retired = instance->instructions_retired;
+        stats->smt_stall_cycles = instance->smt_stall_cycles;
+        stats->tlb_refills = instance->tlb_refills;
+        stats->oom_kills = instance->oom_kills;
+        stats->process_completed |= instance->process_completed;
+        pthread_barrier_wait(&instance->shared_control->pulse_end);
+    }
+}
+
+// Función para crear los procesos trabajadores. Se llama antes de lanzar los hilos del
+// coordinador, que se queda con el reloj, los temporizadores, el planificador y el cargador
+void start_workers()
+{
+    int workers = instance->kernel_machine.workers;
+    instance->shared_control = shared_alloc(sizeof(struct shared_control) + workers * sizeof(struct worker_stats));
+
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&instance->shared_control->pulse_start, &attr, workers + 1);
+    pthread_barrier_init(&instance->shared_control->pulse_end, &attr, workers + 1);
+    pthread_barrierattr_destroy(&attr);
+
+    fflush(stdout); // Que los hijos no repitan la salida pendiente
+    for (int w = 0; w < workers; w++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror(RED"Clock: No se pudo crear el proceso trabajador"RESET);
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0)
+            run_worker(w);
+        char name[24];
+        snprintf(name, sizeof(name), "worker%d", w);
+        profile_process(name, pid);
+        DEBUG_PRINT(CYAN"Clock:"RESET" Proceso trabajador %d (pid %d) con las CPUs %d a %d\n", w, pid,
+                    w * MACHINE_CPUS / workers, (w + 1) * MACHINE_CPUS / workers - 1);
+    }
+}
+
+// Función para ejecutar un pulso en los procesos trabajadores y recoger sus contadores
+static void run_workers_pulse()
+{
+    pthread_barrier_wait(&instance->shared_control->pulse_start);
+    pthread_barrier_wait(&instance->shared_control->pulse_end);
+
+    instance->instructions_retired = instance->smt_stall_cycles = instance->tlb_refills = instance->oom_kills = 0;
+    for (int w = 0; w < instance->kernel_machine.workers; w++)
+    {
+        struct worker_stats *stats = &instance->shared_control->stats[w];
+        instance->instructions_retired += stats->instructions_retired;
+        instance->smt_stall_cycles += stats->smt_stall_cycles;
+        instance->tlb_refills += stats->tlb_refills;
+        instance->oom_kills += stats->oom_kills;
+        instance->process_completed |= stats->process_completed;
+        stats->process_completed = 0;
+    }
+}
+
 // Función para esperar a que todos los componentes del sistema estén listos
-static void wait_for_system_start()
+void wait_for_system_start()
 {
-    pthread_mutex_lock(&timer_init_mutex);
-    if (timer_init_flag == 0)
-        pthread_cond_wait(&timer_init_cond, &timer_init_mutex);
-    pthread_mutex_unlock(&timer_init_mutex);
+    pthread_mutex_lock(&instance->timer_init_mutex);
+    if (instance->timer_init_flag == 0)
+        pthread_cond_wait(&instance->timer_init_cond, &instance->timer_init_mutex);
+    pthread_mutex_unlock(&instance->timer_init_mutex);
 
-    pthread_mutex_lock(&scheduler_init_mutex);
-    if (scheduler_init_flag == 0)
-        pthread_cond_wait(&scheduler_init_cond, &scheduler_init_mutex);
-    pthread_mutex_unlock(&scheduler_init_mutex);
+    pthread_mutex_lock(&instance->scheduler_init_mutex);
+    if (instance->scheduler_init_flag == 0)
+        pthread_cond_wait(&instance->scheduler_init_cond, &instance->scheduler_init_mutex);
+    pthread_mutex_unlock(&instance->scheduler_init_mutex);
 
-    pthread_mutex_lock(&loader_init_mutex);
-    if (loader_init_flag == 0)
-        pthread_cond_wait(&loader_init_cond, &loader_init_mutex);
-    pthread_mutex_unlock(&loader_init_mutex);
+    pthread_mutex_lock(&instance->loader_init_mutex);
+    if (instance->loader_init_flag == 0)
+        pthread_cond_wait(&instance->loader_init_cond, &instance->loader_init_mutex);
+    pthread_mutex_unlock(&instance->loader_init_mutex);
 }
 
-// Función que representa el ciclo de reloj del sistema
+// Función para dar un pulso de la máquina de la instancia actual. La usan el hilo del reloj
+// y los hilos del pool de --instances
+void clock_pulse()
+{
+    publish_tick(); // Emitir el pulso; el reloj no espera a las rutinas de los temporizadores
+
+    instance->process_completed = 0;
+    pthread_mutex_lock(&instance->pulse_mutex); // El planificador no cambia los hilos a mitad de pulso
+    if (instance->kernel_machine.workers > 0)
+        run_workers_pulse();
+    else
+        execute_cores(0, MACHINE_CORE_COUNT);
+    pthread_mutex_unlock(&instance->pulse_mutex);
+
+    if (instance->process_completed)
+        raise_irq(IRQ_COMPLETION); // Avisar al planificador y al cargador de que hay un hilo libre
+
+    profile_tick();            // Muestrear los hilos simulados cada profile_period pulsos
+    checkpoint_if_requested(); // Guardar el estado entre dos pulsos si se ha pedido
+    dump_if_requested();       // Copiar los procesos para el volcado en segundo plano
+    profile_if_requested();    // Escribir el perfil si se ha pedido
+}
+
+// Función que representa el ciclo de reloj del sistema. Con --pulses termina tras dar pulse_limit
+// pulsos y con --unpaced los da seguidos, sin esperar al intervalo
 void *run_clock()
 {
     struct timespec interval;
-    if (kernel_machine.clock_rate == 1) // Configurar el intervalo del reloj según la frecuencia
+    if (MACHINE_CLOCK_RATE == 1) // Configurar el intervalo del reloj según la frecuencia
     {
         interval.tv_sec = 1;
         interval.tv_nsec = 0;
@@ -83,36 +411,21 @@ void *run_clock()
     else 
     {
         interval.tv_sec = 0;
-        interval.tv_nsec = 1000000000 / kernel_machine.clock_rate;
+        interval.tv_nsec = 1000000000 / MACHINE_CLOCK_RATE;
     }
 
     wait_for_system_start(); // Esperar a que el sistema esté listo
+    profile_thread("clock");
 
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    instance->started_ns = (unsigned long long)start.tv_sec * 1000000000ull + start.tv_nsec;
 
-    while (1)
+    while (instance->kernel_machine.pulse_limit == 0 || current_epoch() < instance->kernel_machine.pulse_limit)
     {
-        pthread_mutex_lock(&timer_mutex);
-        pthread_cond_broadcast(&clock_pulse_signal); // Emitir una señal de pulso de reloj
-        pthread_mutex_unlock(&timer_mutex);
-
-        process_completed = 0;
-        // Iterar a través de todos los hilos (threads) de todas las CPUs
-        for (int i = 0; i < kernel_machine.num_CPUs; i++)
-            for (int j = 0; j < kernel_machine.cores_per_CPU; j++)
-                for (int k = 0; k < kernel_machine.threads_per_core; k++)
-                {
-                    struct HT *thread = &kernel_machine.CPUs[i].cores[j].threads[k];
-                    if (thread->process == NULL) continue;
-
-                    // Ejecutar la instrucción del hilo (thread) actual
-                    printf(CYAN"Clock:"RESET" Ejecucion de la instrucción num. %d del proceso num. %d\n", thread->pc, thread->process->pid);
-                    execute_instruction(thread);
-                    thread->quantum_cycles--;
-                }
-
-        if (process_completed)
-            notify_scheduler(); // Señalar al planificador si un proceso ha terminado
-
-        nanosleep(&interval, NULL); // Esperar el siguiente ciclo del reloj
+        clock_pulse();
+        if (!instance->kernel_machine.unpaced)
+            nanosleep(&interval, NULL); // Esperar el siguiente ciclo del reloj
     }
+    return NULL;
 }
@@ -1,61 +1,100 @@
 #include <stdio.h>
 #include "kernel_simulator.h"
 #include "timer.h"
-
-#define MAX_TIMERS 8 // Número máximo de temporizadores
-
-struct timer timers[MAX_TIMERS];
-unsigned timer_count = 0; // Contador de temporizadores
+#include "arrivals.h"
+#include "io.h"
+#include "interrupts.h"
+#include "profiler.h"
+#include "reclaimer.h"
 
 // Función para añadir un nuevo temporizador
-static void register_timer(unsigned long time_ns, void callback())
+static void register_timer(unsigned long time_ns, enum irq_vector vector)
 {
-    if (timer_count == MAX_TIMERS) 
+    if (instance->timer_count == MAX_TIMERS) 
     {
         fprintf(stderr, "Timer: Sin temporizadores disponibles\n");
         return;
     }
 
-    timers[timer_count].target_pulse = (time_ns * kernel_machine.clock_rate) / 1000000000;
-    if (timers[timer_count].target_pulse == 0)
+    // En coma flotante para que periodos de segundos a frecuencias de GHz no desborden
+    instance->timers[instance->timer_count].target_pulse = (unsigned long)((double)time_ns * instance->kernel_machine.clock_rate / 1000000000);
+    if (instance->timers[instance->timer_count].target_pulse == 0)
     {
-        timers[timer_count].target_pulse = 1;
+        instance->timers[instance->timer_count].target_pulse = 1;
     }
-    timers[timer_count].pulse_counter = 0;
-    timers[timer_count].routine = callback;
-    timer_count++;
+    instance->timers[instance->timer_count].pulse_counter = 0;
+    instance->timers[instance->timer_count].vector = vector;
+    instance->timer_count++;
+}
+
+// Manejador de IRQ_COMPLETION: un hilo ha quedado libre
+static void notify_completion()
+{
+    notify_scheduler(); // Señalar al planificador si un proceso ha terminado
+    notify_loader();    // Y al cargador, que puede admitir cargas retenidas
+    notify_reclaimer(); // Y al reclamador, por si ha terminado alguno
 }
 
 // Función para señalizar el inicio del temporizador
 static void signal_timer_start()
 {
-    pthread_mutex_lock(&timer_init_mutex);
-    timer_init_flag = 1;
-    pthread_cond_signal(&timer_init_cond);
-    pthread_mutex_unlock(&timer_init_mutex);
+    pthread_mutex_lock(&instance->timer_init_mutex);
+    instance->timer_init_flag = 1;
+    pthread_cond_signal(&instance->timer_init_cond);
+    pthread_mutex_unlock(&instance->timer_init_mutex);
 }
 
-// Función principal del temporizador
+// Función principal del temporizador. Sólo cuenta pulsos y levanta interrupciones: las rutinas
+// corren en los hilos manejadores, así que una rutina lenta no retrasa a las demás ni al reloj
 void *run_timer()
 {
+    register_irq_handler(IRQ_SCHEDULER, notify_scheduler);
+    register_irq_handler(IRQ_GENERATOR, notify_process_generator);
+    register_irq_handler(IRQ_ARRIVALS, fire_arrivals);
+    register_irq_handler(IRQ_IO, io_complete);
+    register_irq_handler(IRQ_COMPLETION, notify_completion);
+    register_irq_handler(IRQ_CHECKPOINT, request_checkpoint);
+    register_irq_handler(IRQ_DUMP, request_dump);
+
     // Registrar temporizadores para el planificador y el generador de procesos
-    register_timer(1000000000 / kernel_machine.scheduler_rate, notify_scheduler);
-    register_timer(1000000000 / kernel_machine.process_generator_rate, notify_process_generator);
+    register_timer(1000000000 / instance->kernel_machine.scheduler_rate, IRQ_SCHEDULER);
+    if (instance->kernel_machine.arrival_model == ARRIVALS_FIXED)
+        register_timer(1000000000 / instance->kernel_machine.process_generator_rate, IRQ_GENERATOR);
+    else
+        initialize_arrivals(); // Las llegadas y la E/S se vigilan por su pulso absoluto
+    if (instance->kernel_machine.checkpoint_period > 0)
+        register_timer(instance->kernel_machine.checkpoint_period * 1000000000ul, IRQ_CHECKPOINT);
+    if (instance->kernel_machine.dump_period > 0)
+        register_timer(instance->kernel_machine.dump_period * 1000000000ul, IRQ_DUMP);
+    restore_timer_state(); // Recuperar los contadores si se arranca desde un checkpoint
 
-    pthread_mutex_lock(&timer_mutex);
     signal_timer_start(); // Señalar que el temporizador ha comenzado
+    profile_thread("timer");
+    unsigned long seen = current_epoch();
     while (1)
     {
-        pthread_cond_wait(&clock_pulse_signal, &timer_mutex);
-
-        // Comprobar todos los temporizadores registrados
-        for (int i = 0; i < timer_count; i++)
-        {   
-            if (++timers[i].pulse_counter == timers[i].target_pulse)
-            {
-                timers[i].pulse_counter = 0;
-                timers[i].routine(); // Ejecutar la rutina del temporizador
+        // Si el temporizador se ha retrasado recupera todos los pulsos perdidos de una vez
+        unsigned long epoch = wait_for_tick(seen);
+
+        pthread_mutex_lock(&instance->timer_mutex);
+        for (; seen < epoch; seen++)
+        {
+            // Comprobar todos los temporizadores registrados
+            for (int i = 0; i < instance->timer_count; i++)
+            {   
+                if (++instance->timers[i].pulse_counter == instance->timers[i].target_pulse)
+                {
+                    instance->timers[i].pulse_counter = 0;
+                    raise_irq(instance->timers[i].vector);
+                }
             }
         }
+        pthread_mutex_unlock(&instance->timer_mutex);
+
+        // Una interrupción perdida devuelve su plazo para reintentarla en el siguiente pulso
+        if (instance->kernel_machine.arrival_model != ARRIVALS_FIXED && claim_arrivals(epoch) && !raise_irq(IRQ_ARRIVALS))
+            release_arrivals(epoch);
+        if (claim_io_completion(epoch) && !raise_irq(IRQ_IO))
+            release_io_completion(epoch);
     }
 }